@@ -0,0 +1,71 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QList>
+#include <QString>
+#include <QProcess>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+
+#ifndef BENCHMARKHELPERS_H
+#define BENCHMARKHELPERS_H
+
+// Helpers shared by the headless benchmarks
+
+// Nearest-rank percentile of sorted samples
+inline double percentile(const QList<double>& sortedSamples, double p)
+{
+    if (sortedSamples.isEmpty()) return 0.;
+
+    qsizetype rank = static_cast<qsizetype>(std::ceil(p / 100. * sortedSamples.size()));
+    return sortedSamples.at(std::clamp<qsizetype>(rank - 1, 0, sortedSamples.size() - 1));
+}
+
+// Line printed by a child process on its standard output, empty if none arrives before timeout
+inline QString readLine(QProcess& process, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!process.canReadLine())
+    {
+        if (timer.elapsed() > timeout || !process.waitForReadyRead(timeout - timer.elapsed())) return QString();
+    }
+    return QString::fromLocal8Bit(process.readLine()).trimmed();
+}
+
+// Run the event loop until signal is emitted by sender, or until timeout milliseconds have passed
+template <typename Sender, typename Signal>
+bool waitForSignal(Sender* sender, Signal signal, int timeout)
+{
+    QEventLoop loop;
+    bool emitted = false;
+
+    QObject::connect(sender, signal, &loop, [&]() {
+        emitted = true;
+        loop.quit();
+    });
+    QTimer::singleShot(timeout, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    return emitted;
+}
+
+#endif
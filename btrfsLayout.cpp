@@ -0,0 +1,119 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "btrfsLayout.hpp"
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QDebug>
+
+// Run a short command to completion, logging its output
+static bool runCommand(const QString& program, const QStringList& arguments)
+{
+    QProcess process;
+    process.setProcessChannelMode(QProcess::MergedChannels);
+    process.start(program, arguments);
+
+    if (!process.waitForFinished(-1))
+    {
+        qWarning() << "Could not run" << program << arguments << ":" << process.errorString();
+        return false;
+    }
+
+    QByteArray output = process.readAll();
+    if (!output.isEmpty()) qDebug() << output;
+
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+    {
+        qWarning() << program << arguments << "failed with exit code" << process.exitCode();
+        return false;
+    }
+
+    return true;
+}
+
+QStringList BtrfsLayout::mountOptions(bool compression)
+{
+    QStringList options;
+    if (compression)
+    {
+        options << "compress=zstd";
+    }
+    return options;
+}
+
+bool BtrfsLayout::registerDevices(const QStringList& deviceNodes)
+{
+    return runCommand("btrfs", QStringList{ "device", "scan" } + deviceNodes);
+}
+
+bool BtrfsLayout::createSubvolumes(const QString& deviceNode)
+{
+    // Subvolumes are created on the top level subvolume, mounted on a temporary directory
+    QTemporaryDir topLevelMountPoint;
+
+    if (!topLevelMountPoint.isValid())
+    {
+        qWarning() << "BtrfsLayout::createSubvolumes(): Could not create temporary mountpoint";
+        return false;
+    }
+
+    if (!runCommand("mount", { "-o", "subvolid=5", deviceNode, topLevelMountPoint.path() }))
+    {
+        return false;
+    }
+
+    bool success = true;
+    for (const QPair<QString, QString>& subvolume : subvolumes)
+    {
+        if (!runCommand("btrfs", { "subvolume", "create", topLevelMountPoint.path() + "/" + subvolume.first }))
+        {
+            success = false;
+            break;
+        }
+    }
+
+    runCommand("umount", { topLevelMountPoint.path() });
+
+    return success;
+}
+
+bool BtrfsLayout::mountSubvolumes(const QString& deviceNode, const QString& mountPoint, bool compression)
+{
+    for (const QPair<QString, QString>& subvolume : subvolumes)
+    {
+        QString subvolumeMountPoint = subvolume.second.isEmpty() ? mountPoint : mountPoint + "/" + subvolume.second;
+
+        if (!QDir().mkpath(subvolumeMountPoint))
+        {
+            qWarning() << "BtrfsLayout::mountSubvolumes(): Failed to create mountpoint" << subvolumeMountPoint;
+            return false;
+        }
+
+        QStringList options = mountOptions(compression);
+        options << "subvol=" + subvolume.first;
+
+        if (!runCommand("mount", { "-o", options.join(","), deviceNode, subvolumeMountPoint }))
+        {
+            return false;
+        }
+
+        qDebug() << "Mounted subvolume" << subvolume.first << "on" << subvolumeMountPoint;
+    }
+
+    return true;
+}
@@ -0,0 +1,53 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+#ifndef BTRFSLAYOUT_H
+#define BTRFSLAYOUT_H
+
+// Standard subvolume layout of a Btrfs root filesystem
+namespace BtrfsLayout
+{
+    // Subvolume names and their mountpoints relative to the root of the system
+    const QList<QPair<QString, QString>> subvolumes = QList<QPair<QString, QString>>
+    {
+        { "@", "" },
+        { "@home", "home" },
+        { "@log", "var/log" },
+        { "@pkg", "var/cache/pacman/pkg" },
+        { "@snapshots", ".snapshots" },
+        { "@swap", "swap" }                 // Swap file, kept out of snapshots
+    };
+
+    // Mount options shared by every subvolume. genfstab copies them into the fstab of the installed system.
+    QStringList mountOptions(bool compression);
+
+    // Make the kernel aware of every device of a multi-device filesystem, which can only be mounted once all of them are known
+    bool registerDevices(const QStringList& deviceNodes);
+
+    // Create the subvolumes on a freshly created Btrfs filesystem
+    bool createSubvolumes(const QString& deviceNode);
+
+    // Mount every subvolume on its place under mountPoint
+    bool mountSubvolumes(const QString& deviceNode, const QString& mountPoint, bool compression);
+}
+
+#endif
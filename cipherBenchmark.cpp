@@ -0,0 +1,111 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "cipherBenchmark.hpp"
+#include <QRegularExpression>
+#include <QDebug>
+
+void CipherBenchmark::start()
+{
+    if (isRunning())
+    {
+        qWarning() << "CipherBenchmark::start(): Benchmark is already running";
+        return;
+    }
+
+    currentCandidate = -1;
+    benchmarkNextCandidate();
+}
+
+void CipherBenchmark::benchmarkNextCandidate()
+{
+    currentCandidate++;
+
+    if (currentCandidate >= candidates.count())
+    {
+        benchmarkProcess = nullptr;
+        CipherCandidate selected = selectedCipher();
+        qDebug() << "Selected cipher" << selected.cipher << selected.keySize << "bits at" << selected.throughputMiBps() << "MiB/s";
+        emit finished();
+        return;
+    }
+
+    const CipherCandidate& candidate = candidates.at(currentCandidate);
+
+    // Measures encryption and decryption in memory only, nothing is written to the devices
+    benchmarkProcess = new QProcess(this);
+    benchmarkProcess->setProcessChannelMode(QProcess::MergedChannels);
+
+    connect(benchmarkProcess, &QProcess::finished, this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
+        QString output = QString::fromLocal8Bit(benchmarkProcess->readAll());
+        benchmarkProcess->deleteLater();
+
+        CipherCandidate& candidate = candidates[currentCandidate];
+        if (exitStatus != QProcess::NormalExit || exitCode != 0 || !parseBenchmarkOutput(output, candidate))
+        {
+            // Usually the kernel does not provide the cipher, which then can not be used anyway
+            qWarning() << "Could not benchmark" << candidate.cipher << ":" << output.trimmed();
+        }
+
+        benchmarkNextCandidate();
+    });
+
+    connect(benchmarkProcess, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+
+        qWarning() << "Failed to start cryptsetup benchmark";
+        benchmarkProcess->deleteLater();
+        benchmarkNextCandidate();
+    });
+
+    benchmarkProcess->start("cryptsetup", { "benchmark", "--cipher", candidate.cipher, "--key-size", QString::number(candidate.keySize) });
+}
+
+bool CipherBenchmark::parseBenchmarkOutput(const QString& output, CipherCandidate& candidate)
+{
+    // e.g. "        aes-xts        512b      2034.2 MiB/s      2045.4 MiB/s"
+    static const QRegularExpression resultLine("^\\s*\\S+\\s+(\\d+)b\\s+([\\d.]+)\\s+MiB/s\\s+([\\d.]+)\\s+MiB/s\\s*$",
+        QRegularExpression::MultilineOption);
+
+    QRegularExpressionMatch match = resultLine.match(output);
+    if (!match.hasMatch()) return false;
+
+    candidate.encryptionMiBps = match.captured(2).toDouble();
+    candidate.decryptionMiBps = match.captured(3).toDouble();
+    candidate.measured = true;
+
+    qDebug() << "Benchmarked" << candidate.cipher << candidate.keySize << "bits - encryption:" << candidate.encryptionMiBps
+             << "MiB/s decryption:" << candidate.decryptionMiBps << "MiB/s";
+
+    return true;
+}
+
+CipherCandidate CipherBenchmark::selectedCipher() const
+{
+    CipherCandidate selected = candidates.first();
+
+    for (const CipherCandidate& candidate : candidates)
+    {
+        if (candidate.measured && (!selected.measured || candidate.throughputMiBps() > selected.throughputMiBps()))
+        {
+            selected = candidate;
+        }
+    }
+
+    return selected;
+}
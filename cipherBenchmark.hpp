@@ -0,0 +1,81 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <QObject>
+#include <QProcess>
+#include <QList>
+#include <QString>
+#include <algorithm>
+
+#ifndef CIPHERBENCHMARK_H
+#define CIPHERBENCHMARK_H
+
+// A dm-crypt cipher and key size, with its in-memory throughput measured by cryptsetup benchmark
+struct CipherCandidate
+{
+    QString cipher;                    // cryptsetup cipher specification, e.g. aes-xts-plain64
+    int keySize;                       // Bits
+    QString description;
+    double encryptionMiBps = 0.;
+    double decryptionMiBps = 0.;
+    bool measured = false;
+
+    // Installations read more than they write, but both matter, so the slowest direction counts
+    double throughputMiBps() const
+    {
+        return std::min(encryptionMiBps, decryptionMiBps);
+    }
+};
+
+// Benchmarks the candidate ciphers of an encrypted root one after the other, so they do not compete for
+// the CPU, and picks the fastest one. Every candidate is secure enough: AES-XTS with a 256 bit AES key, and
+// Adiantum for CPUs without AES instructions, where it is several times faster than AES.
+class CipherBenchmark : public QObject
+{
+Q_OBJECT
+private:
+    QList<CipherCandidate> candidates = QList<CipherCandidate>
+    {
+        { "aes-xts-plain64", 512, "AES-XTS" },
+        { "xchacha12,aes-adiantum-plain64", 256, "Adiantum" }
+    };
+
+    int currentCandidate = -1;
+    QProcess* benchmarkProcess = nullptr;
+
+    void benchmarkNextCandidate();
+    bool parseBenchmarkOutput(const QString& output, CipherCandidate& candidate);
+
+public:
+    explicit CipherBenchmark(QObject* parent = nullptr) : QObject(parent) {};
+
+    void start();
+
+    bool isRunning() const
+    {
+        return benchmarkProcess != nullptr;
+    }
+
+    // Fastest measured candidate. Defaults to AES-XTS if nothing could be measured.
+    CipherCandidate selectedCipher() const;
+
+signals:
+    void finished();
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "deviceProbe.hpp"
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QDebug>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+void DeviceProbe::run()
+{
+    for (const QString& deviceNode : deviceNodes)
+    {
+        if (isInterruptionRequested()) return;
+
+        emit deviceProbed(probeDevice(deviceNode));
+    }
+}
+
+DeviceProbeResult DeviceProbe::probeDevice(const QString& deviceNode)
+{
+    DeviceProbeResult result;
+    result.deviceNode = deviceNode;
+
+    int fd = open(deviceNode.toLocal8Bit().constData(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        qWarning() << "DeviceProbe: Could not open" << deviceNode << ":" << strerror(errno);
+        return result;
+    }
+
+    uint64_t deviceSize = 0;
+    int logicalBlockSize = 512;
+    ioctl(fd, BLKGETSIZE64, &deviceSize);
+    ioctl(fd, BLKSSZGET, &logicalBlockSize);
+
+    if (deviceSize < static_cast<uint64_t>(sequentialBytes * 2))
+    {
+        qDebug() << "DeviceProbe:" << deviceNode << "is too small to be probed";
+        close(fd);
+        return result;
+    }
+
+    // O_DIRECT needs buffers aligned to the logical block size
+    const size_t bufferAlignment = std::max<size_t>(logicalBlockSize, 4096);
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, bufferAlignment, sequentialChunkSize) != 0)
+    {
+        qWarning() << "DeviceProbe: Could not allocate the read buffer";
+        close(fd);
+        return result;
+    }
+
+    // Sequential reads from the middle of the device, away from the partition table and the fastest outer tracks of HDDs
+    const qint64 sequentialStart = (static_cast<qint64>(deviceSize) / 2) / sequentialChunkSize * sequentialChunkSize;
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 bytesRead = 0;
+    while (bytesRead < sequentialBytes && !isInterruptionRequested())
+    {
+        ssize_t readSize = pread(fd, buffer, sequentialChunkSize, sequentialStart + bytesRead);
+        if (readSize <= 0)
+        {
+            qWarning() << "DeviceProbe: Sequential read of" << deviceNode << "failed:" << strerror(errno);
+            free(buffer);
+            close(fd);
+            return result;
+        }
+        bytesRead += readSize;
+    }
+
+    const qint64 sequentialNs = std::max<qint64>(timer.nsecsElapsed(), 1);
+
+    // Random reads of small blocks spread over the whole device
+    const qint64 randomReadBlocks = static_cast<qint64>(deviceSize) / randomReadSize;
+    std::vector<double> latencies;
+    latencies.reserve(randomReads);
+
+    for (int i = 0; i < randomReads && !isInterruptionRequested(); i++)
+    {
+        const qint64 offset = QRandomGenerator::global()->bounded(randomReadBlocks) * randomReadSize;
+
+        timer.restart();
+        if (pread(fd, buffer, randomReadSize, offset) != randomReadSize)
+        {
+            qWarning() << "DeviceProbe: Random read of" << deviceNode << "failed:" << strerror(errno);
+            free(buffer);
+            close(fd);
+            return result;
+        }
+        latencies.push_back(timer.nsecsElapsed() / 1e6);
+    }
+
+    free(buffer);
+    close(fd);
+
+    if (latencies.empty()) return result;
+
+    std::nth_element(latencies.begin(), latencies.begin() + latencies.size() / 2, latencies.end());
+
+    result.sequentialBytesPerSecond = static_cast<double>(bytesRead) * 1e9 / sequentialNs;
+    result.randomReadLatencyMs = latencies[latencies.size() / 2];
+    result.valid = true;
+
+    qDebug() << "Probed" << deviceNode << "- sequential:" << result.sequentialBytesPerSecond / (1024 * 1024) << "MiB/s"
+             << "random read latency:" << result.randomReadLatencyMs << "ms";
+
+    return result;
+}
@@ -0,0 +1,76 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QThread>
+#include <QList>
+#include <QString>
+#include <QMetaType>
+
+#ifndef DEVICEPROBE_H
+#define DEVICEPROBE_H
+
+// Measured read performance of a block device
+struct DeviceProbeResult
+{
+    QString deviceNode;
+    bool valid = false;
+    double sequentialBytesPerSecond = 0.;
+    double randomReadLatencyMs = 0.;   // Median latency of small random reads
+
+    // Estimated time to read an installation-like workload, made of a few GiB of package data and many small
+    // files. Lower is faster. Combines both measurements, so a fast sequential HDD still loses to an SSD.
+    double estimatedWorkloadSeconds() const
+    {
+        if (!valid || sequentialBytesPerSecond <= 0.) return -1.;
+        return 4. * 1024 * 1024 * 1024 / sequentialBytesPerSecond + 100000. * randomReadLatencyMs / 1000.;
+    }
+};
+Q_DECLARE_METATYPE(DeviceProbeResult)
+
+// Measures sequential and random read performance of block devices in a background thread. Reads are
+// O_DIRECT so the page cache does not hide the device, and only a small sample of each device is read.
+// Nothing is ever written.
+class DeviceProbe : public QThread
+{
+Q_OBJECT
+private:
+    static constexpr qint64 sequentialBytes = 64 * 1024 * 1024;   // Read in chunks of sequentialChunkSize
+    static constexpr qint64 sequentialChunkSize = 1024 * 1024;
+    static constexpr int randomReads = 128;
+    static constexpr qint64 randomReadSize = 4096;
+
+    QList<QString> deviceNodes;
+
+    DeviceProbeResult probeDevice(const QString& deviceNode);
+
+protected:
+    void run() override;
+
+public:
+    explicit DeviceProbe(QObject* parent = nullptr) : QThread(parent) {};
+
+    // Queue a device to be probed. Must be called before start().
+    void addDevice(const QString& deviceNode)
+    {
+        deviceNodes.append(deviceNode);
+    }
+
+signals:
+    void deviceProbed(const DeviceProbeResult& result);
+};
+
+#endif
@@ -0,0 +1,519 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Benchmark of the package download stages of the installer against delphinos-mock-mirror. Mirrors of different
+// speeds and latencies are served from a temporary repository, and every stage is checked for correctness as
+// well as timed: the mirror ranking must order the mirrors by their configured bandwidth, and the package
+// downloads must deliver every file intact although some mirrors stall or answer with errors.
+//
+//   delphinos-download-benchmark --iterations 5
+//   delphinos-download-benchmark --mirror 0:5 --mirror 1000:40 --mirror 200:150
+//   delphinos-download-benchmark --download-mirror 0:5:128 --download-mirror 2000:20:-1:50 --packages 100
+//   delphinos-download-benchmark --link 2000 --packages 200
+
+#include "mirrorRanker.hpp"
+#include "packageDownloader.hpp"
+#include "benchmarkHelpers.hpp"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QRandomGenerator>
+#include <QProcess>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QCryptographicHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QUrl>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+const qint64 MiB = 1024 * 1024;
+
+// File of random bytes in the repository served by the mock mirrors
+static bool writeRandomFile(const QString& path, qint64 size)
+{
+    QDir().mkpath(QFileInfo(path).path());
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    QByteArray block(MiB, Qt::Uninitialized);
+    for (qint64 written = 0; written < size; written += block.size())
+    {
+        QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(block.data()), block.size() / sizeof(quint32));
+        file.write(block.constData(), std::min<qint64>(block.size(), size - written));
+    }
+    return true;
+}
+
+// SHA-256 of a file, in hexadecimal
+static QByteArray sha256(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(&file);
+    return hash.result().toHex();
+}
+
+// Whether every file is in directory, intact, without partial files left behind
+static bool isCacheComplete(const QString& directory, const QList<PackageFile>& files)
+{
+    bool complete = QDir(directory).entryList({ "*.part" }, QDir::Files).isEmpty();
+    for (const PackageFile& file : files)
+    {
+        if (sha256(directory + "/" + file.fileName) != file.sha256)
+        {
+            qWarning() << file.fileName << "is missing or corrupted";
+            complete = false;
+        }
+    }
+    return complete;
+}
+
+// Start the mock with a mirror of every profile, returning the servers of the mirrors
+static QStringList startMock(QProcess& mock, const QString& program, const QString& root, const QStringList& profiles, qint64 linkKiBPerSecond = 0)
+{
+    QStringList arguments{ "--root", root, "--link", QString::number(linkKiBPerSecond) };
+    for (const QString& profile : profiles) arguments << "--mirror" << "0:" + profile;
+
+    mock.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    mock.start(program, arguments);
+
+    QString readyLine = readLine(mock, 10000);
+    if (!readyLine.startsWith("ready")) return QStringList();
+
+    QStringList servers;
+    for (const QString& port : readyLine.split(' ', Qt::SkipEmptyParts).mid(1))
+    {
+        servers << QString("http://127.0.0.1:%1/$repo/os/$arch").arg(port);
+    }
+    return servers;
+}
+
+// Mirror served by the mock, with its configured bandwidth
+struct BenchmarkMirror
+{
+    QString server;
+    qint64 kibPerSecond;    // 0 is unthrottled
+    int latency;
+};
+
+class DownloadBenchmark
+{
+private:
+    QList<BenchmarkMirror> mirrors;
+    int timeBudget;
+
+    QList<double> rankingMilliseconds;
+    int correctRankings = 0;
+    QList<MirrorScore> lastRanking;
+
+    QList<double> downloadSeconds;
+    QList<int> downloadFailovers;
+    QList<int> downloadConcurrency;
+    int correctDownloads = 0;
+    qint64 downloadBytes = 0;
+    QStringList downloadServers;
+    QTemporaryDir healthDirectory;
+
+    bool resumeRan = false;
+    bool resumeCorrect = false;
+    qint64 resumeInterruptedBytes = 0;
+    qint64 resumeRepeatedBytes = 0;
+
+    bool comparisonRan = false;
+    bool comparisonCorrect = false;
+    double engineSeconds = 0.;
+    double sequentialSeconds = 0.;
+
+    // The servers ordered by their configured bandwidth, the order the ranking should find
+    QStringList expectedRanking() const
+    {
+        QList<BenchmarkMirror> sorted = mirrors;
+        std::stable_sort(sorted.begin(), sorted.end(), [](const BenchmarkMirror& mirror, const BenchmarkMirror& other) {
+            qint64 bandwidth = mirror.kibPerSecond == 0 ? std::numeric_limits<qint64>::max() : mirror.kibPerSecond;
+            qint64 otherBandwidth = other.kibPerSecond == 0 ? std::numeric_limits<qint64>::max() : other.kibPerSecond;
+            return bandwidth > otherBandwidth;
+        });
+
+        QStringList servers;
+        for (const BenchmarkMirror& mirror : sorted) servers << mirror.server;
+        return servers;
+    }
+
+public:
+    DownloadBenchmark(const QList<BenchmarkMirror>& _mirrors, int _timeBudget) : mirrors(_mirrors), timeBudget(_timeBudget) {}
+
+    bool rankMirrors(const QString& unreachableServer)
+    {
+        QStringList servers;
+        for (const BenchmarkMirror& mirror : mirrors) servers << mirror.server;
+        servers << unreachableServer;
+
+        MirrorRanker ranker;
+        ranker.setTimeBudget(timeBudget);
+
+        QElapsedTimer timer;
+        timer.start();
+        ranker.start(servers);
+
+        if (!waitForSignal(&ranker, &MirrorRanker::finished, timeBudget * 2))
+        {
+            qCritical() << "The mirror ranking did not finish";
+            return false;
+        }
+        rankingMilliseconds << timer.nsecsElapsed() / 1e6;
+
+        lastRanking = ranker.ranked();
+        QStringList ranking;
+        for (const MirrorScore& score : lastRanking) ranking << score.server;
+
+        if (ranking == expectedRanking() + QStringList{ unreachableServer })
+        {
+            correctRankings++;
+        } else {
+            qWarning() << "Unexpected ranking:" << ranking;
+        }
+        return true;
+    }
+
+    // Download files from servers into an empty cache. The mirror health is kept from one iteration to the next,
+    // as it is across sessions of the live environment.
+    bool downloadPackages(const QStringList& servers, const QList<PackageFile>& files, int stallTimeout)
+    {
+        QTemporaryDir cache;
+        downloadServers = servers;
+
+        PackageDownloader downloader;
+        downloader.setHealthPath(healthDirectory.filePath("mirror-health.ini"));
+        downloader.setServers(servers);
+        downloader.setDestination(cache.path());
+        downloader.setStallTimeout(stallTimeout);
+        downloader.setGracePeriod(stallTimeout);
+
+        downloadBytes = 0;
+        for (const PackageFile& file : files) downloadBytes += file.size;
+
+        QElapsedTimer timer;
+        timer.start();
+        downloader.start(files);
+
+        if (downloader.isRunning() && !waitForSignal(&downloader, &PackageDownloader::finished, 600000))
+        {
+            qCritical() << "The package downloads did not finish";
+            return false;
+        }
+        downloadSeconds << timer.nsecsElapsed() / 1e9;
+        downloadFailovers << downloader.failoverCount();
+        downloadConcurrency << downloader.tunedConcurrency();
+
+        if (isCacheComplete(cache.path(), files)) correctDownloads++;
+
+        return true;
+    }
+
+    // Cancel a download halfway and continue it with another downloader on the same cache
+    bool resumeDownload(const QStringList& servers, const QList<PackageFile>& files)
+    {
+        QTemporaryDir cache;
+        QTemporaryDir health;
+
+        PackageDownloader interrupted;
+        interrupted.setHealthPath(health.filePath("mirror-health.ini"));
+        interrupted.setServers(servers);
+        interrupted.setDestination(cache.path());
+
+        QObject::connect(&interrupted, &PackageDownloader::progress, [&interrupted](qint64 bytesReceived, qint64 bytesTotal) {
+            if (bytesReceived * 2 >= bytesTotal) interrupted.cancel();
+        });
+
+        interrupted.start(files);
+        if (interrupted.isRunning() && !waitForSignal(&interrupted, &PackageDownloader::finished, 600000))
+        {
+            qCritical() << "The interrupted download did not stop";
+            return false;
+        }
+
+        PackageDownloader resumed;
+        resumed.setHealthPath(health.filePath("mirror-health.ini"));
+        resumed.setServers(servers);
+        resumed.setDestination(cache.path());
+
+        resumed.start(files);
+        if (resumed.isRunning() && !waitForSignal(&resumed, &PackageDownloader::finished, 600000))
+        {
+            qCritical() << "The resumed download did not finish";
+            return false;
+        }
+
+        resumeInterruptedBytes = interrupted.bytesDownloaded();
+        resumeRepeatedBytes = interrupted.bytesDownloaded() + resumed.bytesDownloaded() - resumed.bytesTotal();
+        resumeCorrect = isCacheComplete(cache.path(), files) && resumeRepeatedBytes == 0;
+        resumeRan = true;
+
+        return true;
+    }
+
+    // The downloader against files downloaded one at a time over a connection each, on the same mirrors
+    bool compareWithSequential(const QStringList& servers, const QList<PackageFile>& files)
+    {
+        QTemporaryDir cache;
+        QTemporaryDir health;
+
+        PackageDownloader downloader;
+        downloader.setHealthPath(health.filePath("mirror-health.ini"));
+        downloader.setServers(servers);
+        downloader.setDestination(cache.path());
+
+        QElapsedTimer timer;
+        timer.start();
+        downloader.start(files);
+        if (downloader.isRunning() && !waitForSignal(&downloader, &PackageDownloader::finished, 600000))
+        {
+            qCritical() << "The package downloads did not finish";
+            return false;
+        }
+        engineSeconds = timer.nsecsElapsed() / 1e9;
+        comparisonCorrect = isCacheComplete(cache.path(), files);
+
+        QNetworkAccessManager networkAccessManager;
+        timer.start();
+        for (const PackageFile& file : files)
+        {
+            QNetworkRequest request(QUrl(MirrorRanker::repositoryUrl(servers.first(), file.repository, file.fileName)));
+            request.setRawHeader("Connection", "close");
+
+            QNetworkReply* reply = networkAccessManager.get(request);
+            if (!reply->isFinished() && !waitForSignal(reply, &QNetworkReply::finished, 600000))
+            {
+                qCritical() << "The sequential download of" << file.fileName << "did not finish";
+                delete reply;
+                return false;
+            }
+
+            if (QCryptographicHash::hash(reply->readAll(), QCryptographicHash::Sha256).toHex() != file.sha256)
+            {
+                qWarning() << "The sequential download of" << file.fileName << "is corrupted";
+                comparisonCorrect = false;
+            }
+            delete reply;
+        }
+        sequentialSeconds = timer.nsecsElapsed() / 1e9;
+        comparisonRan = true;
+
+        return true;
+    }
+
+    bool isCorrect() const
+    {
+        return correctRankings == rankingMilliseconds.count() && correctDownloads == downloadSeconds.count()
+            && (!resumeRan || resumeCorrect) && (!comparisonRan || comparisonCorrect);
+    }
+
+    void printReport(QTextStream& out)
+    {
+        std::sort(rankingMilliseconds.begin(), rankingMilliseconds.end());
+
+        out << "Mirror ranking: " << correctRankings << "/" << rankingMilliseconds.count() << " correct, "
+            << QString("p50 %1 ms, max %2 ms\n").arg(percentile(rankingMilliseconds, 50), 0, 'f', 1)
+                .arg(rankingMilliseconds.isEmpty() ? 0. : rankingMilliseconds.last(), 0, 'f', 1);
+
+        out << QString("%1 %2 %3 %4\n").arg("server", -48).arg("connect ms", 11).arg("KiB/s", 10).arg("configured", 11);
+        for (const MirrorScore& score : lastRanking)
+        {
+            QString configured = "-";
+            for (const BenchmarkMirror& mirror : mirrors)
+            {
+                if (mirror.server == score.server) configured = mirror.kibPerSecond == 0 ? "unlimited" : QString::number(mirror.kibPerSecond);
+            }
+            out << QString("%1 %2 %3 %4\n").arg(score.server, -48).arg(score.connectMilliseconds, 11)
+                .arg(score.bytesPerSecond / 1024., 10, 'f', 0).arg(configured, 11);
+        }
+
+        if (downloadSeconds.isEmpty()) return;
+
+        out << "\nPackage downloads: " << correctDownloads << "/" << downloadSeconds.count() << " correct, "
+            << QString("%1 MiB per iteration\n").arg(downloadBytes / double(MiB), 0, 'f', 1);
+        out << QString("%1 %2 %3 %4 %5\n").arg("iteration", 9).arg("seconds", 9).arg("MiB/s", 8).arg("failovers", 10).arg("tuned streams", 14);
+        for (int i = 0; i < downloadSeconds.count(); i++)
+        {
+            out << QString("%1 %2 %3 %4 %5\n").arg(i + 1, 9).arg(downloadSeconds.at(i), 9, 'f', 2)
+                .arg(downloadBytes / double(MiB) / downloadSeconds.at(i), 8, 'f', 2).arg(downloadFailovers.at(i), 10)
+                .arg(downloadConcurrency.at(i), 14);
+        }
+
+        MirrorHealth health(healthDirectory.filePath("mirror-health.ini"));
+        health.load();
+        out << QString("%1 %2 %3\n").arg("server", -48).arg("KiB/s", 10).arg("error rate", 11);
+        for (const QString& server : health.byHealth(downloadServers))
+        {
+            MirrorStatistics statistics = health.statistics(server);
+            out << QString("%1 %2 %3\n").arg(server, -48).arg(statistics.bytesPerSecond / 1024., 10, 'f', 0).arg(statistics.errorRate, 11, 'f', 2);
+        }
+
+        if (resumeRan)
+        {
+            out << QString("\nResume: %1, %2 MiB before the interruption, %3 bytes downloaded twice\n")
+                .arg(resumeCorrect ? "correct" : "incorrect").arg(resumeInterruptedBytes / double(MiB), 0, 'f', 1).arg(resumeRepeatedBytes);
+        }
+
+        if (comparisonRan)
+        {
+            out << QString("Healthy mirrors: %1, downloader %2 s, one file per connection %3 s, %4x\n")
+                .arg(comparisonCorrect ? "correct" : "incorrect").arg(engineSeconds, 0, 'f', 2).arg(sequentialSeconds, 0, 'f', 2)
+                .arg(engineSeconds > 0 ? sequentialSeconds / engineSeconds : 0., 0, 'f', 2);
+        }
+    }
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("delphinos-download-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark of the package download stages of delphinos-installer against mock mirrors");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "iterations", "Number of times every stage is run.", "n", "3" },
+        { "mirror", "A mock mirror, as KiB/s:latency ms[:stall after KiB[:error percent]]. May be repeated.", "profile" },
+        { "download-mirror", "A mock mirror of the package downloads, in the format of --mirror. May be repeated.", "profile" },
+        { "time-budget", "Time budget of the mirror ranking, in milliseconds.", "ms", "8000" },
+        { "db-size", "Size of the probed database, in MiB.", "MiB", "4" },
+        { "packages", "Number of package files downloaded.", "n", "120" },
+        { "package-size", "Largest size of a package file, in KiB.", "KiB", "2048" },
+        { "link", "Bandwidth shared by every download, in KiB/s, like the link of the machine. 0 is unlimited.", "KiB/s", "8000" },
+        { "stall-timeout", "Milliseconds without data before a download leaves its mirror.", "ms", "2000" },
+        { "mock", "Path of delphinos-mock-mirror.", "path", QCoreApplication::applicationDirPath() + "/delphinos-mock-mirror" },
+    });
+    parser.process(app);
+
+    QStringList profiles = parser.values("mirror");
+    if (profiles.isEmpty()) profiles = QStringList{ "0:5", "8000:20", "2000:40", "400:120" };
+
+    // An unthrottled mirror that stalls every response, one that answers half of the requests with errors,
+    // and two healthy ones
+    QStringList downloadProfiles = parser.values("download-mirror");
+    if (downloadProfiles.isEmpty()) downloadProfiles = QStringList{ "0:5:256", "0:10:-1:50", "4000:20", "1000:60" };
+
+    // The repository served by every mirror
+    QTemporaryDir repository;
+    if (!writeRandomFile(repository.filePath("extra/os/x86_64/extra.db"), parser.value("db-size").toLongLong() * MiB))
+    {
+        qCritical() << "Could not create the mock repository";
+        return 1;
+    }
+
+    QList<PackageFile> files;
+    for (int i = 0; i < parser.value("packages").toInt(); i++)
+    {
+        PackageFile file;
+        file.repository = "core";
+        file.fileName = QString("package-%1-1-x86_64.pkg.tar.zst").arg(i);
+        file.size = QRandomGenerator::global()->bounded(16, std::max(17, parser.value("package-size").toInt())) * 1024;
+
+        QString path = repository.filePath("core/os/x86_64/" + file.fileName);
+        if (!writeRandomFile(path, file.size))
+        {
+            qCritical() << "Could not create the mock repository";
+            return 1;
+        }
+        file.sha256 = sha256(path);
+        files << file;
+    }
+
+    QProcess rankingMock;
+    QStringList rankingServers = startMock(rankingMock, parser.value("mock"), repository.path(), profiles);
+    QProcess downloadMock;
+    QStringList downloadServers = startMock(downloadMock, parser.value("mock"), repository.path(), downloadProfiles, parser.value("link").toLongLong());
+
+    if (rankingServers.count() != profiles.count() || downloadServers.count() != downloadProfiles.count())
+    {
+        qCritical() << "The mock mirrors did not start:" << parser.value("mock");
+        return 1;
+    }
+
+    QList<BenchmarkMirror> mirrors;
+    for (int i = 0; i < rankingServers.count(); i++)
+    {
+        QStringList fields = profiles.at(i).split(':');
+        mirrors << BenchmarkMirror{ rankingServers.at(i), fields.value(0).toLongLong(), fields.value(1).toInt() };
+    }
+
+    // Nothing listens on the discard port, so this mirror cannot be reached
+    const QString unreachableServer = "http://127.0.0.1:9/$repo/os/$arch";
+
+    DownloadBenchmark benchmark(mirrors, parser.value("time-budget").toInt());
+    int exitCode = 0;
+
+    for (int i = 0; i < std::max(1, parser.value("iterations").toInt()); i++)
+    {
+        if (!benchmark.rankMirrors(unreachableServer))
+        {
+            exitCode = 1;
+            break;
+        }
+    }
+
+    // The troubled mirrors come first, as a stale ranking would have them
+    for (int i = 0; i < std::max(1, parser.value("iterations").toInt()) && exitCode == 0; i++)
+    {
+        if (!benchmark.downloadPackages(downloadServers, files, parser.value("stall-timeout").toInt()))
+        {
+            exitCode = 1;
+        }
+    }
+
+    // Mirrors that neither stall nor answer with errors
+    QStringList healthyServers;
+    for (int i = 0; i < downloadServers.count(); i++)
+    {
+        QStringList fields = downloadProfiles.at(i).split(':');
+        if (fields.value(2, "-1").toLongLong() < 0 && fields.value(3, "0").toInt() == 0) healthyServers << downloadServers.at(i);
+    }
+
+    if (exitCode == 0 && !healthyServers.isEmpty())
+    {
+        if (!benchmark.resumeDownload(healthyServers, files) || !benchmark.compareWithSequential(healthyServers, files))
+        {
+            exitCode = 1;
+        }
+    }
+
+    if (!benchmark.isCorrect()) exitCode = 1;
+
+    QTextStream out(stdout);
+    benchmark.printReport(out);
+
+    rankingMock.terminate();
+    rankingMock.waitForFinished();
+    downloadMock.terminate();
+    downloadMock.waitForFinished();
+
+    return exitCode;
+}
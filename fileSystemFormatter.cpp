@@ -0,0 +1,190 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "fileSystemFormatter.hpp"
+#include <QDebug>
+
+FileSystemFormatter::FileSystemFormatter(MkfsProfile _profile, QObject* parent) : QObject(parent), profile(_profile)
+{
+}
+
+void FileSystemFormatter::addFileSystem(const QString& deviceNode, FileSystem::Type type, const QString& label, const QStringList& features)
+{
+    jobs.append(FormatJob{ deviceNode, type, label, QStringList(), features });
+}
+
+void FileSystemFormatter::addStripedFileSystem(const QStringList& deviceNodes, const QString& label)
+{
+    if (deviceNodes.isEmpty())
+    {
+        qWarning() << "FileSystemFormatter::addStripedFileSystem(): No devices given";
+        return;
+    }
+
+    jobs.append(FormatJob{ deviceNodes.first(), FileSystem::Type::Btrfs, label, deviceNodes.mid(1), QStringList() });
+}
+
+QString FileSystemFormatter::mkfsProgram(FileSystem::Type type) const
+{
+    switch (type)
+    {
+        case FileSystem::Type::Ext4:  return "mkfs.ext4";
+        case FileSystem::Type::Fat32: return "mkfs.fat";
+        case FileSystem::Type::Btrfs: return "mkfs.btrfs";
+        case FileSystem::Type::F2fs:  return "mkfs.f2fs";
+        default:                      return QString();
+    }
+}
+
+QStringList FileSystemFormatter::mkfsArguments(const FormatJob& job) const
+{
+    QStringList arguments;
+
+    switch (job.type)
+    {
+        case FileSystem::Type::Ext4:
+            arguments << "-q" << "-F";
+            if (!job.label.isEmpty()) arguments << "-L" << job.label.left(16);
+
+            if (profile == MkfsProfile::FastInstall)
+            {
+                // Inode tables and journal are zeroed by the kernel in the background after the first mount,
+                // and free space is discarded in batches by the fstrim timer of the installed system
+                arguments << "-E" << "lazy_itable_init=1,lazy_journal_init=1,nodiscard";
+            } else {
+                arguments << "-E" << "lazy_itable_init=0,lazy_journal_init=0,discard";
+            }
+
+            if (!job.features.isEmpty()) arguments << "-O" << job.features.join(",");
+            break;
+
+        case FileSystem::Type::Btrfs:
+            arguments << "-f";
+            if (!job.label.isEmpty()) arguments << "-L" << job.label;
+
+            // Btrfs has no inode tables to initialize, so the profiles only differ on discarding the free space
+            if (profile == MkfsProfile::FastInstall) arguments << "--nodiscard";
+
+            // Data is striped across every device for throughput. Metadata is mirrored, so a single bad
+            // sector on one device does not make the whole filesystem unreadable.
+            if (!job.stripeDeviceNodes.isEmpty())
+            {
+                arguments << "-d" << "raid0" << "-m" << "raid1";
+                arguments << job.deviceNode << job.stripeDeviceNodes;
+                return arguments;
+            }
+            break;
+
+        case FileSystem::Type::F2fs:
+            arguments << "-f";
+            if (!job.label.isEmpty()) arguments << "-l" << job.label;
+            if (!job.features.isEmpty()) arguments << "-O" << job.features.join(",");
+
+            // F2FS has no inode tables either, and discards the whole device unless told not to
+            if (profile == MkfsProfile::FastInstall) arguments << "-t" << "0";
+            break;
+
+        case FileSystem::Type::Fat32:
+            arguments << "-F" << "32";
+            if (!job.label.isEmpty()) arguments << "-n" << job.label.left(11).toUpper(); // FAT labels have at most 11 characters
+            break;
+
+        default:
+            break;
+    }
+
+    arguments << job.deviceNode;
+    return arguments;
+}
+
+void FileSystemFormatter::start()
+{
+    if (isRunning())
+    {
+        qWarning() << "FileSystemFormatter::start(): Filesystems are already being created";
+        return;
+    }
+
+    if (jobs.isEmpty())
+    {
+        emit finished(true);
+        return;
+    }
+
+    runningJobs = jobs.count();
+    allSucceeded = true;
+
+    const QList<FormatJob> queuedJobs = jobs;
+
+    for (const FormatJob& job : queuedJobs)
+    {
+        const QString program = mkfsProgram(job.type);
+
+        if (program.isEmpty())
+        {
+            qWarning() << "FileSystemFormatter: Unsupported filesystem type" << FileSystem::nameForType(job.type) << "for" << job.deviceNode;
+            finishJob(job.deviceNode, false);
+            continue;
+        }
+
+        const QStringList arguments = mkfsArguments(job);
+        const QString deviceNode = job.deviceNode;
+
+        QProcess* mkfsProcess = new QProcess(this);
+        mkfsProcess->setProcessChannelMode(QProcess::MergedChannels);
+
+        connect(mkfsProcess, &QProcess::readyReadStandardOutput, this, [mkfsProcess]() {
+            qDebug() << mkfsProcess->readAllStandardOutput();
+        });
+
+        connect(mkfsProcess, &QProcess::errorOccurred, this, [this, mkfsProcess, deviceNode](QProcess::ProcessError error) {
+            // A process that failed to start never emits finished
+            if (error != QProcess::FailedToStart) return;
+
+            qWarning() << "Failed to start" << mkfsProcess->program() << "for" << deviceNode;
+            mkfsProcess->deleteLater();
+            finishJob(deviceNode, false);
+        });
+
+        connect(mkfsProcess, &QProcess::finished, this, [this, mkfsProcess, deviceNode](int exitCode, QProcess::ExitStatus exitStatus) {
+            mkfsProcess->deleteLater();
+            finishJob(deviceNode, exitStatus == QProcess::NormalExit && exitCode == 0);
+        });
+
+        qDebug() << "Creating filesystem:" << program << arguments;
+        mkfsProcess->start(program, arguments);
+    }
+}
+
+void FileSystemFormatter::finishJob(const QString& deviceNode, bool success)
+{
+    if (success)
+    {
+        qDebug() << "Filesystem created on" << deviceNode;
+    } else {
+        qWarning() << "Could not create filesystem on" << deviceNode;
+        allSucceeded = false;
+    }
+
+    emit fileSystemCreated(deviceNode, success);
+
+    if (--runningJobs == 0)
+    {
+        jobs.clear();
+        emit finished(allSucceeded);
+    }
+}
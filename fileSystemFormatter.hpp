@@ -0,0 +1,84 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QObject>
+#include <QProcess>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <kpmcore/fs/filesystem.h>
+
+#ifndef FILESYSTEMFORMATTER_H
+#define FILESYSTEMFORMATTER_H
+
+// How much of the filesystem initialization is done during the installation
+enum class MkfsProfile
+{
+    FastInstall,        // Inode tables initialized lazily after first boot, discard batched by the fstrim timer
+    FullyInitialized    // Inode tables and journal zeroed and free space discarded during the installation
+};
+Q_DECLARE_METATYPE(MkfsProfile)
+
+// Creates filesystems on several partitions at once, running one mkfs process per partition
+// without blocking the GUI thread
+class FileSystemFormatter : public QObject
+{
+Q_OBJECT
+private:
+    struct FormatJob
+    {
+        QString deviceNode;
+        FileSystem::Type type;
+        QString label;
+        QStringList stripeDeviceNodes; // Further devices of a multi-device filesystem
+        QStringList features;          // Filesystem features enabled by mkfs
+    };
+
+    MkfsProfile profile;
+    QList<FormatJob> jobs;
+
+    int runningJobs = 0;
+    bool allSucceeded = true;
+
+    QString mkfsProgram(FileSystem::Type type) const;
+    QStringList mkfsArguments(const FormatJob& job) const;
+    void finishJob(const QString& deviceNode, bool success);
+
+public:
+    explicit FileSystemFormatter(MkfsProfile _profile, QObject* parent = nullptr);
+
+    // Queue a filesystem to be created on deviceNode. Must be called before start().
+    void addFileSystem(const QString& deviceNode, FileSystem::Type type, const QString& label = QString(), const QStringList& features = QStringList());
+
+    // Queue a Btrfs filesystem striped across several devices, with data in RAID0 and metadata in RAID1.
+    // Must be called before start().
+    void addStripedFileSystem(const QStringList& deviceNodes, const QString& label = QString());
+
+    // Start all queued mkfs processes concurrently
+    void start();
+
+    bool isRunning() const
+    {
+        return runningJobs > 0;
+    }
+
+signals:
+    void fileSystemCreated(const QString& deviceNode, bool success);
+    void finished(bool success);
+};
+
+#endif
@@ -21,6 +21,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <QFile>
 #include <QApplication>
 #include <QMessageBox>
+#include <QStorageInfo>
+#include <QUrl>
 
 // Function to calculate the checksum of a file
 QString calculateFileChecksum(const QString &filePath) {
@@ -207,6 +209,12 @@ InstallationPage::InstallationPage(QWidget* parent) : QWidget(parent)
     formLayout->addRow(new QLabel("Pacotes a serem instalados:"));
     formLayout->addRow(packageSelectionLayout);
 
+    // Swap configuration of the installed system
+    swapFileCheckbox = new QCheckBox("Criar arquivo de swap além do zram");
+    swapFileCheckbox->setChecked(true);
+    swapFileCheckbox->setToolTip("O tamanho do zram e do arquivo de swap é calculado a partir da memória RAM e do tamanho da partição do sistema");
+    formLayout->addRow(swapFileCheckbox);
+
     // Create the install system button
     installSystemButton = new QPushButton("Instalar o sistema");
     packageSelectionButtonsLayout->addSpacing(300);
@@ -217,12 +225,8 @@ InstallationPage::InstallationPage(QWidget* parent) : QWidget(parent)
     connect(installBasicButton, &QPushButton::clicked, this, &InstallationPage::onInstallBasicButtonClicked);
     connect(installBasicAndOptionalButton, &QPushButton::clicked, this, &InstallationPage::onInstallBasicAndOptionalButtonClicked);
 
-    connect(installSystemButton, &QPushButton::clicked, this, [this](bool checked)
-    {
-        installSystemButton->setEnabled(false);
-        InstallationPage::onInstallSystemButtonClicked(checked);
-        installSystemButton->setEnabled(true);
-    });
+    // The button stays disabled while the installation runs, and is enabled again only if the script fails
+    connect(installSystemButton, &QPushButton::clicked, this, &InstallationPage::onInstallSystemButtonClicked);
 
     // Create the progress indicator for the installation 
     QVBoxLayout* installationProgressLayout = new QVBoxLayout;
@@ -246,13 +250,90 @@ InstallationPage::InstallationPage(QWidget* parent) : QWidget(parent)
     // Define o layout no container
     statusContainer->setLayout(installationProgressLabelLayout);
 
+    mirrorThroughputLabel = new QLabel;
+    mirrorThroughputLabel->setAlignment(Qt::AlignCenter);
+    mirrorThroughputLabel->hide();
+
     // Adiciona a barra de progresso e o container de status ao layout principal
     installationProgressLayout->addWidget(installationProgressBar);
     installationProgressLayout->addWidget(statusContainer, 0, Qt::AlignHCenter);
+    installationProgressLayout->addWidget(mirrorThroughputLabel);
 
     // Adiciona ao layout principal da página
     page->addLayout(formLayout);
     page->addLayout(installationProgressLayout);
+
+    // The ranking has a time budget, and the installation uses the mirrorlist of the live system until it finishes
+    mirrorRanker = new MirrorRanker(this);
+    packagePrefetcher = new PackagePrefetcher(this);
+
+    connect(mirrorRanker, &MirrorRanker::finished, this, [this](bool success) {
+        if (success) MirrorRanker::writeMirrorlist(MirrorRanker::rankedMirrorlistPath(), mirrorRanker->ranked());
+
+        // The probes of the ranking are the freshest measurements of the mirrors. They are recorded once, in the
+        // mirror health shared by the prefetcher and the installation.
+        for (const MirrorScore& score : mirrorRanker->ranked())
+        {
+            if (score.isReachable() && score.bytesPerSecond > 0)
+            {
+                packagePrefetcher->downloader()->mirrorHealth().recordTransfer(score.server, score.bytesReceived, score.bytesReceived / score.bytesPerSecond);
+            }
+        }
+
+        // Nothing is prefetched once the installation was requested, it downloads the packages itself
+        if (!installationRequested)
+        {
+            packagePrefetcher->start(mirrorServers(), QStringList{ "base", "grub" } + basicPackages.keys());
+        }
+    });
+
+    NetworkStateStore::instance()->whenConnected(this, [this]() {
+        mirrorRanker->start(MirrorRanker::readMirrorlist("/etc/pacman.d/mirrorlist"));
+    });
+
+    packageResolver = new PackageResolver(this);
+    connect(packageResolver, &PackageResolver::resolved, this, [this](bool success) {
+        if (!success)
+        {
+            qWarning() << "Could not resolve the packages to download, pacman downloads them during the installation";
+            runInstallationScript();
+            return;
+        }
+
+        installationProgressLabel->setText("Baixando pacotes");
+        emitStatus();
+        packageDownloader->start(packageResolver->files());
+    });
+
+    packageDownloader = new PackageDownloader(this);
+    packageDownloader->setMirrorHealth(packagePrefetcher->downloader()->sharedMirrorHealth());
+    packageDownloader->setDestination(newRootCachePath);
+
+    connect(packageDownloader, &PackageDownloader::progress, this, [this](qint64 bytesReceived, qint64 bytesTotal) {
+        if (bytesTotal <= 0) return;
+
+        installationProgressBar->setRange(0, 1000);
+        installationProgressBar->setValue(static_cast<int>(bytesReceived * 1000 / bytesTotal));
+        installationProgressLabel->setText(QString("Baixando pacotes (%1 de %2 MiB)")
+            .arg(bytesReceived / (1024 * 1024)).arg(bytesTotal / (1024 * 1024)));
+
+        QMap<QString, double> mirrorThroughput = packageDownloader->mirrorThroughput();
+        QStringList mirrorLines;
+        for (auto it = mirrorThroughput.constBegin(); it != mirrorThroughput.constEnd(); it++)
+        {
+            mirrorLines << QString("%1: %2 MiB/s").arg(QUrl(it.key()).host()).arg(it.value() / (1024. * 1024.), 0, 'f', 1);
+        }
+        mirrorThroughputLabel->setText(mirrorLines.join("\n"));
+        mirrorThroughputLabel->setVisible(!mirrorLines.isEmpty());
+        emitStatus();
+    });
+
+    // Files that could not be downloaded are left to pacman
+    connect(packageDownloader, &PackageDownloader::finished, this, [this](bool success) {
+        mirrorThroughputLabel->hide();
+        if (!success) qWarning() << "Some packages could not be downloaded, pacman downloads them during the installation";
+        runInstallationScript();
+    });
 }
 
 
@@ -314,14 +395,115 @@ void InstallationPage::onInstallBasicAndOptionalButtonClicked(bool checked)
 
 void InstallationPage::onInstallSystemButtonClicked(bool checked)
 {
+    // A second click must not start the installation script again while it runs
+    if (installationRunning) return;
+
+    installationRunning = true;
     installSystemButton->setEnabled(false);
+    installationRequested = true;
+
+    // Packages are downloaded during the installation, so it starts once a device is connected
+    NetworkStateStore* networkState = NetworkStateStore::instance();
+    if (!networkState->isConnected())
+    {
+        installationStatusIndicator->setStatus(StatusIndicator::Warning);
+        installationProgressLabel->setText("Aguardando conexão de rede");
+        installationProgressLabel->show();
+    }
+
+    networkState->whenConnected(this, [this]() {
+        startInstallation();
+    });
+}
 
+void InstallationPage::startInstallation()
+{
+    // A ranking that is still running is waited for, since it is bounded by its time budget
+    if (mirrorRanker->isRunning())
+    {
+        installationStatusIndicator->setStatus(StatusIndicator::Warning);
+        installationProgressLabel->setText("Classificando espelhos de pacotes");
+        installationProgressLabel->show();
+
+        connect(mirrorRanker, &MirrorRanker::finished, this, [this]() {
+            startInstallation();
+        }, Qt::SingleShotConnection);
+        return;
+    }
+
+    downloadPackages();
+}
+
+QStringList InstallationPage::mirrorServers()
+{
+    QStringList servers;
+    for (const MirrorScore& score : mirrorRanker->ranked())
+    {
+        servers << score.server;
+    }
+    if (servers.isEmpty()) servers = MirrorRanker::readMirrorlist("/etc/pacman.d/mirrorlist");
+
+    return servers;
+}
+
+void InstallationPage::downloadPackages()
+{
+    packageDownloader->setServers(mirrorServers());
+
+    installationProgressBar->show();
+    installationProgressBar->setRange(0, 0);
+    installationStatusIndicator->setStatus(StatusIndicator::Loading);
+    installationProgressLabel->setText("Movendo pacotes baixados antecipadamente");
+    installationProgressLabel->show();
+    emitStatus();
+
+    // The installation runs in the background from here on, while the user goes on to the users page
+    page->setCanAdvance(true);
+
+    // The prefetched packages join the cache of the new root, and the downloads skip or continue them
+    connect(packagePrefetcher, &PackagePrefetcher::moved, this, [this]() {
+        installationProgressLabel->setText("Resolvendo pacotes");
+        emitStatus();
+        packageResolver->resolve(QStringList{ "base", "grub" } + getSelectedPackages());
+    }, Qt::SingleShotConnection);
+
+    packagePrefetcher->moveTo(newRootCachePath);
+}
+
+void InstallationPage::runInstallationScript()
+{
     QStringList installationScriptCommand;
     installationScriptCommand.append(QApplication::applicationDirPath() + "/systemInstallation/systemInstallation.sh");
     installationScriptCommand.append(getSelectedPackages());
 
     installationProcess = new QProcess;
-    installationProcess->start("/bin/bash", installationScriptCommand);
+
+    // zram and the swap file are sized from the memory of this machine and the size of the new root
+    SwapPlan swapPlan = SwapPlanner::plan(SwapPlanner::totalMemoryBytes(), SwapPlanner::fileSystemBytes("/mnt/new_root"), swapFileCheckbox->isChecked());
+
+    QProcessEnvironment installationEnvironment = QProcessEnvironment::systemEnvironment();
+    installationEnvironment.insert("DELPHINOS_ZRAM_SIZE_MIB", QString::number(swapPlan.zramSizeMiB));
+    installationEnvironment.insert("DELPHINOS_SWAPFILE_SIZE_MIB", QString::number(swapPlan.swapFileSizeMiB));
+
+    // Mount options, I/O schedulers and TRIM of the installed system are chosen for the media of the new root
+    QStorageInfo rootStorage("/mnt/new_root");
+    StorageMedia rootMedia = StorageAdvisor::classify(QString::fromLocal8Bit(rootStorage.device()));
+    FileSystem::Type rootFileSystemType = FileSystem::typeForName(QString::fromLatin1(rootStorage.fileSystemType()));
+    installationEnvironment.insert("DELPHINOS_ROOT_MOUNT_OPTIONS", StorageAdvisor::mountOptions(rootMedia, rootFileSystemType).join(","));
+    installationEnvironment.insert("DELPHINOS_IO_SCHEDULER_RULES", StorageAdvisor::udevRules());
+    installationEnvironment.insert("DELPHINOS_PERIODIC_TRIM", StorageAdvisor::periodicTrim(rootMedia) ? "1" : "0");
+
+    if (QFile::exists(MirrorRanker::rankedMirrorlistPath()))
+    {
+        installationEnvironment.insert("DELPHINOS_MIRRORLIST", MirrorRanker::rankedMirrorlistPath());
+    }
+
+    // The installed system downloads with the concurrency tuned on this connection
+    if (packageDownloader->tunedConcurrency() > 0)
+    {
+        installationEnvironment.insert("DELPHINOS_PARALLEL_DOWNLOADS", QString::number(packageDownloader->tunedConcurrency()));
+    }
+    installationProcess->setProcessEnvironment(installationEnvironment);
 
     connect(installationProcess, &QProcess::started, this, [this](){
         installationProgressBar->show();
@@ -331,10 +513,10 @@ void InstallationPage::onInstallSystemButtonClicked(bool checked)
         installationStatusIndicator->setStatus(StatusIndicator::Warning);
         installationProgressLabel->setText("Aguardando senha");
         installationProgressLabel->show();
+        emitStatus();
     });
 
     connect(installationProcess, &QProcess::readyReadStandardOutput, this, [this]() {
-        page->setCanAdvance(false);
         // If there is output from the process (e.g., progress updates from the script)
         QByteArray output = installationProcess->readAllStandardOutput();
         
@@ -420,6 +602,21 @@ void InstallationPage::onInstallSystemButtonClicked(bool checked)
                 installationStatusIndicator->setStatus(StatusIndicator::Loading);
                 installationProgressLabel->setText("Ativando serviço do sistema " + readableName);
             }
+            else if (line.contains("BYTESWRITTEN:")) {
+                QStringList parts = line.split(":");
+
+                bool bytesWrittenIsInt;
+                qint64 bytesWritten = parts.value(1).toLongLong(&bytesWrittenIsInt);
+                if (bytesWrittenIsInt) {
+                    QString compression = parts.mid(2, parts.size() - 3).join(":"); // Options such as compress=zstd:3 contain colons
+                    qDebug() << "Bytes written on the new root:" << bytesWritten << "compression:" << compression;
+                    installationBytesWrittenLabel = QString("%1 GiB gravados no disco, compressão: %2")
+                        .arg(static_cast<double>(bytesWritten) / (1024. * 1024. * 1024.), 0, 'f', 2)
+                        .arg(compression == "none" ? "nenhuma" : compression);
+                } else {
+                    qWarning() << "Failed to convert BYTESWRITTEN to an integer";
+                }
+            }
             else if (line.contains("ERROR:")) {
                 QStringList parts = line.split(":");
                 QString name = parts[1];
@@ -437,6 +634,7 @@ void InstallationPage::onInstallSystemButtonClicked(bool checked)
                 return;
             }
         }
+        emitStatus();
     });
 
     connect(installationProcess, &QProcess::finished, this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
@@ -444,19 +642,104 @@ void InstallationPage::onInstallSystemButtonClicked(bool checked)
         installationProcess->deleteLater();
         if (exitStatus == QProcess::CrashExit || exitCode != 0) {
             qDebug() << "System installation process failed";
-            installSystemButton->setEnabled(true);
-            installationStatusIndicator->setStatus(StatusIndicator::Error);
-            if (!installationErrorLabel.isEmpty())
+            failInstallation(installationErrorLabel.isEmpty() ? "Instalação do sistema falhou" : installationErrorLabel);
+        } else {
+            qDebug() << "System installation script finished successfully";
+            installationScriptFinished = true;
+
+            // The users are the last step of the installation, once they were confirmed on the users page
+            if (usersQueued)
             {
-                installationProgressLabel->setText(installationErrorLabel);
+                applyUsers();
             } else {
-                installationProgressLabel->setText("Instalação do sistema falhou");
+                installationStatusIndicator->setStatus(StatusIndicator::Warning);
+                installationProgressLabel->setText("Aguardando a criação de usuários");
+                emitStatus();
             }
-        } else {
-            qDebug() << "System installation finished successfully";
-            installationStatusIndicator->setStatus(StatusIndicator::Ok);
+        }
+    });
+
+    // finished is not emitted when bash cannot be started at all
+    connect(installationProcess, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+
+        qWarning() << "Failed to start the system installation script:" << installationProcess->errorString();
+        installationProgressBar->hide();
+        installationProcess->deleteLater();
+        installationProcess = nullptr;
+        failInstallation("Não foi possível iniciar a instalação do sistema");
+    });
+
+    installationProcess->start("/bin/bash", installationScriptCommand);
+}
+
+void InstallationPage::failInstallation(const QString& message)
+{
+    // The installation can be started again
+    installationRunning = false;
+    installSystemButton->setEnabled(true);
+
+    installationStatusIndicator->setStatus(StatusIndicator::Error);
+    installationProgressLabel->setText(message);
+    installationProgressLabel->show();
+    page->setCanAdvance(false);
+    emitStatus();
+}
+
+void InstallationPage::queueUsers(const UserAccounts& users)
+{
+    queuedUsers = users;
+    usersQueued = true;
+
+    if (installationScriptFinished) applyUsers();
+}
+
+void InstallationPage::applyUsers()
+{
+    usersQueued = false;
+
+    installationStatusIndicator->setStatus(StatusIndicator::Loading);
+    installationProgressLabel->setText("Configurando usuários");
+    emitStatus();
+
+    // Passwords are given to chpasswd on its standard input, so they do not show up in the process list.
+    // The user may already exist from an earlier attempt whose passwords could not be set.
+    const QString usersScript =
+        "id -u \"$1\" > /dev/null 2>&1 || useradd -m \"$1\" || exit 1; "
+        "if [ \"$2\" = 1 ]; then usermod -aG wheel \"$1\" || exit 1; fi; "
+        "chpasswd";
+
+    QProcess* usersProcess = new QProcess(this);
+    usersProcess->setProcessChannelMode(QProcess::MergedChannels);
+    usersProcess->start("chroot", { "/mnt/new_root", "/bin/bash", "-c", usersScript, "bash",
+                                    queuedUsers.username, queuedUsers.administrator ? "1" : "0" });
+    usersProcess->write(QString("root:%1\n%2:%3\n").arg(queuedUsers.rootPassword, queuedUsers.username, queuedUsers.userPassword).toUtf8());
+    usersProcess->closeWriteChannel();
+    queuedUsers = UserAccounts();
+
+    connect(usersProcess, &QProcess::finished, this, [this, usersProcess](int exitCode, QProcess::ExitStatus exitStatus) {
+        qDebug() << usersProcess->readAll();
+        usersProcess->deleteLater();
+
+        if (exitStatus == QProcess::CrashExit || exitCode != 0)
+        {
+            qWarning() << "Could not configure the users, exit code" << exitCode;
+            installationStatusIndicator->setStatus(StatusIndicator::Warning);
+            installationProgressLabel->setText("Não foi possível configurar os usuários");
+            emitStatus();
+            emit usersApplied(false);
+            return;
+        }
+
+        qDebug() << "System installation finished successfully";
+        installationStatusIndicator->setStatus(StatusIndicator::Ok);
+        if (installationBytesWrittenLabel.isEmpty()) {
             installationProgressLabel->setText("Instalação do sistema finalizada com sucesso");
-            page->setCanAdvance(true);
+        } else {
+            installationProgressLabel->setText("Instalação do sistema finalizada com sucesso (" + installationBytesWrittenLabel + ")");
         }
+        page->setCanAdvance(true);
+        emitStatus();
+        emit usersApplied(true);
     });
 }
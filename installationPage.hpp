@@ -17,9 +17,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "mainWindow.hpp"
 #include "statusIndicator.hpp"
+#include "usersPage.hpp"
+#include "swapPlanner.hpp"
+#include "storageAdvisor.hpp"
+#include "networkStateStore.hpp"
+#include "mirrorRanker.hpp"
+#include "packageResolver.hpp"
+#include "packageDownloader.hpp"
+#include "packagePrefetcher.hpp"
 #include <QButtonGroup>
 #include <QProcess>
 #include <QProgressBar>
+#include <QCheckBox>
 
 #ifndef InstallationPage_H
 #define InstallationPage_H
@@ -45,7 +54,10 @@ private:
         { "sudo", "Sudo privilege elevation support" },
         { "mesa", "open-source graphics driver" },
         { "bluez", "Bluetooth protocol stack" },
-        { "man", "manuals for system programs"}
+        { "man", "manuals for system programs"},
+        { "btrfs-progs", "Btrfs filesystem utilities" },
+        { "f2fs-tools", "F2FS filesystem utilities" },
+        { "zram-generator", "compressed swap in RAM" }
     };
 
     QMap<QString, QString> optionalPackages = QMap<QString, QString>
@@ -101,6 +113,9 @@ private:
         { "base", "basic system packages"},
         { "UEFI bootloader", "UEFI bootloader" },
         { "BIOS bootloader", "BIOS bootloader" },
+        { "fstrim.timer", "periodic TRIM" },
+        { "swap", "zram and swap" },
+        { "storage", "storage tuning" },
 
         // Errors
         { "/mnt/new_root is not a directory", "/mnt/new_root is not a directory"},
@@ -110,7 +125,8 @@ private:
         { "Could not install BIOS bootloader", "Could not install BIOS bootloader"},
         { "Could not generate BIOS bootloader configuration", "Could not generate BIOS bootloader configuration"},
         { "Could not detect the device mounted on /boot", "Could not detect the device mounted on /boot"},
-        { "Could not generate fstab file", "Could not generate fstab fileenv"}
+        { "Could not generate fstab file", "Could not generate fstab fileenv"},
+        { "Could not detect the encrypted root partition", "Could not detect the encrypted root partition"}
     };
 
     int packageNameRole = Qt::UserRole;
@@ -146,14 +162,62 @@ private:
 
     QPushButton* installSystemButton;
 
+    // zram is always configured, the swap file is optional
+    QCheckBox* swapFileCheckbox;
+
     QProcess* installationProcess = nullptr;
     QProgressBar* installationProgressBar;
     StatusIndicator* installationStatusIndicator;
     QLabel* installationProgressLabel;
+    QLabel* mirrorThroughputLabel;      // Throughput of every mirror while the packages are downloaded
     QString installationErrorLabel; 
+    QString installationBytesWrittenLabel;
 
     int currentPackageIndex = 0;
 
+    // Mirrors of the live system, ranked in the background as soon as the network is connected
+    MirrorRanker* mirrorRanker;
+
+    // Packages are downloaded into the cache of the new root before the installation script runs, which
+    // leaves pacman only the packages that could not be downloaded
+    PackageResolver* packageResolver;
+    PackageDownloader* packageDownloader;
+    const QString newRootCachePath = "/mnt/new_root/var/cache/pacman/pkg";
+
+    // Base and basic packages are prefetched once the mirrors are ranked, while the user is still on the pages before
+    PackagePrefetcher* packagePrefetcher;
+
+    // The ranked mirrors, or the mirrorlist of the live system when the ranking failed
+    QStringList mirrorServers();
+
+    // Set once the user asked for the installation, from then on nothing is prefetched
+    bool installationRequested = false;
+
+    // Set from the click on the install button until the installation script fails
+    bool installationRunning = false;
+
+    void startInstallation();
+    void downloadPackages();
+
+    // Run the installation script
+    void runInstallationScript();
+
+    // Show message as the error of the installation, and let the user start it again
+    void failInstallation(const QString& message);
+
+    // Users confirmed on the users page while the installation runs, created once the installation script finished
+    UserAccounts queuedUsers;
+    bool usersQueued = false;
+    bool installationScriptFinished = false;
+
+    void applyUsers();
+
+    // Let the other pages follow the installation
+    void emitStatus()
+    {
+        emit installationStatusChanged(installationStatusIndicator->getStatus(), installationProgressLabel->text());
+    }
+
 private slots:
     void onPackageListChanged(QListWidgetItem *item);
 
@@ -169,6 +233,13 @@ public:
     }
 
     explicit InstallationPage(QWidget* parent);
+
+public slots:
+    void queueUsers(const UserAccounts& users);
+
+signals:
+    void installationStatusChanged(StatusIndicator::Status status, const QString& text);
+    void usersApplied(bool success);
 };
 
 #endif
@@ -0,0 +1,119 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "luksEncryptor.hpp"
+#include "swapPlanner.hpp"
+#include <QDebug>
+#include <algorithm>
+
+void LuksEncryptor::start(const QString& _deviceNode, const QString& _mapperName, const QString& _passphrase,
+    const QString& _cipher, int _keySize, int _unlockTimeMs)
+{
+    if (isRunning())
+    {
+        qWarning() << "LuksEncryptor::start(): Encryption is already running";
+        return;
+    }
+
+    deviceNode = _deviceNode;
+    mapperName = _mapperName;
+    passphrase = _passphrase.toUtf8();
+    cipher = _cipher;
+    keySize = _keySize;
+    unlockTimeMs = _unlockTimeMs;
+
+    // Argon2id uses up to 1 GiB of memory, but never more than a quarter of the memory of this machine,
+    // so the system can still be unlocked on it
+    qint64 pbkdfMemoryKiB = std::min<qint64>(1024 * 1024, SwapPlanner::totalMemoryBytes() / 4 / 1024);
+
+    QStringList arguments = {
+        "luksFormat", "--batch-mode", "--type", "luks2",
+        "--cipher", cipher, "--key-size", QString::number(keySize),
+        "--pbkdf", "argon2id", "--iter-time", QString::number(unlockTimeMs)
+    };
+
+    if (pbkdfMemoryKiB > 0)
+    {
+        arguments << "--pbkdf-memory" << QString::number(pbkdfMemoryKiB);
+    }
+
+    arguments << "--key-file" << "-" << deviceNode;
+
+    qDebug() << "Formatting" << deviceNode << "as LUKS2 with" << cipher << keySize << "bits";
+    runCryptsetup(arguments, &LuksEncryptor::openDevice);
+}
+
+void LuksEncryptor::openDevice()
+{
+    // Discards are passed through so the fstrim timer keeps working, and the dm-crypt work queues are bypassed,
+    // which is faster on SSDs. --persistent stores these flags in the LUKS2 header for the installed system.
+    qDebug() << "Opening" << deviceNode << "as" << mapperNode(mapperName);
+    runCryptsetup({ "open", "--allow-discards", "--perf-no_read_workqueue", "--perf-no_write_workqueue", "--persistent",
+        "--key-file", "-", deviceNode, mapperName }, nullptr);
+}
+
+void LuksEncryptor::runCryptsetup(const QStringList& arguments, void (LuksEncryptor::*onSuccess)())
+{
+    cryptsetupProcess = new QProcess(this);
+    cryptsetupProcess->setProcessChannelMode(QProcess::MergedChannels);
+
+    connect(cryptsetupProcess, &QProcess::started, this, [this]() {
+        cryptsetupProcess->write(passphrase);
+        cryptsetupProcess->closeWriteChannel();
+    });
+
+    connect(cryptsetupProcess, &QProcess::finished, this, [this, onSuccess](int exitCode, QProcess::ExitStatus exitStatus) {
+        QByteArray output = cryptsetupProcess->readAll();
+        if (!output.isEmpty()) qDebug() << output;
+
+        cryptsetupProcess->deleteLater();
+        cryptsetupProcess = nullptr;
+
+        if (exitStatus != QProcess::NormalExit || exitCode != 0)
+        {
+            qWarning() << "cryptsetup failed on" << deviceNode << "with exit code" << exitCode;
+            finish(false);
+            return;
+        }
+
+        if (onSuccess)
+        {
+            (this->*onSuccess)();
+        } else {
+            finish(true);
+        }
+    });
+
+    connect(cryptsetupProcess, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+
+        qWarning() << "Failed to start cryptsetup";
+        cryptsetupProcess->deleteLater();
+        cryptsetupProcess = nullptr;
+        finish(false);
+    });
+
+    cryptsetupProcess->start("cryptsetup", arguments);
+}
+
+void LuksEncryptor::finish(bool success)
+{
+    passphrase.fill('\0');
+    passphrase.clear();
+    emit finished(success);
+}
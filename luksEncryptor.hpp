@@ -0,0 +1,70 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+
+#ifndef LUKSENCRYPTOR_H
+#define LUKSENCRYPTOR_H
+
+// Formats a partition as LUKS2 and opens it as /dev/mapper/<mapperName>, without blocking the GUI thread.
+// The passphrase is given to cryptsetup through its standard input and never appears on a command line.
+class LuksEncryptor : public QObject
+{
+Q_OBJECT
+private:
+    QString deviceNode;
+    QString mapperName;
+    QByteArray passphrase;
+
+    QString cipher;
+    int keySize;
+    int unlockTimeMs;
+
+    QProcess* cryptsetupProcess = nullptr;
+
+    void runCryptsetup(const QStringList& arguments, void (LuksEncryptor::*onSuccess)());
+    void openDevice();
+    void finish(bool success);
+
+public:
+    explicit LuksEncryptor(QObject* parent = nullptr) : QObject(parent) {};
+
+    // Start formatting deviceNode with the given cipher. The PBKDF cost is tuned by cryptsetup on this
+    // machine so that unlocking takes about unlockTimeMs.
+    void start(const QString& _deviceNode, const QString& _mapperName, const QString& _passphrase,
+        const QString& _cipher, int _keySize, int _unlockTimeMs = 1000);
+
+    bool isRunning() const
+    {
+        return cryptsetupProcess != nullptr;
+    }
+
+    // Node of the opened device, where the filesystem is created
+    static QString mapperNode(const QString& mapperName)
+    {
+        return "/dev/mapper/" + mapperName;
+    }
+
+signals:
+    void finished(bool success);
+};
+
+#endif
@@ -79,6 +79,11 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     UsersPage* usersPage = new UsersPage(this);
     pageList.append(usersPage->getPage());
 
+    // The installation runs in the background while the users are configured, and creates them as its last step
+    connect(usersPage, &UsersPage::usersConfirmed, installationPage, &InstallationPage::queueUsers);
+    connect(installationPage, &InstallationPage::usersApplied, usersPage, &UsersPage::onUsersApplied);
+    connect(installationPage, &InstallationPage::installationStatusChanged, usersPage, &UsersPage::onInstallationStatusChanged);
+
     PageContent* emptyPage = new PageContent("Página vazia", "Para fins de teste", 640, 480, this);// empty last page. For testing purposes.
     pageList.append(emptyPage);
 
@@ -121,7 +126,8 @@ void MainWindow::onPageChanged(int index)
 
 void MainWindow::onCanAdvanceChanged(bool canAdvance)
 {
-    if (canAdvance) buttonNext->setEnabled(true); else buttonNext->setEnabled(false);
+    // Pages visited before keep emitting, such as the installation running in the background
+    buttonNext->setEnabled(pageList[pageStack->currentIndex()]->getCanAdvance());
 }
 
 
@@ -0,0 +1,127 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "mirrorHealth.hpp"
+#include <QSettings>
+#include <QHash>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+
+bool MirrorHealth::load()
+{
+    if (!QFileInfo::exists(path)) return false;
+
+    QSettings settings(path, QSettings::IniFormat);
+
+    int count = settings.beginReadArray("mirrors");
+    for (int i = 0; i < count; i++)
+    {
+        settings.setArrayIndex(i);
+
+        MirrorStatistics mirror;
+        mirror.bytesPerSecond = settings.value("bytesPerSecond").toDouble();
+        mirror.errorRate = settings.value("errorRate").toDouble();
+        mirror.samples = settings.value("samples").toInt();
+        mirrors.insert(settings.value("server").toString(), mirror);
+    }
+    settings.endArray();
+
+    qDebug() << "Loaded the health of" << mirrors.count() << "mirrors from" << path;
+    return true;
+}
+
+bool MirrorHealth::save() const
+{
+    QDir().mkpath(QFileInfo(path).path());
+
+    QSettings settings(path, QSettings::IniFormat);
+    settings.clear();
+
+    settings.beginWriteArray("mirrors", mirrors.count());
+    int i = 0;
+    for (auto it = mirrors.constBegin(); it != mirrors.constEnd(); it++, i++)
+    {
+        settings.setArrayIndex(i);
+        settings.setValue("server", it.key());
+        settings.setValue("bytesPerSecond", it.value().bytesPerSecond);
+        settings.setValue("errorRate", it.value().errorRate);
+        settings.setValue("samples", it.value().samples);
+    }
+    settings.endArray();
+
+    settings.sync();
+    if (settings.status() != QSettings::NoError)
+    {
+        qWarning() << "Could not save the mirror health to" << path;
+        return false;
+    }
+    return true;
+}
+
+void MirrorHealth::recordTransfer(const QString& server, qint64 bytes, double seconds)
+{
+    if (bytes <= 0 || seconds <= 0) return;
+
+    MirrorStatistics& mirror = mirrors[server];
+    double bytesPerSecond = bytes / seconds;
+
+    mirror.bytesPerSecond = mirror.samples == 0 ? bytesPerSecond : (1. - weight) * mirror.bytesPerSecond + weight * bytesPerSecond;
+    mirror.samples++;
+}
+
+void MirrorHealth::recordSuccess(const QString& server)
+{
+    MirrorStatistics& mirror = mirrors[server];
+    mirror.errorRate = (1. - weight) * mirror.errorRate;
+}
+
+void MirrorHealth::recordFailure(const QString& server)
+{
+    MirrorStatistics& mirror = mirrors[server];
+    mirror.errorRate = (1. - weight) * mirror.errorRate + weight;
+}
+
+QStringList MirrorHealth::byHealth(const QStringList& servers) const
+{
+    QList<double> measuredScores;
+    for (const QString& server : servers)
+    {
+        if (mirrors.value(server).samples > 0) measuredScores.append(score(server));
+    }
+    std::sort(measuredScores.begin(), measuredScores.end());
+    // Without any throughput measured the prior is only a unit the error rates are applied to
+    const double prior = measuredScores.isEmpty() ? 1. : measuredScores.at(measuredScores.size() / 2);
+
+    // Mirrors that refuse connections or stall before their first byte only have an error rate, which
+    // penalizes the prior just as it penalizes a measured throughput
+    QHash<QString, double> expectedScores;
+    for (const QString& server : servers)
+    {
+        const MirrorStatistics mirror = mirrors.value(server);
+        const double priorScore = prior * (1. - mirror.errorRate) * (1. - mirror.errorRate);
+        expectedScores.insert(server, (mirror.samples * score(server) + priorSamples * priorScore) / (mirror.samples + priorSamples));
+    }
+
+    QStringList sorted = servers;
+    std::stable_sort(sorted.begin(), sorted.end(), [&expectedScores](const QString& server, const QString& other) {
+        return expectedScores.value(server) > expectedScores.value(other);
+    });
+
+    return sorted;
+}
@@ -0,0 +1,81 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+
+#ifndef MIRRORHEALTH_H
+#define MIRRORHEALTH_H
+
+// Throughput and error rate of a mirror, as exponentially weighted moving averages
+struct MirrorStatistics
+{
+    double bytesPerSecond = 0.;
+    double errorRate = 0.;      // Fraction of the recent requests that failed or stalled
+    int samples = 0;
+};
+
+// Health of the package mirrors, measured while packages are downloaded and kept across sessions of the live
+// environment, so a mirror that stalled in a previous attempt is not the first one tried again.
+class MirrorHealth
+{
+private:
+    static constexpr double weight = 0.3;   // Weight of a new sample in the moving averages
+    static constexpr int priorSamples = 2;  // Weight of the neutral prior when ordering mirrors with few samples
+
+    QString path;
+    QMap<QString, MirrorStatistics> mirrors;
+
+public:
+    explicit MirrorHealth(const QString& _path = defaultPath()) : path(_path) {};
+
+    static QString defaultPath()
+    {
+        return "/var/lib/delphinos-installer/mirror-health.ini";
+    }
+
+    bool load();
+    bool save() const;
+
+    // A transfer of bytes from server in seconds
+    void recordTransfer(const QString& server, qint64 bytes, double seconds);
+
+    // A request that completed, or one that failed or stalled
+    void recordSuccess(const QString& server);
+    void recordFailure(const QString& server);
+
+    MirrorStatistics statistics(const QString& server) const
+    {
+        return mirrors.value(server);
+    }
+
+    // Expected throughput, penalized by the error rate. 0 for a mirror never measured.
+    double score(const QString& server) const
+    {
+        MirrorStatistics mirror = mirrors.value(server);
+        return mirror.bytesPerSecond * (1. - mirror.errorRate) * (1. - mirror.errorRate);
+    }
+
+    // servers, healthiest first. Mirrors whose throughput was never measured are assumed to score like the median
+    // measured one, penalized by their error rate, and mirrors with few samples lean towards that prior, so one
+    // bad sample does not rank a mirror for good.
+    // Mirrors with equal scores keep their order.
+    QStringList byHealth(const QStringList& servers) const;
+};
+
+#endif
@@ -0,0 +1,254 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "mirrorRanker.hpp"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTcpSocket>
+#include <QUrl>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+
+MirrorRanker::MirrorRanker(QObject* parent) : QObject(parent)
+{
+    networkAccessManager = new QNetworkAccessManager(this);
+
+    budgetTimer.setSingleShot(true);
+    connect(&budgetTimer, &QTimer::timeout, this, [this]() {
+        qDebug() << "Mirror ranking ran out of time with" << runningProbes << "probes running";
+        finish();
+    });
+}
+
+MirrorRanker::~MirrorRanker()
+{
+    qDeleteAll(probes);
+}
+
+QStringList MirrorRanker::readMirrorlist(const QString& path)
+{
+    QStringList servers;
+    QFile mirrorlist(path);
+
+    if (!mirrorlist.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "Could not read" << path;
+        return servers;
+    }
+
+    while (!mirrorlist.atEnd())
+    {
+        QString line = QString::fromUtf8(mirrorlist.readLine()).trimmed();
+        if (!line.startsWith("Server")) continue;
+
+        QString server = line.section('=', 1).trimmed();
+        if (!server.isEmpty() && !servers.contains(server)) servers << server;
+    }
+
+    return servers;
+}
+
+bool MirrorRanker::writeMirrorlist(const QString& path, const QList<MirrorScore>& scores)
+{
+    QDir().mkpath(QFileInfo(path).path());
+
+    QSaveFile mirrorlist(path);
+    if (!mirrorlist.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning() << "Could not write" << path;
+        return false;
+    }
+
+    QTextStream out(&mirrorlist);
+    out << "# Ranked by delphinos-installer by download throughput and connect latency\n";
+
+    for (const MirrorScore& score : scores)
+    {
+        if (score.isReachable())
+        {
+            out << QString("\n# %1 KiB/s, %2 ms\n").arg(score.bytesPerSecond / 1024., 0, 'f', 0).arg(score.connectMilliseconds);
+        } else {
+            out << "\n# Unreachable during the ranking\n";
+        }
+        out << "Server = " << score.server << "\n";
+    }
+
+    out.flush();
+    return mirrorlist.commit();
+}
+
+QString MirrorRanker::repositoryUrl(const QString& server, const QString& repository, const QString& fileName)
+{
+    QString url = server;
+    url.replace("$repo", repository).replace("$arch", "x86_64");
+    return url + "/" + fileName;
+}
+
+void MirrorRanker::start(const QStringList& servers)
+{
+    if (running) return;
+
+    qDeleteAll(probes);
+    probes.clear();
+    rankedScores.clear();
+    nextProbe = 0;
+    runningProbes = 0;
+
+    for (const QString& server : servers)
+    {
+        Probe* probe = new Probe;
+        probe->score.server = server;
+        probes << probe;
+    }
+
+    if (probes.isEmpty())
+    {
+        emit finished(false);
+        return;
+    }
+
+    running = true;
+    budgetTimer.start(timeBudget);
+    startNextProbes();
+}
+
+void MirrorRanker::startNextProbes()
+{
+    while (running && runningProbes < concurrency && nextProbe < probes.count())
+    {
+        Probe* probe = probes.at(nextProbe++);
+        runningProbes++;
+
+        QUrl url(repositoryUrl(probe->score.server, probeRepository, probeRepository + ".db"));
+
+        // The connect latency is measured on its own socket, without name resolution caches of the download
+        probe->socket = new QTcpSocket(this);
+        probe->timer.start();
+
+        connect(probe->socket, &QTcpSocket::connected, this, [this, probe]() {
+            probe->score.connectMilliseconds = probe->timer.elapsed();
+            probe->socket->abort();
+            probe->socket->deleteLater();
+            probe->socket = nullptr;
+            startDownload(probe);
+        });
+
+        connect(probe->socket, &QTcpSocket::errorOccurred, this, [this, probe]() {
+            qDebug() << "Could not connect to" << probe->score.server << ":" << probe->socket->errorString();
+            probe->socket->deleteLater();
+            probe->socket = nullptr;
+            finishProbe(probe);
+        });
+
+        probe->socket->connectToHost(url.host(), url.port(url.scheme() == "https" ? 443 : 80));
+    }
+}
+
+void MirrorRanker::startDownload(Probe* probe)
+{
+    // A ranged request of the largest database, so every mirror transfers the same amount
+    QNetworkRequest request(QUrl(repositoryUrl(probe->score.server, probeRepository, probeRepository + ".db")));
+    request.setRawHeader("Range", QString("bytes=0-%1").arg(probeBytes - 1).toLatin1());
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+
+    probe->timer.start();
+    probe->reply = networkAccessManager->get(request);
+
+    connect(probe->reply, &QNetworkReply::readyRead, this, [probe]() {
+        if (probe->firstByteNanoseconds < 0) probe->firstByteNanoseconds = probe->timer.nsecsElapsed();
+        probe->score.bytesReceived += probe->reply->readAll().size();
+    });
+
+    connect(probe->reply, &QNetworkReply::finished, this, [this, probe]() {
+        if (probe->reply->error() != QNetworkReply::NoError && probe->reply->error() != QNetworkReply::OperationCanceledError)
+        {
+            qDebug() << "Probe download from" << probe->score.server << "failed:" << probe->reply->errorString();
+            probe->score.bytesReceived = 0;
+        }
+        finishProbe(probe);
+    });
+}
+
+void MirrorRanker::finishProbe(Probe* probe)
+{
+    if (probe->done) return;
+    probe->done = true;
+
+    if (probe->reply)
+    {
+        probe->score.bytesReceived += probe->reply->readAll().size();
+
+        // Throughput is counted from the first byte, so the latency of the request does not weigh on it
+        double seconds = (probe->timer.nsecsElapsed() - std::max<qint64>(probe->firstByteNanoseconds, 0)) / 1e9;
+        if (probe->score.bytesReceived > 0 && seconds > 0) probe->score.bytesPerSecond = probe->score.bytesReceived / seconds;
+
+        probe->reply->deleteLater();
+        probe->reply = nullptr;
+    }
+
+    runningProbes--;
+
+    if (nextProbe >= probes.count() && runningProbes == 0)
+    {
+        finish();
+        return;
+    }
+
+    startNextProbes();
+}
+
+void MirrorRanker::finish()
+{
+    if (!running) return;
+    running = false;
+    budgetTimer.stop();
+
+    // Mirrors that were never probed are unreachable, the ones still probing are ranked by what they transferred so far
+    for (int i = nextProbe; i < probes.count(); i++) probes.at(i)->done = true;
+
+    for (Probe* probe : probes)
+    {
+        if (probe->socket)
+        {
+            probe->socket->abort();
+            probe->socket->deleteLater();
+            probe->socket = nullptr;
+        }
+        if (probe->reply && !probe->done) probe->reply->abort();
+        if (!probe->done) finishProbe(probe);
+    }
+
+    for (Probe* probe : probes) rankedScores << probe->score;
+
+    std::stable_sort(rankedScores.begin(), rankedScores.end(), [](const MirrorScore& score, const MirrorScore& other) {
+        if (score.isReachable() != other.isReachable()) return score.isReachable();
+        if (!score.isReachable()) return false;
+        if (score.bytesPerSecond != other.bytesPerSecond) return score.bytesPerSecond > other.bytesPerSecond;
+        return score.connectMilliseconds < other.connectMilliseconds;
+    });
+
+    int reachable = std::count_if(rankedScores.constBegin(), rankedScores.constEnd(), [](const MirrorScore& score) { return score.isReachable(); });
+    qDebug() << "Ranked" << rankedScores.count() << "mirrors," << reachable << "reachable";
+
+    emit finished(reachable > 0);
+}
@@ -0,0 +1,134 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <algorithm>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QTcpSocket;
+
+#ifndef MIRRORRANKER_H
+#define MIRRORRANKER_H
+
+// Measurements of one mirror. server is a Server line of a mirrorlist, e.g. https://host/archlinux/$repo/os/$arch
+struct MirrorScore
+{
+    QString server;
+    qint64 connectMilliseconds = -1;    // TCP connect latency, -1 if the mirror could not be reached
+    qint64 bytesReceived = 0;           // Bytes of the ranged probe download
+    double bytesPerSecond = 0.;         // Throughput of the probe download, from its first byte
+
+    bool isReachable() const
+    {
+        return connectMilliseconds >= 0 && bytesReceived > 0;
+    }
+};
+
+// Ranks the mirrors of a mirrorlist before the installation. Every candidate is probed concurrently, up to a
+// limit, with a TCP connect and a short ranged download of the extra database, and the whole ranking is bounded
+// by a time budget. Mirrors still probing when the budget runs out are ranked by what they downloaded so far.
+class MirrorRanker : public QObject
+{
+Q_OBJECT
+private:
+    struct Probe
+    {
+        MirrorScore score;
+        QTcpSocket* socket = nullptr;
+        QNetworkReply* reply = nullptr;
+        QElapsedTimer timer;
+        qint64 firstByteNanoseconds = -1;
+        bool done = false;
+    };
+
+    QNetworkAccessManager* networkAccessManager;
+    QList<Probe*> probes;
+    QList<MirrorScore> rankedScores;
+    QTimer budgetTimer;
+    int nextProbe = 0;
+    int runningProbes = 0;
+    bool running = false;
+
+    const QString probeRepository = "extra";
+
+    int concurrency = 8;
+    int timeBudget = 8000;
+    qint64 probeBytes = 1024 * 1024;
+
+    void startNextProbes();
+    void startDownload(Probe* probe);
+    void finishProbe(Probe* probe);
+    void finish();
+
+public:
+    explicit MirrorRanker(QObject* parent = nullptr);
+    ~MirrorRanker();
+
+    // Where the ranked mirrorlist is written, used by the installation and copied into the new root
+    static QString rankedMirrorlistPath()
+    {
+        return "/tmp/delphinos-installer/mirrorlist";
+    }
+
+    // Server lines of a mirrorlist that are not commented out
+    static QStringList readMirrorlist(const QString& path);
+
+    static bool writeMirrorlist(const QString& path, const QList<MirrorScore>& scores);
+
+    // URL of a file of a repository on a mirror
+    static QString repositoryUrl(const QString& server, const QString& repository, const QString& fileName);
+
+    void setConcurrency(int _concurrency)
+    {
+        concurrency = std::max(1, _concurrency);
+    }
+
+    void setTimeBudget(int milliseconds)
+    {
+        timeBudget = milliseconds;
+    }
+
+    void setProbeBytes(qint64 bytes)
+    {
+        probeBytes = bytes;
+    }
+
+    // Probe every server. Does nothing while a ranking runs.
+    void start(const QStringList& servers);
+
+    bool isRunning() const
+    {
+        return running;
+    }
+
+    // Fastest first. Unreachable mirrors are kept at the end, in their original order.
+    QList<MirrorScore> ranked() const
+    {
+        return rankedScores;
+    }
+
+signals:
+    void finished(bool success);
+};
+
+#endif
@@ -0,0 +1,338 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Stand-in for package mirrors, for testing and benchmarking the mirror ranking and the package downloads without
+// the internet. Each mirror is an HTTP/1.1 server on its own port, serving the files of a directory with its own
+// bandwidth, latency and faults. Range requests, keep-alive connections and pipelined requests are supported.
+//
+//   delphinos-mock-mirror --root /tmp/repo --mirror 8001:20000:5 --mirror 8002:500:80 --mirror 8003:5000:20:256:10
+//
+// Every --mirror is port:KiB/s:latency ms[:stall after KiB[:error percent]]. A mirror with 0 KiB/s is not throttled,
+// a stalled mirror stops sending every response after that many KiB, and a mirror with errors answers that
+// percentage of the requests with 503. --link limits the bandwidth shared by every connection to every mirror,
+// like the link of the client would.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+#include <QList>
+#include <QDebug>
+#include <algorithm>
+
+struct MirrorProfile
+{
+    quint16 port = 0;
+    qint64 bytesPerSecond = 0;  // 0 sends as fast as the connection allows
+    int latency = 0;            // Milliseconds before every response starts
+    qint64 stallAfter = -1;     // Bytes of every response sent before the mirror stalls, -1 to never stall
+    int errorPercent = 0;       // Percentage of requests answered with 503
+};
+
+static bool parseProfile(const QString& specification, MirrorProfile& profile)
+{
+    QStringList fields = specification.split(':');
+    if (fields.count() < 3 || fields.count() > 5) return false;
+
+    bool ok = true;
+    profile.port = fields.at(0).toUShort(&ok);
+    if (!ok) return false;
+    profile.bytesPerSecond = fields.at(1).toLongLong(&ok) * 1024;
+    if (!ok) return false;
+    profile.latency = fields.at(2).toInt(&ok);
+    if (!ok) return false;
+    if (fields.count() > 3) profile.stallAfter = fields.at(3).toLongLong(&ok) * 1024;
+    if (!ok) return false;
+    if (fields.count() > 4) profile.errorPercent = fields.at(4).toInt(&ok);
+
+    return ok;
+}
+
+// Bandwidth shared by every connection, refilled every tick. 0 bytes per second is unlimited.
+struct SharedLink
+{
+    qint64 bytesPerSecond = 0;
+    qint64 available = 0;
+
+    // Bytes of a chunk the link lets through in the current tick
+    qint64 take(qint64 chunk)
+    {
+        if (bytesPerSecond == 0) return chunk;
+
+        qint64 granted = std::min(chunk, available);
+        available -= granted;
+        return granted;
+    }
+};
+
+static SharedLink sharedLink;
+
+// One client connection. Requests are answered in order, so pipelined requests queue up in the buffer.
+class MirrorConnection : public QObject
+{
+private:
+    static constexpr int tickInterval = 10;
+    static constexpr qint64 unthrottledChunk = 256 * 1024;
+
+    QTcpSocket* socket;
+    const MirrorProfile profile;
+    const QDir root;
+
+    QByteArray requestBuffer;
+    bool responding = false;
+    bool closeAfterResponse = false;
+
+    QFile body;
+    qint64 bodyRemaining = 0;
+    qint64 bodySent = 0;
+    QTimer sendTimer;
+
+    void respondToNextRequest()
+    {
+        int headerEnd = requestBuffer.indexOf("\r\n\r\n");
+        if (responding || headerEnd < 0) return;
+
+        QList<QByteArray> lines = requestBuffer.left(headerEnd).split('\n');
+        requestBuffer.remove(0, headerEnd + 4);
+
+        QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+        QByteArray method = requestLine.value(0);
+        QString path = QString::fromUtf8(QByteArray::fromPercentEncoding(requestLine.value(1)));
+
+        QByteArray range;
+        closeAfterResponse = requestLine.value(2) == "HTTP/1.0";
+        for (const QByteArray& line : lines)
+        {
+            int colon = line.indexOf(':');
+            QByteArray name = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed();
+            if (name == "range") range = value;
+            if (name == "connection") closeAfterResponse = value.toLower() == "close";
+        }
+
+        responding = true;
+        QTimer::singleShot(profile.latency, this, [this, method, path, range]() {
+            respond(method, path, range);
+        });
+    }
+
+    void respond(const QByteArray& method, const QString& path, const QByteArray& range)
+    {
+        if (profile.errorPercent > 0 && QRandomGenerator::global()->bounded(100) < profile.errorPercent)
+        {
+            sendHeader(503, "Service Unavailable", 0);
+            finishResponse();
+            return;
+        }
+
+        QString filePath = QDir::cleanPath(root.absolutePath() + "/" + path);
+        body.setFileName(filePath);
+
+        if (!filePath.startsWith(root.absolutePath()) || !body.open(QIODevice::ReadOnly))
+        {
+            sendHeader(404, "Not Found", 0);
+            finishResponse();
+            return;
+        }
+
+        const qint64 size = body.size();
+        qint64 first = 0;
+        qint64 last = size - 1;
+        bool partial = false;
+
+        if (range.startsWith("bytes="))
+        {
+            QByteArray interval = range.mid(6);
+            int dash = interval.indexOf('-');
+            first = interval.left(dash).toLongLong();
+            QByteArray end = interval.mid(dash + 1);
+            if (!end.isEmpty()) last = std::min(end.toLongLong(), size - 1);
+
+            if (first >= size || first > last)
+            {
+                sendHeader(416, "Range Not Satisfiable", 0, QString("Content-Range: bytes */%1\r\n").arg(size).toLatin1());
+                body.close();
+                finishResponse();
+                return;
+            }
+            partial = true;
+        }
+
+        bodyRemaining = last - first + 1;
+        bodySent = 0;
+        body.seek(first);
+
+        if (partial)
+        {
+            sendHeader(206, "Partial Content", bodyRemaining, QString("Content-Range: bytes %1-%2/%3\r\n").arg(first).arg(last).arg(size).toLatin1());
+        } else {
+            sendHeader(200, "OK", bodyRemaining);
+        }
+
+        if (method == "HEAD")
+        {
+            bodyRemaining = 0;
+            body.close();
+            finishResponse();
+            return;
+        }
+
+        sendTimer.start();
+        sendBody();
+    }
+
+    void sendHeader(int status, const QByteArray& reason, qint64 contentLength, const QByteArray& extraHeaders = QByteArray())
+    {
+        QByteArray header = QString("HTTP/1.1 %1 ").arg(status).toLatin1() + reason + "\r\n";
+        header += "Content-Length: " + QByteArray::number(contentLength) + "\r\n";
+        header += "Accept-Ranges: bytes\r\n";
+        header += closeAfterResponse ? "Connection: close\r\n" : "Connection: keep-alive\r\n";
+        header += extraHeaders + "\r\n";
+        socket->write(header);
+    }
+
+    // Send what the bandwidth of the mirror allows in one tick
+    void sendBody()
+    {
+        if (profile.stallAfter >= 0 && bodySent >= profile.stallAfter) return;
+
+        qint64 chunk = profile.bytesPerSecond > 0 ? std::max<qint64>(1, profile.bytesPerSecond * tickInterval / 1000) : unthrottledChunk;
+        if (profile.bytesPerSecond == 0 && socket->bytesToWrite() > unthrottledChunk) return;
+        if (profile.stallAfter >= 0) chunk = std::min(chunk, profile.stallAfter - bodySent);
+
+        chunk = sharedLink.take(std::min(chunk, bodyRemaining));
+        if (chunk <= 0 && bodyRemaining > 0) return;
+
+        QByteArray data = body.read(std::min(chunk, bodyRemaining));
+        socket->write(data);
+        bodySent += data.size();
+        bodyRemaining -= data.size();
+
+        if (bodyRemaining <= 0 || data.isEmpty())
+        {
+            sendTimer.stop();
+            body.close();
+            finishResponse();
+        }
+    }
+
+    void finishResponse()
+    {
+        responding = false;
+
+        if (closeAfterResponse)
+        {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        respondToNextRequest();
+    }
+
+public:
+    MirrorConnection(QTcpSocket* _socket, const MirrorProfile& _profile, const QDir& _root)
+        : QObject(_socket), socket(_socket), profile(_profile), root(_root)
+    {
+        sendTimer.setInterval(tickInterval);
+        connect(&sendTimer, &QTimer::timeout, this, [this]() { sendBody(); });
+
+        connect(socket, &QTcpSocket::readyRead, this, [this]() {
+            requestBuffer += socket->readAll();
+            respondToNextRequest();
+        });
+
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("delphinos-mock-mirror");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Stand-in for package mirrors, for testing and benchmarking delphinos-installer");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "root", "Directory served by every mirror, laid out as $repo/os/$arch/<file>.", "dir", "." },
+        { "mirror", "A mirror, as port:KiB/s:latency ms[:stall after KiB[:error percent]]. May be repeated.", "profile" },
+        { "link", "Bandwidth shared by every connection, in KiB/s. 0 is unlimited.", "KiB/s", "0" },
+    });
+    parser.process(app);
+
+    sharedLink.bytesPerSecond = parser.value("link").toLongLong() * 1024;
+
+    QTimer linkTimer;
+    linkTimer.setInterval(10);
+    QObject::connect(&linkTimer, &QTimer::timeout, [&]() {
+        sharedLink.available = sharedLink.bytesPerSecond * linkTimer.interval() / 1000;
+    });
+    linkTimer.start();
+
+    QDir root(parser.value("root"));
+    if (!root.exists())
+    {
+        qCritical() << "The directory" << root.path() << "does not exist";
+        return 1;
+    }
+
+    QList<QTcpServer*> servers;
+    QStringList ports;
+
+    for (const QString& specification : parser.values("mirror"))
+    {
+        MirrorProfile profile;
+        if (!parseProfile(specification, profile))
+        {
+            qCritical() << "Invalid mirror" << specification;
+            return 1;
+        }
+
+        QTcpServer* server = new QTcpServer(&app);
+        if (!server->listen(QHostAddress::LocalHost, profile.port))
+        {
+            qCritical() << "Could not listen on port" << profile.port << ":" << server->errorString();
+            return 1;
+        }
+
+        QObject::connect(server, &QTcpServer::newConnection, server, [server, profile, root]() {
+            while (QTcpSocket* socket = server->nextPendingConnection())
+            {
+                new MirrorConnection(socket, profile, root);
+            }
+        });
+
+        servers << server;
+        ports << QString::number(server->serverPort());
+    }
+
+    if (servers.isEmpty())
+    {
+        qCritical() << "No mirror was given";
+        return 1;
+    }
+
+    // Whoever started the mirrors waits for this line before using them
+    QTextStream(stdout) << "ready " << ports.join(" ") << Qt::endl;
+
+    return app.exec();
+}
@@ -0,0 +1,604 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Scriptable stand-in for the NetworkManager D-Bus service, for running the network page without NetworkManager
+// or radios. It exports a configurable number of devices, access points and saved connections on a private bus,
+// answers the calls the installer makes and emits the signals NetworkManager would. It is driven by the command
+// line options and, while running, by the methods of org.delphinos.MockNetworkManager on /org/freedesktop/DelphinosMock.
+//
+//   dbus-daemon --session --nofork --print-address &
+//   delphinos-mock-networkmanager --bus <address> --access-points 100 --connections 10 --strength-interval 500
+//   DELPHINOS_NETWORK_BUS=<address> delphinos-installer-elevated
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDBusConnection>
+#include <QDBusVirtualObject>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QDBusArgument>
+#include <QDBusVariant>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QTimer>
+#include <QUuid>
+#include <QMap>
+#include <QDebug>
+#include <algorithm>
+
+const QString NM_SERVICE = "org.freedesktop.NetworkManager";
+const QString NM_PATH = "/org/freedesktop/NetworkManager";
+const QString NM_SETTINGS = "org.freedesktop.NetworkManager.Settings";
+const QString NM_SETTINGS_PATH = "/org/freedesktop/NetworkManager/Settings";
+const QString NM_CONNECTION_INTERFACE = "org.freedesktop.NetworkManager.Settings.Connection";
+const QString NM_ACTIVE_CONNECTION_INTERFACE = "org.freedesktop.NetworkManager.Connection.Active";
+const QString NM_DEVICE_INTERFACE = "org.freedesktop.NetworkManager.Device";
+const QString NM_WIRELESS_INTERFACE = "org.freedesktop.NetworkManager.Device.Wireless";
+const QString NM_ACCESS_POINT_INTERFACE = "org.freedesktop.NetworkManager.AccessPoint";
+const QString NM_OBJECT_MANAGER_PATH = "/org/freedesktop";
+
+const QString DBUS_PROPERTIES_INTERFACE = "org.freedesktop.DBus.Properties";
+const QString DBUS_OBJECT_MANAGER_INTERFACE = "org.freedesktop.DBus.ObjectManager";
+const QString DBUS_INTROSPECTABLE_INTERFACE = "org.freedesktop.DBus.Introspectable";
+
+const QString MOCK_INTERFACE = "org.delphinos.MockNetworkManager";
+const QString MOCK_PATH = "/org/freedesktop/DelphinosMock";
+
+// NMDeviceState values used by the mock
+const uint DEVICE_STATE_DISCONNECTED = 30;
+const uint DEVICE_STATE_PREPARE = 40;
+const uint DEVICE_STATE_CONFIG = 50;
+const uint DEVICE_STATE_IP_CONFIG = 70;
+const uint DEVICE_STATE_ACTIVATED = 100;
+
+using InterfaceProperties = QMap<QString, QVariantMap>;
+using ManagedObjects = QMap<QDBusObjectPath, InterfaceProperties>;
+
+class MockNetworkManager : public QDBusVirtualObject
+{
+private:
+    QDBusConnection bus;
+    QRandomGenerator random;
+    QElapsedTimer uptime;
+
+    QMap<QString, InterfaceProperties> objects;   // Every exported object, by path
+    QMap<QString, InterfaceProperties> connectionSettings;
+    QMap<QString, InterfaceProperties> secrets;   // Secrets of the saved connections, never returned by GetSettings
+    QStringList wirelessDevicePaths;
+    QStringList accessPointPaths;
+
+    int nextDevice = 0;
+    int nextAccessPoint = 0;
+    int nextConnection = 0;
+    int nextActiveConnection = 0;
+    int activationDelay;                          // Milliseconds from ActivateConnection to the activated state
+    quint32 callCount = 0;                        // Calls served, except the ones on the mock interface
+
+    static QList<QDBusObjectPath> toPaths(const QStringList& paths)
+    {
+        QList<QDBusObjectPath> objectPaths;
+        for (const QString& path : paths) objectPaths << QDBusObjectPath(path);
+        return objectPaths;
+    }
+
+    QStringList pathsWithInterface(const QString& interface) const
+    {
+        QStringList paths;
+        for (auto it = objects.constBegin(); it != objects.constEnd(); it++)
+        {
+            if (it.value().contains(interface)) paths << it.key();
+        }
+        return paths;
+    }
+
+    void emitSignal(const QString& path, const QString& interface, const QString& name, const QVariantList& arguments)
+    {
+        QDBusMessage signal = QDBusMessage::createSignal(path, interface, name);
+        signal.setArguments(arguments);
+        bus.send(signal);
+    }
+
+    void setProperty(const QString& path, const QString& interface, const QString& name, const QVariant& value)
+    {
+        objects[path][interface][name] = value;
+        emitSignal(path, DBUS_PROPERTIES_INTERFACE, "PropertiesChanged", { interface, QVariantMap{ { name, value } }, QStringList() });
+    }
+
+    void addObject(const QString& path, const InterfaceProperties& interfaces)
+    {
+        objects.insert(path, interfaces);
+        emitSignal(NM_OBJECT_MANAGER_PATH, DBUS_OBJECT_MANAGER_INTERFACE, "InterfacesAdded",
+            { QVariant::fromValue(QDBusObjectPath(path)), QVariant::fromValue(interfaces) });
+    }
+
+    void removeObject(const QString& path)
+    {
+        QStringList interfaces = objects.take(path).keys();
+        emitSignal(NM_OBJECT_MANAGER_PATH, DBUS_OBJECT_MANAGER_INTERFACE, "InterfacesRemoved",
+            { QVariant::fromValue(QDBusObjectPath(path)), interfaces });
+    }
+
+    QString randomHardwareAddress()
+    {
+        QStringList bytes;
+        for (int i = 0; i < 6; i++) bytes << QString("%1").arg(random.bounded(256), 2, 16, QChar('0')).toUpper();
+        return bytes.join(":");
+    }
+
+    void addDevice(const QString& interfaceName, uint deviceType)
+    {
+        QString path = QString("%1/Devices/%2").arg(NM_PATH).arg(nextDevice++);
+
+        InterfaceProperties interfaces;
+        interfaces[NM_DEVICE_INTERFACE] = QVariantMap{
+            { "Interface", interfaceName },
+            { "DeviceType", deviceType },
+            { "State", DEVICE_STATE_DISCONNECTED },
+            { "ActiveConnection", QVariant::fromValue(QDBusObjectPath("/")) },
+            { "Driver", "mock" },
+            { "HwAddress", randomHardwareAddress() },
+            { "Managed", true }
+        };
+
+        if (deviceType == 2)
+        {
+            interfaces[NM_WIRELESS_INTERFACE] = QVariantMap{
+                { "AccessPoints", QVariant::fromValue(QList<QDBusObjectPath>()) },
+                { "ActiveAccessPoint", QVariant::fromValue(QDBusObjectPath("/")) },
+                { "LastScan", uptime.elapsed() },
+                { "WirelessCapabilities", 0x7ffu }
+            };
+            wirelessDevicePaths << path;
+        }
+
+        addObject(path, interfaces);
+        setProperty(NM_PATH, NM_SERVICE, "Devices", QVariant::fromValue(toPaths(pathsWithInterface(NM_DEVICE_INTERFACE))));
+    }
+
+    // Access points are spread over the wireless devices, each with its own SSID
+    void addAccessPoint()
+    {
+        if (wirelessDevicePaths.isEmpty()) return;
+
+        int number = nextAccessPoint++;
+        QString path = QString("%1/AccessPoint/%2").arg(NM_PATH).arg(number);
+        QString devicePath = wirelessDevicePaths.at(number % wirelessDevicePaths.count());
+
+        addObject(path, InterfaceProperties{ { NM_ACCESS_POINT_INTERFACE, QVariantMap{
+            { "Ssid", QString("Rede %1").arg(number).toUtf8() },
+            { "Strength", QVariant::fromValue<uchar>(random.bounded(10, 101)) },
+            { "Frequency", number % 2 ? 5180u : 2412u },
+            { "HwAddress", randomHardwareAddress() },
+            { "Mode", 2u },
+            { "MaxBitrate", 270000u },
+            { "Flags", 1u },
+            { "WpaFlags", 0u },
+            { "RsnFlags", 0x188u },
+            { "LastSeen", static_cast<int>(uptime.elapsed() / 1000) }
+        } } });
+        accessPointPaths << path;
+
+        QList<QDBusObjectPath> deviceAccessPoints = qdbus_cast<QList<QDBusObjectPath>>(objects[devicePath][NM_WIRELESS_INTERFACE]["AccessPoints"]);
+        deviceAccessPoints << QDBusObjectPath(path);
+        setProperty(devicePath, NM_WIRELESS_INTERFACE, "AccessPoints", QVariant::fromValue(deviceAccessPoints));
+        emitSignal(devicePath, NM_WIRELESS_INTERFACE, "AccessPointAdded", { QVariant::fromValue(QDBusObjectPath(path)) });
+    }
+
+    void removeAccessPoint(const QString& path)
+    {
+        accessPointPaths.removeOne(path);
+        removeObject(path);
+
+        for (const QString& devicePath : wirelessDevicePaths)
+        {
+            QList<QDBusObjectPath> deviceAccessPoints = qdbus_cast<QList<QDBusObjectPath>>(objects[devicePath][NM_WIRELESS_INTERFACE]["AccessPoints"]);
+            if (!deviceAccessPoints.removeOne(QDBusObjectPath(path))) continue;
+
+            setProperty(devicePath, NM_WIRELESS_INTERFACE, "AccessPoints", QVariant::fromValue(deviceAccessPoints));
+            emitSignal(devicePath, NM_WIRELESS_INTERFACE, "AccessPointRemoved", { QVariant::fromValue(QDBusObjectPath(path)) });
+        }
+    }
+
+    QString addConnection(InterfaceProperties settings)
+    {
+        QString path = QString("%1/%2").arg(NM_SETTINGS_PATH).arg(nextConnection++);
+
+        // Secrets are kept apart, as NetworkManager does
+        if (settings.contains("802-11-wireless-security"))
+        {
+            QVariant psk = settings["802-11-wireless-security"].take("psk");
+            if (psk.isValid()) secrets[path]["802-11-wireless-security"]["psk"] = psk;
+        }
+
+        addObject(path, InterfaceProperties{ { NM_CONNECTION_INTERFACE, QVariantMap{ { "Unsaved", false }, { "Flags", 0u } } } });
+        connectionSettings.insert(path, settings);
+
+        setProperty(NM_SETTINGS_PATH, NM_SETTINGS, "Connections", QVariant::fromValue(toPaths(connectionSettings.keys())));
+        emitSignal(NM_SETTINGS_PATH, NM_SETTINGS, "NewConnection", { QVariant::fromValue(QDBusObjectPath(path)) });
+        return path;
+    }
+
+    void removeConnection(const QString& path)
+    {
+        connectionSettings.remove(path);
+        secrets.remove(path);
+        removeObject(path);
+
+        emitSignal(path, NM_CONNECTION_INTERFACE, "Removed", {});
+        setProperty(NM_SETTINGS_PATH, NM_SETTINGS, "Connections", QVariant::fromValue(toPaths(connectionSettings.keys())));
+        emitSignal(NM_SETTINGS_PATH, NM_SETTINGS, "ConnectionRemoved", { QVariant::fromValue(QDBusObjectPath(path)) });
+    }
+
+    // Walk the device through the activation states, as a real connection would
+    QString activateConnection(const QString& connectionPath, const QString& devicePath)
+    {
+        QString activePath = QString("%1/ActiveConnection/%2").arg(NM_PATH).arg(nextActiveConnection++);
+
+        addObject(activePath, InterfaceProperties{ { NM_ACTIVE_CONNECTION_INTERFACE, QVariantMap{
+            { "Connection", QVariant::fromValue(QDBusObjectPath(connectionPath)) },
+            { "Devices", QVariant::fromValue(QList<QDBusObjectPath>{ QDBusObjectPath(devicePath) }) },
+            { "State", 1u }
+        } } });
+
+        setProperty(devicePath, NM_DEVICE_INTERFACE, "ActiveConnection", QVariant::fromValue(QDBusObjectPath(activePath)));
+
+        const QList<uint> states = { DEVICE_STATE_PREPARE, DEVICE_STATE_CONFIG, DEVICE_STATE_IP_CONFIG, DEVICE_STATE_ACTIVATED };
+        for (int i = 0; i < states.count(); i++)
+        {
+            uint state = states.at(i);
+            QTimer::singleShot(activationDelay * i / (states.count() - 1), [this, devicePath, activePath, state]() {
+                if (!objects.contains(activePath)) return;
+
+                uint oldState = objects[devicePath][NM_DEVICE_INTERFACE]["State"].toUInt();
+                setProperty(devicePath, NM_DEVICE_INTERFACE, "State", state);
+                emitSignal(devicePath, NM_DEVICE_INTERFACE, "StateChanged", { state, oldState, 0u });
+
+                if (state == DEVICE_STATE_ACTIVATED)
+                {
+                    setProperty(activePath, NM_ACTIVE_CONNECTION_INTERFACE, "State", 2u);
+                    setProperty(NM_PATH, NM_SERVICE, "State", 70u);
+                    emitSignal(NM_PATH, NM_SERVICE, "StateChanged", { 70u });
+                }
+            });
+        }
+
+        return activePath;
+    }
+
+    void deactivateConnection(const QString& activePath)
+    {
+        if (!objects.contains(activePath)) return;
+
+        for (const QDBusObjectPath& devicePath : qdbus_cast<QList<QDBusObjectPath>>(objects[activePath][NM_ACTIVE_CONNECTION_INTERFACE]["Devices"]))
+        {
+            uint oldState = objects[devicePath.path()][NM_DEVICE_INTERFACE]["State"].toUInt();
+            setProperty(devicePath.path(), NM_DEVICE_INTERFACE, "ActiveConnection", QVariant::fromValue(QDBusObjectPath("/")));
+            setProperty(devicePath.path(), NM_DEVICE_INTERFACE, "State", DEVICE_STATE_DISCONNECTED);
+            emitSignal(devicePath.path(), NM_DEVICE_INTERFACE, "StateChanged", { DEVICE_STATE_DISCONNECTED, oldState, 0u });
+        }
+
+        setProperty(activePath, NM_ACTIVE_CONNECTION_INTERFACE, "State", 4u);
+        removeObject(activePath);
+    }
+
+    QVariant handleCall(const QDBusMessage& message, QString& errorName)
+    {
+        const QString path = message.path();
+        const QString interface = message.interface();
+        const QString member = message.member();
+        const QVariantList arguments = message.arguments();
+
+        if (interface == DBUS_OBJECT_MANAGER_INTERFACE && member == "GetManagedObjects")
+        {
+            ManagedObjects managedObjects;
+            for (auto it = objects.constBegin(); it != objects.constEnd(); it++)
+            {
+                if (it.key() != MOCK_PATH) managedObjects.insert(QDBusObjectPath(it.key()), it.value());
+            }
+            return QVariant::fromValue(managedObjects);
+        }
+
+        if (interface == DBUS_PROPERTIES_INTERFACE && objects.contains(path))
+        {
+            if (member == "GetAll") return objects[path].value(arguments.value(0).toString());
+            if (member == "Get") return QVariant::fromValue(QDBusVariant(objects[path].value(arguments.value(0).toString()).value(arguments.value(1).toString())));
+            if (member == "Set") return QVariant();
+        }
+
+        if (interface == NM_SERVICE && path == NM_PATH)
+        {
+            if (member == "GetDevices" || member == "GetAllDevices") return QVariant::fromValue(toPaths(pathsWithInterface(NM_DEVICE_INTERFACE)));
+            if (member == "ActivateConnection") return QVariant::fromValue(QDBusObjectPath(activateConnection(
+                qdbus_cast<QDBusObjectPath>(arguments.value(0)).path(), qdbus_cast<QDBusObjectPath>(arguments.value(1)).path())));
+            if (member == "DeactivateConnection")
+            {
+                deactivateConnection(qdbus_cast<QDBusObjectPath>(arguments.value(0)).path());
+                return QVariant();
+            }
+        }
+
+        if (interface == NM_WIRELESS_INTERFACE && wirelessDevicePaths.contains(path))
+        {
+            if (member == "GetAccessPoints" || member == "GetAllAccessPoints") return objects[path][NM_WIRELESS_INTERFACE]["AccessPoints"];
+            if (member == "RequestScan")
+            {
+                // Scan results arrive later, as new signal strengths and a new LastScan
+                QTimer::singleShot(random.bounded(100, 500), [this, path]() {
+                    for (int i = 0; i < std::min<qsizetype>(accessPointPaths.count(), 5); i++) changeStrength();
+                    setProperty(path, NM_WIRELESS_INTERFACE, "LastScan", uptime.elapsed());
+                });
+                return QVariant();
+            }
+        }
+
+        if (interface == NM_DEVICE_INTERFACE && member == "Disconnect" && objects.contains(path))
+        {
+            deactivateConnection(qdbus_cast<QDBusObjectPath>(objects[path][NM_DEVICE_INTERFACE]["ActiveConnection"]).path());
+            return QVariant();
+        }
+
+        if (interface == NM_SETTINGS && path == NM_SETTINGS_PATH)
+        {
+            if (member == "ListConnections") return QVariant::fromValue(toPaths(connectionSettings.keys()));
+            if (member == "AddConnection" || member == "AddConnectionUnsaved")
+            {
+                return QVariant::fromValue(QDBusObjectPath(addConnection(qdbus_cast<InterfaceProperties>(arguments.value(0)))));
+            }
+        }
+
+        if (interface == NM_CONNECTION_INTERFACE && connectionSettings.contains(path))
+        {
+            if (member == "GetSettings") return QVariant::fromValue(connectionSettings.value(path));
+            if (member == "GetSecrets")
+            {
+                QString settingName = arguments.value(0).toString();
+                return QVariant::fromValue(InterfaceProperties{ { settingName, secrets[path].value(settingName) } });
+            }
+            if (member == "Update" || member == "UpdateUnsaved")
+            {
+                InterfaceProperties settings = qdbus_cast<InterfaceProperties>(arguments.value(0));
+                if (settings.contains("802-11-wireless-security"))
+                {
+                    QVariant psk = settings["802-11-wireless-security"].take("psk");
+                    if (psk.isValid()) secrets[path]["802-11-wireless-security"]["psk"] = psk;
+                }
+                connectionSettings[path] = settings;
+                emitSignal(path, NM_CONNECTION_INTERFACE, "Updated", {});
+                return QVariant();
+            }
+            if (member == "Save") return QVariant();
+            if (member == "Delete")
+            {
+                removeConnection(path);
+                return QVariant();
+            }
+        }
+
+        errorName = "org.freedesktop.DBus.Error.UnknownMethod";
+        return QVariant();
+    }
+
+    QVariant handleMockCall(const QDBusMessage& message, QString& errorName)
+    {
+        const QString member = message.member();
+        const QVariantList arguments = message.arguments();
+
+        if (member == "GetCallCount") return callCount;
+        if (member == "ResetCallCount")
+        {
+            callCount = 0;
+            return QVariant();
+        }
+        if (member == "SetAccessPointCount")
+        {
+            setAccessPointCount(arguments.value(0).toUInt());
+            return QVariant();
+        }
+        if (member == "ChangeStrengths")
+        {
+            for (uint i = 0; i < arguments.value(0).toUInt(); i++) changeStrength();
+            return QVariant();
+        }
+        if (member == "ChurnAccessPoints")
+        {
+            for (uint i = 0; i < arguments.value(0).toUInt(); i++) churnAccessPoint();
+            return QVariant();
+        }
+        if (member == "SetDeviceState")
+        {
+            QString devicePath = qdbus_cast<QDBusObjectPath>(arguments.value(0)).path();
+            if (!objects.contains(devicePath)) return QVariant();
+
+            uint state = arguments.value(1).toUInt();
+            uint oldState = objects[devicePath][NM_DEVICE_INTERFACE]["State"].toUInt();
+            setProperty(devicePath, NM_DEVICE_INTERFACE, "State", state);
+            emitSignal(devicePath, NM_DEVICE_INTERFACE, "StateChanged", { state, oldState, 0u });
+            return QVariant();
+        }
+
+        errorName = "org.freedesktop.DBus.Error.UnknownMethod";
+        return QVariant();
+    }
+
+public:
+    MockNetworkManager(const QDBusConnection& _bus, quint32 seed, int _activationDelay)
+        : bus(_bus), random(seed), activationDelay(_activationDelay)
+    {
+        qDBusRegisterMetaType<QVariantMap>();
+        qDBusRegisterMetaType<InterfaceProperties>();
+        qDBusRegisterMetaType<ManagedObjects>();
+        uptime.start();
+
+        objects.insert(NM_PATH, InterfaceProperties{ { NM_SERVICE, QVariantMap{
+            { "Devices", QVariant::fromValue(QList<QDBusObjectPath>()) },
+            { "State", 20u },
+            { "Version", "1.46.0-mock" },
+            { "WirelessEnabled", true },
+            { "NetworkingEnabled", true }
+        } } });
+        objects.insert(NM_SETTINGS_PATH, InterfaceProperties{ { NM_SETTINGS, QVariantMap{
+            { "Connections", QVariant::fromValue(QList<QDBusObjectPath>()) },
+            { "Hostname", "delphinos" }
+        } } });
+        objects.insert(MOCK_PATH, InterfaceProperties{ { MOCK_INTERFACE, QVariantMap() } });
+    }
+
+    void populate(int ethernetDevices, int wirelessDevices, int accessPoints, int connections)
+    {
+        for (int i = 0; i < ethernetDevices; i++) addDevice(QString("eth%1").arg(i), 1);
+        for (int i = 0; i < wirelessDevices; i++) addDevice(QString("wlan%1").arg(i), 2);
+        setAccessPointCount(accessPoints);
+
+        // The first networks have saved profiles, with their passwords
+        for (int i = 0; i < connections; i++)
+        {
+            QString ssid = QString("Rede %1").arg(i);
+            addConnection(InterfaceProperties{
+                { "connection", QVariantMap{ { "type", "802-11-wireless" }, { "id", ssid }, { "uuid", QUuid::createUuid().toString(QUuid::WithoutBraces) } } },
+                { "802-11-wireless", QVariantMap{ { "ssid", ssid.toUtf8() }, { "mode", "infrastructure" }, { "security", "802-11-wireless-security" } } },
+                { "802-11-wireless-security", QVariantMap{ { "key-mgmt", "wpa-psk" }, { "psk", QString("senha%1").arg(i) } } },
+                { "ipv4", QVariantMap{ { "method", "auto" } } },
+                { "ipv6", QVariantMap{ { "method", "auto" } } }
+            });
+        }
+    }
+
+    void setAccessPointCount(uint count)
+    {
+        while (static_cast<uint>(accessPointPaths.count()) < count && !wirelessDevicePaths.isEmpty()) addAccessPoint();
+        while (static_cast<uint>(accessPointPaths.count()) > count) removeAccessPoint(accessPointPaths.last());
+    }
+
+    void changeStrength()
+    {
+        if (accessPointPaths.isEmpty()) return;
+
+        QString path = accessPointPaths.at(random.bounded(accessPointPaths.count()));
+        setProperty(path, NM_ACCESS_POINT_INTERFACE, "Strength", QVariant::fromValue<uchar>(random.bounded(10, 101)));
+    }
+
+    // An access point goes out of range and another one appears
+    void churnAccessPoint()
+    {
+        if (accessPointPaths.isEmpty()) return;
+
+        removeAccessPoint(accessPointPaths.at(random.bounded(accessPointPaths.count())));
+        addAccessPoint();
+    }
+
+    QString introspect(const QString& path) const override
+    {
+        QString xml;
+        for (const QString& interface : objects.value(path).keys())
+        {
+            xml += QString("  <interface name=\"%1\"/>\n").arg(interface);
+        }
+        return xml;
+    }
+
+    bool handleMessage(const QDBusMessage& message, const QDBusConnection& connection) override
+    {
+        if (message.type() != QDBusMessage::MethodCallMessage) return false;
+
+        // Introspection is answered by Qt from introspect()
+        if (message.interface() == DBUS_INTROSPECTABLE_INTERFACE)
+        {
+            callCount++;
+            return false;
+        }
+
+        QString errorName;
+        QVariant result;
+
+        if (message.interface() == MOCK_INTERFACE)
+        {
+            result = handleMockCall(message, errorName);
+        } else {
+            callCount++;
+            result = handleCall(message, errorName);
+        }
+
+        if (!errorName.isEmpty())
+        {
+            connection.send(message.createErrorReply(errorName, QString("%1.%2 is not implemented on %3").arg(message.interface(), message.member(), message.path())));
+        } else {
+            connection.send(result.isValid() ? message.createReply(result) : message.createReply());
+        }
+        return true;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("delphinos-mock-networkmanager");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Stand-in for the NetworkManager D-Bus service, for testing and benchmarking delphinos-installer");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "bus", "Address of the bus to register on. Defaults to the session bus.", "address" },
+        { "ethernet-devices", "Number of Ethernet devices.", "n", "1" },
+        { "wifi-devices", "Number of Wi-Fi devices. The access points are spread over them.", "n", "1" },
+        { "access-points", "Number of access points, each with its own SSID.", "n", "10" },
+        { "connections", "Number of saved connections, for the first SSIDs.", "n", "1" },
+        { "strength-interval", "Change the signal strength of a random access point every ms milliseconds. 0 disables it.", "ms", "0" },
+        { "churn-interval", "Replace a random access point every ms milliseconds. 0 disables it.", "ms", "0" },
+        { "activation-delay", "Milliseconds from ActivateConnection to the activated state.", "ms", "300" },
+        { "seed", "Seed of the random strengths and addresses.", "n", "1" },
+    });
+    parser.process(app);
+
+    QDBusConnection bus = parser.isSet("bus") ? QDBusConnection::connectToBus(parser.value("bus"), "mock-networkmanager") : QDBusConnection::sessionBus();
+    if (!bus.isConnected())
+    {
+        qCritical() << "Could not connect to the bus:" << bus.lastError().message();
+        return 1;
+    }
+
+    MockNetworkManager networkManager(bus, parser.value("seed").toUInt(), parser.value("activation-delay").toInt());
+
+    if (!bus.registerVirtualObject(NM_OBJECT_MANAGER_PATH, &networkManager, QDBusConnection::SubPath))
+    {
+        qCritical() << "Could not register the objects:" << bus.lastError().message();
+        return 1;
+    }
+
+    networkManager.populate(parser.value("ethernet-devices").toInt(), parser.value("wifi-devices").toInt(),
+        parser.value("access-points").toInt(), parser.value("connections").toInt());
+
+    if (!bus.registerService(NM_SERVICE))
+    {
+        qCritical() << "Could not own" << NM_SERVICE << ":" << bus.lastError().message();
+        return 1;
+    }
+
+    QTimer strengthTimer;
+    QObject::connect(&strengthTimer, &QTimer::timeout, [&networkManager]() { networkManager.changeStrength(); });
+    if (parser.value("strength-interval").toInt() > 0) strengthTimer.start(parser.value("strength-interval").toInt());
+
+    QTimer churnTimer;
+    QObject::connect(&churnTimer, &QTimer::timeout, [&networkManager]() { networkManager.churnAccessPoint(); });
+    if (parser.value("churn-interval").toInt() > 0) churnTimer.start(parser.value("churn-interval").toInt());
+
+    // Whoever started the mock waits for this line before calling it
+    QTextStream(stdout) << "ready " << bus.baseService() << Qt::endl;
+
+    return app.exec();
+}
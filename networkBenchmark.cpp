@@ -0,0 +1,247 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Benchmark of the network page against delphinos-mock-networkmanager on a private bus. For every access point
+// count it starts the mock, builds a NetworkPage, selects the Wi-Fi device and measures the first load, the
+// refreshes, the D-Bus calls the mock served and the memory held by the page.
+//
+//   delphinos-network-benchmark --access-points 1,100,1000 --iterations 20
+
+#include "networkPage.hpp"
+#include "benchmarkHelpers.hpp"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QProcess>
+#include <QTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+const QString MOCK_INTERFACE = "org.delphinos.MockNetworkManager";
+const QString MOCK_PATH = "/org/freedesktop/DelphinosMock";
+
+// Resident memory of the benchmark process, in KiB
+static qint64 residentKiB()
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) return 0;
+
+    for (const QByteArray& line : status.readAll().split('\n'))
+    {
+        if (line.startsWith("VmRSS:")) return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+    return 0;
+}
+
+struct NetworkSample
+{
+    int accessPoints;
+    int rows;
+    double firstLoadMilliseconds;
+    QList<double> refreshMilliseconds;
+    uint firstLoadCalls;
+    double callsPerRefresh;
+    qint64 residentDeltaKiB;
+};
+
+class NetworkBenchmark
+{
+private:
+    QString mockProgram;
+    QString busAddress;
+    int iterations;
+    int connections;
+    int timeout;
+
+    uint mockCallCount()
+    {
+        QDBusMessage reply = networkBus().call(QDBusMessage::createMethodCall(NM_SERVICE, MOCK_PATH, MOCK_INTERFACE, "GetCallCount"));
+        return reply.arguments().value(0).toUInt();
+    }
+
+    void resetMockCallCount()
+    {
+        networkBus().call(QDBusMessage::createMethodCall(NM_SERVICE, MOCK_PATH, MOCK_INTERFACE, "ResetCallCount"));
+    }
+
+public:
+    NetworkBenchmark(const QString& _mockProgram, const QString& _busAddress, int _iterations, int _connections, int _timeout)
+        : mockProgram(_mockProgram), busAddress(_busAddress), iterations(_iterations), connections(_connections), timeout(_timeout) {}
+
+    bool run(int accessPoints, NetworkSample& sample)
+    {
+        QProcess mock;
+        mock.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        mock.start(mockProgram, {
+            "--bus", busAddress,
+            "--access-points", QString::number(accessPoints),
+            "--connections", QString::number(std::min(connections, accessPoints))
+        });
+
+        if (!readLine(mock, timeout).startsWith("ready"))
+        {
+            qCritical() << "The mock NetworkManager did not start:" << mockProgram;
+            return false;
+        }
+
+        sample.accessPoints = accessPoints;
+        resetMockCallCount();
+        const qint64 residentBefore = residentKiB();
+
+        // First load: the page is built, fetches the objects and shows the access points of the Wi-Fi device
+        QElapsedTimer timer;
+        timer.start();
+
+        NetworkPage* page = new NetworkPage(nullptr);
+        bool loaded = waitForSignal(page->networkObjectTree, &NetworkObjectTree::refreshed, timeout);
+
+        for (int row = 0; loaded && row < page->deviceList->count(); row++)
+        {
+            if (page->getNetworkDevice(page->deviceList->item(row))->type == "Wi-Fi")
+            {
+                page->deviceList->setCurrentRow(row);
+                break;
+            }
+        }
+
+        sample.firstLoadMilliseconds = timer.nsecsElapsed() / 1e6;
+        sample.rows = page->wifiAccessPointList->count();
+
+        // The saved connections are indexed in the background, and their calls belong to the first load
+        if (loaded && !page->savedConnectionIndex->isReady())
+        {
+            loaded = waitForSignal(page->savedConnectionIndex, &SavedConnectionIndex::built, timeout);
+        }
+
+        sample.firstLoadCalls = mockCallCount();
+        sample.residentDeltaKiB = residentKiB() - residentBefore;
+
+        if (!loaded)
+        {
+            qCritical() << "The network page did not load" << accessPoints << "access points";
+            delete page;
+            mock.kill();
+            mock.waitForFinished();
+            return false;
+        }
+
+        // Refresh: what the "Atualizar" button does, until the lists are reconciled
+        resetMockCallCount();
+        sample.refreshMilliseconds.clear();
+
+        for (int i = 0; i < iterations; i++)
+        {
+            timer.start();
+            page->populateNetworkDevices();
+
+            if (!waitForSignal(page->networkObjectTree, &NetworkObjectTree::refreshed, timeout))
+            {
+                qCritical() << "Refresh" << i + 1 << "timed out";
+                loaded = false;
+                break;
+            }
+            sample.refreshMilliseconds.append(timer.nsecsElapsed() / 1e6);
+        }
+
+        sample.callsPerRefresh = static_cast<double>(mockCallCount()) / std::max(1, iterations);
+
+        delete page;
+        mock.terminate();
+        mock.waitForFinished();
+
+        return loaded;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    // The page is never shown
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("delphinos-network-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark of the network page of delphinos-installer against a mock NetworkManager");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "access-points", "Comma-separated access point counts to measure.", "counts", "1,100,1000" },
+        { "iterations", "Number of refreshes measured for every count.", "n", "10" },
+        { "connections", "Number of saved connections.", "n", "10" },
+        { "timeout", "Milliseconds to wait for any step.", "ms", "30000" },
+        { "mock", "Path of delphinos-mock-networkmanager.", "path", QApplication::applicationDirPath() + "/delphinos-mock-networkmanager" },
+    });
+    parser.process(app);
+
+    const int timeout = parser.value("timeout").toInt();
+
+    // A private bus, so the benchmark never touches the NetworkManager of the system
+    QProcess busDaemon;
+    busDaemon.start("dbus-daemon", { "--session", "--nofork", "--print-address" });
+    QString busAddress = readLine(busDaemon, timeout);
+
+    if (busAddress.isEmpty())
+    {
+        qCritical() << "Could not start a private dbus-daemon";
+        return 1;
+    }
+
+    // networkBus() connects to the private bus from now on
+    qputenv("DELPHINOS_NETWORK_BUS", busAddress.toLocal8Bit());
+
+    NetworkBenchmark benchmark(parser.value("mock"), busAddress, std::max(1, parser.value("iterations").toInt()),
+        parser.value("connections").toInt(), timeout);
+
+    QList<NetworkSample> samples;
+    int exitCode = 0;
+
+    for (const QString& count : parser.value("access-points").split(',', Qt::SkipEmptyParts))
+    {
+        NetworkSample sample;
+        if (!benchmark.run(count.toInt(), sample))
+        {
+            exitCode = 1;
+            break;
+        }
+        samples.append(sample);
+    }
+
+    busDaemon.terminate();
+    busDaemon.waitForFinished();
+
+    QTextStream out(stdout);
+    out << "Refreshes per count: " << std::max(1, parser.value("iterations").toInt()) << ", saved connections: " << parser.value("connections") << "\n";
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n").arg("aps", 6).arg("rows", 6).arg("load ms", 10).arg("load calls", 11)
+        .arg("p50 ms", 10).arg("p90 ms", 10).arg("max ms", 10).arg("calls", 7).arg("rss KiB", 10);
+
+    for (NetworkSample& sample : samples)
+    {
+        std::sort(sample.refreshMilliseconds.begin(), sample.refreshMilliseconds.end());
+
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n").arg(sample.accessPoints, 6).arg(sample.rows, 6)
+            .arg(sample.firstLoadMilliseconds, 10, 'f', 2).arg(sample.firstLoadCalls, 11)
+            .arg(percentile(sample.refreshMilliseconds, 50), 10, 'f', 2).arg(percentile(sample.refreshMilliseconds, 90), 10, 'f', 2)
+            .arg(sample.refreshMilliseconds.isEmpty() ? 0. : sample.refreshMilliseconds.last(), 10, 'f', 2)
+            .arg(sample.callsPerRefresh, 7, 'f', 1).arg(sample.residentDeltaKiB, 10);
+    }
+
+    return exitCode;
+}
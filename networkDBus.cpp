@@ -16,10 +16,72 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "networkDBus.hpp"
+#include <QDBusMetaType>
+#include <QDBusPendingReply>
+#include <QDBusMessage>
+
+NetworkObjectTree::NetworkObjectTree(QObject* parent) : QObject(parent)
+{
+    qDBusRegisterMetaType<DBusInterfaceProperties>();
+    qDBusRegisterMetaType<DBusManagedObjects>();
+}
+
+QDBusConnection networkBus()
+{
+    static const QString address = QString::fromLocal8Bit(qgetenv("DELPHINOS_NETWORK_BUS"));
+
+    if (address.isEmpty()) return QDBusConnection::systemBus();
+
+    // Connecting again with the same name returns the existing connection
+    return QDBusConnection::connectToBus(address, "delphinos-network");
+}
+
+void NetworkObjectTree::refresh()
+{
+    if (isRefreshing()) return;
+
+    QDBusMessage getManagedObjects = QDBusMessage::createMethodCall(NM_SERVICE, NM_OBJECT_MANAGER_PATH,
+        "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
+
+    roundTrips++;
+    pendingRefresh = new QDBusPendingCallWatcher(networkBus().asyncCall(getManagedObjects), this);
+    connect(pendingRefresh, &QDBusPendingCallWatcher::finished, this, &NetworkObjectTree::onRefreshFinished);
+}
+
+void NetworkObjectTree::onRefreshFinished(QDBusPendingCallWatcher* watcher)
+{
+    QDBusPendingReply<DBusManagedObjects> reply = *watcher;
+    watcher->deleteLater();
+    pendingRefresh = nullptr;
+
+    if (reply.isError())
+    {
+        qCritical() << "Failed to get the NetworkManager objects:" << reply.error().message();
+        emit refreshed(false);
+        return;
+    }
+
+    objects = reply.value();
+    qDebug() << "Fetched" << objects.count() << "NetworkManager objects";
+
+    emit refreshed(true);
+}
+
+QList<QDBusObjectPath> NetworkObjectTree::objectsWithInterface(const QString& interface) const
+{
+    QList<QDBusObjectPath> paths;
+
+    for (auto it = objects.constBegin(); it != objects.constEnd(); it++)
+    {
+        if (it.value().contains(interface)) paths << it.key();
+    }
+
+    return paths;
+}
 
 void NetworkDevice::monitor()
 {
-    bool connectedDBus = QDBusConnection::systemBus().connect(
+    bool connectedDBus = networkBus().connect(
         NM_SERVICE, dbusPath.path(), "org.freedesktop.DBus.Properties", "PropertiesChanged", this, SLOT(onPropertiesChanged(QString, QVariantMap, QStringList))
     );
 
@@ -33,7 +95,7 @@ void NetworkDevice::monitor()
 
 void NetworkDevice::stopMonitoring()
 {
-    bool disconnectedDBus = QDBusConnection::systemBus().disconnect(
+    bool disconnectedDBus = networkBus().disconnect(
         NM_SERVICE, dbusPath.path(), "org.freedesktop.DBus.Properties",
         "PropertiesChanged", this, SLOT(onPropertiesChanged(QString, QVariantMap, QStringList))
     );
@@ -47,31 +109,36 @@ void NetworkDevice::stopMonitoring()
 
 
 
-void NetworkConnection::monitor()
+void NetworkConnection::monitor(const QDBusObjectPath& _activePath)
 {
-    bool connectedDBus = QDBusConnection::systemBus().connect(NM_SERVICE, dbusPath.path(), "org.freedesktop.DBus.Properties",
+    if (!activePath.path().isEmpty()) stopMonitoring();
+    activePath = _activePath;
+
+    // The state belongs to the active connection, not to the saved settings at dbusPath
+    bool connectedDBus = networkBus().connect(NM_SERVICE, activePath.path(), "org.freedesktop.DBus.Properties",
         "PropertiesChanged", this, SLOT(onPropertiesChanged(QString, QVariantMap, QStringList))
     );
 
     if (connectedDBus)
     {
+        qDebug() << "Monitoring connection state for" << activePath.path();
+    } else {
+        qCritical() << "Failed to connect to D-Bus signal for connection" << activePath.path();
     }
-
-    qDebug() << "Monitoring connection state continuously...";
 }
 
 
 void NetworkConnection::stopMonitoring()
 {
-    bool disconnectedDBus = QDBusConnection::systemBus().disconnect(
-        NM_SERVICE, dbusPath.path(), "org.freedesktop.DBus.Properties",
+    bool disconnectedDBus = networkBus().disconnect(
+        NM_SERVICE, activePath.path(), "org.freedesktop.DBus.Properties",
         "PropertiesChanged", this, SLOT(onPropertiesChanged(QString, QVariantMap, QStringList))
     );
     if (disconnectedDBus) 
     {
-        qDebug() << "Stopped monitoring connection state for" << dbusPath.path();
+        qDebug() << "Stopped monitoring connection state for" << activePath.path();
     } else {
-        qCritical() << "Failed to disconnect D-Bus signal for" << dbusPath.path();
+        qCritical() << "Failed to disconnect D-Bus signal for" << activePath.path();
     }
 }
 
@@ -128,6 +195,9 @@ void NetworkDevice::onPropertiesChanged(const QString& interfaceName, const QVar
                     qDebug() << "Device state: Unknown state" << state;
                     break;
             }
+
+            // The state store reports the change to the pages
+            setState(state);
         }
         if (changedProperties.contains("ActiveConnection"))
         {
@@ -143,7 +213,7 @@ void NetworkDevice::onPropertiesChanged(const QString& interfaceName, const QVar
 
 void NetworkConnection::onPropertiesChanged(const QString& interfaceName, const QVariantMap& changedProperties, const QStringList& invalidatedProperties)
 {
-    if (interfaceName == "org.freedesktop.NetworkManager.Connection.Active")
+    if (interfaceName == "org.freedesktop.NetworkManager.Connection.Active" && changedProperties.contains("State"))
     {
         uint state = changedProperties["State"].toUInt();  // Get the connection state from the properties
 
@@ -165,5 +235,7 @@ void NetworkConnection::onPropertiesChanged(const QString& interfaceName, const
             default:
                 break;
         }
+
+        setState(state);
     }
 }
@@ -19,9 +19,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <QDBusConnection>
 #include <QDBusInterface>
 #include <QDBusReply>
+#include <QDBusPendingCallWatcher>
 #include <QDebug>
 #include <QUuid>
 #include <QMetaType>
+#include <algorithm>
 
 #pragma push_macro("signals")
 #undef signals
@@ -37,6 +39,9 @@ const QString NM_PATH = "/org/freedesktop/NetworkManager";
 const QString NM_SETTINGS = "org.freedesktop.NetworkManager.Settings";
 const QString NM_SETTINGS_PATH = "/org/freedesktop/NetworkManager/Settings";
 const QString NM_DEVICE_INTERFACE = "org.freedesktop.NetworkManager.Device";
+const QString NM_WIRELESS_INTERFACE = "org.freedesktop.NetworkManager.Device.Wireless";
+const QString NM_ACCESS_POINT_INTERFACE = "org.freedesktop.NetworkManager.AccessPoint";
+const QString NM_OBJECT_MANAGER_PATH = "/org/freedesktop";
 
 #define NM_CONSTANTS 
 #endif
@@ -46,6 +51,56 @@ using ConnectionSettings = QMap<QString, ConnectionSettingsItem>;
 using ConnectionSecretsItem = ConnectionSettingsItem;
 using ConnectionSecrets = ConnectionSettings;
 
+// Properties of a D-Bus object by interface, and every object of a service, as returned by GetManagedObjects
+using DBusInterfaceProperties = QMap<QString, QVariantMap>;
+using DBusManagedObjects = QMap<QDBusObjectPath, DBusInterfaceProperties>;
+
+// Bus where NetworkManager is reached: the system bus, or the bus at the address in DELPHINOS_NETWORK_BUS,
+// where delphinos-mock-networkmanager can stand in for NetworkManager
+QDBusConnection networkBus();
+
+// Snapshot of every NetworkManager object with its properties. The whole tree is fetched with a single
+// asynchronous GetManagedObjects call, instead of one blocking Get call per property of every object.
+class NetworkObjectTree : public QObject
+{
+Q_OBJECT
+private:
+    DBusManagedObjects objects;
+    QDBusPendingCallWatcher* pendingRefresh = nullptr;
+    int roundTrips = 0;
+
+private slots:
+    void onRefreshFinished(QDBusPendingCallWatcher* watcher);
+
+public:
+    explicit NetworkObjectTree(QObject* parent = nullptr);
+
+    // Fetch the tree again. A refresh requested while another one is pending is served by the pending one.
+    void refresh();
+
+    bool isRefreshing() const
+    {
+        return pendingRefresh != nullptr;
+    }
+
+    // Paths of the objects implementing interface, in path order
+    QList<QDBusObjectPath> objectsWithInterface(const QString& interface) const;
+
+    QVariantMap properties(const QDBusObjectPath& path, const QString& interface) const
+    {
+        return objects.value(path).value(interface);
+    }
+
+    // D-Bus calls made since the tree was created
+    int getRoundTrips() const
+    {
+        return roundTrips;
+    }
+
+signals:
+    void refreshed(bool success);
+};
+
 class WifiAccessPoint;
 
 class NetworkDevice : public QObject
@@ -59,7 +114,7 @@ public:
 
     void monitor();
     void stopMonitoring();
-    QList<WifiAccessPoint*> accessPoints;
+
     explicit NetworkDevice(const QDBusObjectPath& _dbusPath, const QString& _name, const QString& _type) : dbusPath(_dbusPath), name(_name), type(_type), state(0)
     {
         monitor();
@@ -68,24 +123,56 @@ public:
     ~NetworkDevice()
     {
         stopMonitoring();
-        qDeleteAll(accessPoints); 
+    }
+
+    void setState(uint _state)
+    {
+        if (state == _state) return;
+        state = _state;
+        emit stateChanged(state);
     }
 
 private slots:
     void onPropertiesChanged(const QString& interfaceName, const QVariantMap& changedProperties, const QStringList& invalidatedProperties);
+
+signals:
+    void stateChanged(uint state);
 };
 Q_DECLARE_METATYPE(NetworkDevice*)
 
+// Wi-Fi network, merging every access point that broadcasts the same SSID
 class WifiAccessPoint : public QObject
 {
 Q_OBJECT
 public:
-    const QDBusObjectPath dbusPath;
+    QDBusObjectPath dbusPath;           // Strongest access point of the network
     const NetworkDevice* networkDevice;
     const QString ssid;
-    bool isConnected;
+    bool isConnected = false;
+    QMap<QString, uint> strengths;      // Signal strength in percent of every access point of the network, by path
 
-    explicit WifiAccessPoint(const QDBusObjectPath& _dbusPath, const NetworkDevice* _networkDevice, QString _ssid) : dbusPath(_dbusPath), networkDevice(_networkDevice), ssid(_ssid) {};
+    explicit WifiAccessPoint(const QDBusObjectPath& _dbusPath, const NetworkDevice* _networkDevice, QString _ssid, QObject* parent = nullptr)
+        : QObject(parent), dbusPath(_dbusPath), networkDevice(_networkDevice), ssid(_ssid) {};
+
+    uint strength() const
+    {
+        uint strongest = 0;
+        for (uint accessPointStrength : strengths) strongest = std::max(strongest, accessPointStrength);
+        return strongest;
+    }
+
+    // Point dbusPath to the strongest access point, the one NetworkManager should connect to
+    void selectStrongest()
+    {
+        for (auto it = strengths.constBegin(); it != strengths.constEnd(); it++)
+        {
+            if (it.value() == strength())
+            {
+                dbusPath = QDBusObjectPath(it.key());
+                return;
+            }
+        }
+    }
 };
 Q_DECLARE_METATYPE(WifiAccessPoint*)
 
@@ -93,17 +180,34 @@ class NetworkConnection : public QObject
 {
 Q_OBJECT
 public:
-    void monitor();
+    // Follow the state of the active connection returned by ActivateConnection
+    void monitor(const QDBusObjectPath& _activePath);
     void stopMonitoring();
 
     const QDBusObjectPath dbusPath;
+    QDBusObjectPath activePath;         // Empty until the connection is activated
     const NetworkDevice* networkDevice;
     const WifiAccessPoint* accessPoint;
-    uint state;
+    uint state = 0;
     
     explicit NetworkConnection(const QDBusObjectPath& _dbusPath, const NetworkDevice* _networkDevice, const WifiAccessPoint* _accessPoint = nullptr) : dbusPath(_dbusPath), networkDevice(_networkDevice), accessPoint(_accessPoint) {};
 
+    ~NetworkConnection()
+    {
+        if (!activePath.path().isEmpty()) stopMonitoring();
+    }
+
+    void setState(uint _state)
+    {
+        if (state == _state) return;
+        state = _state;
+        emit stateChanged(state);
+    }
+
 private slots:
     void onPropertiesChanged(const QString& interfaceName, const QVariantMap& changedProperties, const QStringList& invalidatedProperties);
+
+signals:
+    void stateChanged(uint state);
 };
 Q_DECLARE_METATYPE(NetworkConnection*)
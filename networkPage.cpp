@@ -19,6 +19,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <QLineEdit>
 #include <QInputDialog>
 #include <QDBusMetaType>
+#include <QDBusArgument>
 #include <QDialog>
 #include <QMap>
 
@@ -69,6 +70,10 @@ NetworkPage::NetworkPage(QWidget* parent) : QWidget(parent)
     
     deviceList = new QListWidget;
     formLayout->addRow("Dispositivos de rede:", deviceList);
+
+    // State of the selected device, updated from the state store
+    networkStateLabel = new QLabel;
+    formLayout->addRow("Estado:", networkStateLabel);
     
     // Wi-Fi access points list
     wifiAccessPointList = new QListWidget;
@@ -84,6 +89,52 @@ NetworkPage::NetworkPage(QWidget* parent) : QWidget(parent)
     functionButtons->addWidget(refreshButton);
     functionButtons->addWidget(disconnectButton);
     functionButtons->addWidget(connectButton);
+
+    networkObjectTree = new NetworkObjectTree(this);
+
+    // Saved connections are indexed in the background, so connecting needs no ListConnections round trip
+    savedConnectionIndex = new SavedConnectionIndex(this);
+    savedConnectionIndex->build();
+
+    // The access point list applies the changes of the model row by row
+    accessPointModel = new WifiAccessPointModel(this);
+
+    connect(accessPointModel, &WifiAccessPointModel::rowInserted, this, [this](int row) {
+        WifiAccessPoint* accessPoint = accessPointModel->network(row);
+        QListWidgetItem* accessPointItem = new QListWidgetItem(getAccessPointText(accessPoint));
+        accessPointItem->setData(wifiAccessPointObjRole, QVariant::fromValue<WifiAccessPoint*>(accessPoint));
+        wifiAccessPointList->insertItem(row, accessPointItem);
+    });
+
+    connect(accessPointModel, &WifiAccessPointModel::rowRemoved, this, [this](int row) {
+        delete wifiAccessPointList->takeItem(row);
+    });
+
+    connect(accessPointModel, &WifiAccessPointModel::rowMoved, this, [this](int from, int to) {
+        bool wasCurrent = wifiAccessPointList->currentRow() == from;
+        QListWidgetItem* accessPointItem = wifiAccessPointList->takeItem(from);
+        wifiAccessPointList->insertItem(to, accessPointItem);
+        if (wasCurrent) wifiAccessPointList->setCurrentItem(accessPointItem);
+    });
+
+    connect(accessPointModel, &WifiAccessPointModel::rowChanged, this, [this](int row) {
+        wifiAccessPointList->item(row)->setText(getAccessPointText(accessPointModel->network(row)));
+    });
+    connect(networkObjectTree, &NetworkObjectTree::refreshed, this, &NetworkPage::onNetworkObjectsRefreshed);
+
+    connect(accessPointModel, &WifiAccessPointModel::scanStarted, this, [this]() {
+        refreshButton->setText("Procurando redes...");
+    });
+
+    connect(accessPointModel, &WifiAccessPointModel::scanFinished, this, [this]() {
+        refreshButton->setText("Atualizar");
+    });
+
+    // Device states arrive coalesced, at most once per frame
+    connect(NetworkStateStore::instance(), &NetworkStateStore::changed, this, [this](const QList<QDBusObjectPath>& devicePaths) {
+        NetworkDevice* networkDevice = getNetworkDevice(deviceList->currentItem());
+        if (networkDevice && devicePaths.contains(networkDevice->dbusPath)) updateNetworkState();
+    });
     
     populateNetworkDevices();
     
@@ -115,78 +166,60 @@ NetworkPage::NetworkPage(QWidget* parent) : QWidget(parent)
 
 void NetworkPage::populateNetworkDevices()
 {
-    QListWidgetItem* currentDevice = deviceList->currentItem();
-    QListWidgetItem* currentAccessPoint = wifiAccessPointList->currentItem();
-    QString currentDevicePath;
-
-    if (currentDevice)
-    {
-        currentDevicePath = getNetworkDevice(currentDevice)->dbusPath.path();
-    }
+    // The lists are reconciled once the objects of NetworkManager arrive, and the access points found by the
+    // rescan stream in afterwards, without blocking the event loop
+    networkObjectTree->refresh();
+    accessPointModel->requestScan();
+}
 
-    qDebug() << "Clearing list of network devices";
-    clearNetworkDevices(networkDevices, deviceList);
+void NetworkPage::onNetworkObjectsRefreshed(bool success)
+{
+    if (!success) return;
 
-    QDBusInterface dbusInterface("org.freedesktop.NetworkManager", "/org/freedesktop/NetworkManager", "org.freedesktop.NetworkManager", QDBusConnection::systemBus());
+    QList<QDBusObjectPath> devicePaths = networkObjectTree->objectsWithInterface(NM_DEVICE_INTERFACE);
 
-    if (!dbusInterface.isValid())
-    {   
-        qCritical() << "Failed to connect to D-Bus: " << QDBusConnection::systemBus().lastError().message();
-        return;
-    }
+    // Devices that disappeared are removed. The others keep their rows, their selection and their access points.
+    for (int row = deviceList->count() - 1; row >= 0; row--)
+    {
+        NetworkDevice* networkDevice = getNetworkDevice(deviceList->item(row));
+        if (devicePaths.contains(networkDevice->dbusPath)) continue;
 
-    QDBusReply<QList<QDBusObjectPath>> getAllDevicesReply = dbusInterface.call("GetAllDevices");
-    QList<QDBusObjectPath> dbusDevices = getAllDevicesReply.value();
+        if (accessPointModel->getDevice() == networkDevice) accessPointModel->clear();
 
-    if (!getAllDevicesReply.isValid())
-    {
-        qCritical() << "Failed to call GetAllDevices: " << QDBusConnection::systemBus().lastError().message();
-        return;
+        delete deviceList->takeItem(row);
+        networkDevices.removeOne(networkDevice);
+        delete networkDevice;
     }
-    
+
     qDebug() << "Populating network devices";
-    for (const QDBusObjectPath& devicePath : dbusDevices)
+    for (const QDBusObjectPath& devicePath : devicePaths)
     {
-        QDBusInterface deviceInterface("org.freedesktop.NetworkManager", devicePath.path(), "org.freedesktop.DBus.Properties", QDBusConnection::systemBus());
-        QDBusReply<QVariant> deviceReply = deviceInterface.call("Get", "org.freedesktop.NetworkManager.Device", "Interface");
+        QVariantMap deviceProperties = networkObjectTree->properties(devicePath, NM_DEVICE_INTERFACE);
 
-        if (!deviceReply.isValid())
+        if (NetworkDevice* knownDevice = findNetworkDevice(devicePath))
         {
-            qCritical() << "Failed to get device interface for path" << devicePath.path() << ":" << deviceReply.error().message();
+            knownDevice->setState(deviceProperties.value("State").toUInt());
             continue;
         }
 
-        NetworkDevice* newNetworkDevice;
-        QString deviceName = deviceReply.value().toString();
-        QDBusReply<QVariant> deviceTypeReply = deviceInterface.call("Get", "org.freedesktop.NetworkManager.Device", "DeviceType");
+        QString deviceName = deviceProperties.value("Interface").toString();
 
-        if (!deviceTypeReply.isValid())
+        if (deviceName.isEmpty())
         {
-            qWarning() << "Coult not determine type of device" << deviceName << ":" << deviceTypeReply.error().message();
+            qCritical() << "Failed to get device interface for path" << devicePath.path();
+            continue;
         }
 
-        int deviceType = deviceTypeReply.value().toInt();
-        newNetworkDevice = new NetworkDevice(devicePath, deviceName, networkTypeMap.value(deviceType, "Unknown"));
+        int deviceType = deviceProperties.value("DeviceType").toInt();
+        NetworkDevice* newNetworkDevice = new NetworkDevice(devicePath, deviceName, networkTypeMap.value(deviceType, "Unknown"));
+        newNetworkDevice->state = deviceProperties.value("State").toUInt();
         networkDevices.push_back(newNetworkDevice);
         deviceName += " (" + networkTypeMap.value(deviceType, "Unknown") + ")";
         QListWidgetItem* newItem = new QListWidgetItem(deviceName);
         newItem->setData(networkDeviceObjRole, QVariant::fromValue(newNetworkDevice));
         deviceList->addItem(newItem);
-    }
-
-    // Reset previously selected item
-    if (!currentDevicePath.isEmpty())
-    {
-        for (int i = 0; i < deviceList->count(); i++)
-        {
-            QListWidgetItem* item = deviceList->item(i);
 
-            if (item->data(networkDeviceObjRole).value<NetworkDevice*>()->dbusPath.path() == currentDevicePath)
-            {
-                deviceList->setCurrentItem(item);
-                break;
-            }
-        }
+        NetworkStateStore::instance()->track(newNetworkDevice);
     }
 
     updateNetworkDevice();
@@ -198,72 +231,35 @@ void NetworkPage::updateNetworkDevice()
     qDebug() << "Updating network device";
     
     NetworkDevice* networkDevice = getNetworkDevice(deviceList->currentItem());
+    bool accessPointListShown = formLayout->indexOf(wifiAccessPointList) != -1;
+
+    updateNetworkState();
 
-    for (int i = 0; i < formLayout->rowCount(); ++i)
+    if (!networkDevice || networkDevice->type != "Wi-Fi")
     {
-        QLayoutItem* item = formLayout->itemAt(i, QFormLayout::FieldRole);
-        if (item && item->widget() == wifiAccessPointList) {
-            formLayout->removeWidget(wifiAccessPointList);
-            formLayout->removeRow(i);
-            wifiAccessPointList->clear();
-            wifiAccessPointList->hide();
-            break;
-        }
-    }
+        accessPointModel->clear();
 
-    if (!networkDevice) {
-        return; 
+        for (int i = 0; accessPointListShown && i < formLayout->rowCount(); ++i)
+        {
+            QLayoutItem* item = formLayout->itemAt(i, QFormLayout::FieldRole);
+            if (item && item->widget() == wifiAccessPointList) {
+                formLayout->removeWidget(wifiAccessPointList);
+                formLayout->removeRow(i);
+                wifiAccessPointList->hide();
+                break;
+            }
+        }
+        return;
     }
 
-    // If the selected device is Wi-Fi, generate access points
-    if (networkDevice->type == "Wi-Fi")
+    if (!accessPointListShown)
     {
-        qDebug() << "Creating new Wi-Fi interface for" << networkDevice->dbusPath.path();
-        QDBusInterface wifiInterface("org.freedesktop.NetworkManager", networkDevice->dbusPath.path(), "org.freedesktop.NetworkManager.Device.Wireless", QDBusConnection::systemBus());
-
         formLayout->addRow("Pontos de acesso:", wifiAccessPointList);
         wifiAccessPointList->show();
-
-        if (!wifiInterface.isValid())
-        {
-            qWarning() << "Failed to get Wi-Fi device interface for" << networkDevice->dbusPath.path() << ":" << wifiInterface.lastError().message();
-            return;
-        }
-
-        QDBusReply<QList<QDBusObjectPath>> wifiAccessPointsReply = wifiInterface.call("GetAllAccessPoints");
-        if (!wifiAccessPointsReply.isValid())
-        {
-            qWarning() << "Failed to call Wi-Fi device method GetAllAccessPoints:" << wifiAccessPointsReply.error().message();
-            return;
-        }
-
-        for (const QDBusObjectPath& accessPointIterator : wifiAccessPointsReply.value())
-        {
-            const QDBusObjectPath& accessPointPath = accessPointIterator;
-            QDBusInterface accessPointInterface("org.freedesktop.NetworkManager", accessPointIterator.path(), "org.freedesktop.DBus.Properties", QDBusConnection::systemBus());
-            if (!accessPointInterface.isValid())
-            {
-                qWarning() << "Failed to get access point interface for path" << accessPointIterator.path() << ":" << accessPointInterface.lastError().message();
-                continue;
-            }
-
-            QDBusReply<QVariant> accessPointSsidReply = accessPointInterface.call("Get", "org.freedesktop.NetworkManager.AccessPoint", "Ssid");
-            if (!accessPointSsidReply.isValid())
-            {
-                qWarning() << "Failed to get access point SSID for path" << accessPointIterator.path() << ":" << accessPointSsidReply.error().message();
-                continue;
-            }
-
-            WifiAccessPoint* newAccessPoint = new WifiAccessPoint(accessPointPath, networkDevice, accessPointSsidReply.value().toString());
-            networkDevice->accessPoints.push_back(newAccessPoint);
-
-            qDebug() << "Access point SSID:" << newAccessPoint->ssid;
-
-            QListWidgetItem* newAccessPointItem = new QListWidgetItem(newAccessPoint->ssid);
-            newAccessPointItem->setData(wifiAccessPointObjRole, QVariant::fromValue<WifiAccessPoint*>(newAccessPoint));
-            wifiAccessPointList->addItem(newAccessPointItem);
-        }
     }
+
+    // Selecting the device again only reconciles the model with the fetched objects
+    accessPointModel->setDevice(networkDevice, networkObjectTree);
 }
 
 
@@ -273,19 +269,31 @@ void NetworkPage::connectNetwork()
     qDBusRegisterMetaType<ConnectionSettings>();
     qDBusRegisterMetaType<ConnectionSettingsItem>();
 
-    QDBusInterface nmInterface(NM_SERVICE, NM_PATH, NM_SERVICE, QDBusConnection::systemBus());
+    QDBusInterface nmInterface(NM_SERVICE, NM_PATH, NM_SERVICE, networkBus());
     if (!nmInterface.isValid())
     {
         qCritical() << "Failed to connect to NetworkManager D-Bus service:" << nmInterface.lastError().message();
         return;
     }
-    QDBusInterface nmSettingsInterface(NM_SERVICE, NM_SETTINGS_PATH, NM_SETTINGS, QDBusConnection::systemBus());
+    QDBusInterface nmSettingsInterface(NM_SERVICE, NM_SETTINGS_PATH, NM_SETTINGS, networkBus());
     if (!nmSettingsInterface.isValid())
     {
         qCritical() << "Failed to connect to NetworkManager settings D-Bus service:" << nmSettingsInterface.lastError().message();
         return;
     }
 
+    // A connect requested before the saved connections are indexed is retried once the index is built
+    if (!savedConnectionIndex->isReady())
+    {
+        qDebug() << "Waiting for the saved connections to be indexed";
+        connectButton->setEnabled(false);
+        connect(savedConnectionIndex, &SavedConnectionIndex::built, this, [this]() {
+            connectButton->setEnabled(true);
+            connectNetwork();
+        }, Qt::SingleShotConnection);
+        return;
+    }
+
     const NetworkDevice* networkDevice = getNetworkDevice(deviceList->currentItem());
     WifiAccessPoint* wifiAccessPoint = getAccessPoint(wifiAccessPointList->currentItem());
 
@@ -297,60 +305,24 @@ void NetworkPage::connectNetwork()
         {
             ConnectionSettings nmSettings;
 
-            // Check for existing connections for this network
-            QDBusReply<QList<QDBusObjectPath>> listConnectionsReply = nmSettingsInterface.call("ListConnections");
+            // Look up the saved connection for this network in the index, instead of asking NetworkManager for every profile
+            QDBusObjectPath existingConnectionPath = savedConnectionIndex->findBySsid(wifiAccessPoint->ssid.toUtf8());
             QString existingPassword;
-            if (!listConnectionsReply.isValid())
-            {
-                qWarning() << "Failed to get list connections:" << listConnectionsReply.error().message();
-            }
 
-            for (const QDBusObjectPath& tempConnectionPath : listConnectionsReply.value())
+            if (!existingConnectionPath.path().isEmpty())
             {
-                QDBusInterface connectionInterface(NM_SERVICE, tempConnectionPath.path(), "org.freedesktop.NetworkManager.Settings.Connection", QDBusConnection::systemBus());
-                if (!connectionInterface.isValid())
-                {
-                    qWarning() << "Failed to get connection interface:" << connectionInterface.lastError().message();
-                    continue;
-                }
-                
-                QDBusReply<ConnectionSettings> getSettingsReply = connectionInterface.call("GetSettings");
-                if (!getSettingsReply.isValid())
-                {
-                    qWarning() << "Failed to get connection settings for " << tempConnectionPath.path() << ":" << getSettingsReply.error().message();
-                    continue;
-                }
-
-                ConnectionSettings tempNmSettings = getSettingsReply.value();
-                if (!tempNmSettings.contains("802-11-wireless"))
-                {
-                    continue;
-                }
-
-                QByteArray tempSsid = tempNmSettings["802-11-wireless"]["ssid"].toByteArray();
-                //Check if found SSID corresponds to the selected Access Point
-                if (tempSsid != QByteArray(wifiAccessPoint->ssid.toUtf8()))
-                {
-                    continue;
-                }
-
                 qDebug() << "Found existing connection for SSID:" << wifiAccessPoint->ssid;
-                networkConnection = new NetworkConnection(tempConnectionPath, networkDevice, wifiAccessPoint);
-                nmSettings = tempNmSettings;
-                if (!nmSettings.contains("802-11-wireless-security"))
-                {
-                    continue;
-                }
+                networkConnection = new NetworkConnection(existingConnectionPath, networkDevice, wifiAccessPoint);
+                nmSettings = savedConnectionIndex->settings(existingConnectionPath);
 
-                existingPassword = nmSettings["802-11-wireless-security"]["psk"].toString();
-
-                // If GetSettings retrieve no password, try GetSecrets
-                if (existingPassword.isEmpty())
+                // GetSettings never returns secrets, so the password of a secured network needs one GetSecrets call
+                if (nmSettings.contains("802-11-wireless-security"))
                 {
+                    QDBusInterface connectionInterface(NM_SERVICE, existingConnectionPath.path(), "org.freedesktop.NetworkManager.Settings.Connection", networkBus());
                     QDBusReply<ConnectionSecrets> getSecretsReply = connectionInterface.call("GetSecrets", "802-11-wireless-security");
                     if (!getSecretsReply.isValid())
                     {
-                        qWarning() << "Failed to get connection secrets:" << getSettingsReply.error().message();
+                        qWarning() << "Failed to get connection secrets:" << getSecretsReply.error().message();
                     }
 
                     ConnectionSecrets nmSecrets = getSecretsReply.value();
@@ -362,7 +334,6 @@ void NetworkPage::connectNetwork()
                         if (!nmSettings.contains(key))
                         {
                             nmSettings[key] = nmSecrets[key];
-                            qDebug() << "Added secret key to settings:" << nmSettings[key];
                             continue;
                         }
 
@@ -370,13 +341,10 @@ void NetworkPage::connectNetwork()
                         for (const QString& subkey : nmSecrets[key].keys())
                         {
                             nmSettings[key][subkey] = nmSecrets[key][subkey];
-                            qDebug() << "Changed settings key from secret key:" << nmSettings[key];
                         }
                     }
                     nmSettings["802-11-wireless-security"]["psk-flags"] = 0;
                 }
-
-                qDebug() << "Existing password:" << existingPassword;
             }
 
             // If there is no existing connection for this access point, add a new one
@@ -411,12 +379,6 @@ void NetworkPage::connectNetwork()
                     { "method", "auto"}
                 };
 
-                qDebug() << "Using connection settings:";
-                for (const QString& key : settings.keys())
-                {
-                    qDebug() << settings[key];
-                }            
-
                 QDBusReply<QDBusObjectPath> addConnectionReply = nmSettingsInterface.call("AddConnection", QVariant::fromValue(settings));
 
                 if (addConnectionReply.isValid())
@@ -453,6 +415,10 @@ void NetworkPage::connectNetwork()
             {
                 qDebug() << "Successfully initiated Wi-Fi connection";
 
+                // Whether the activation succeeds is reported by the state store
+                networkConnection->monitor(activateConnectionReply.value());
+                NetworkStateStore::instance()->track(networkConnection);
+                networkConnections.push_back(networkConnection);
             } else {
                 qCritical() << "Could not activate connection:" << activateConnectionReply.error().message();
             }
@@ -462,13 +428,6 @@ void NetworkPage::connectNetwork()
     // If the selected network device is ethernet
     } else if (networkDevice->type == "Ethernet") {
 
-        // List all connections
-        QDBusReply<QList<QDBusObjectPath>> listConnectionsReply = nmSettingsInterface.call("ListConnections");
-        if (!listConnectionsReply.isValid()) {
-            qWarning() << "Failed to get list connections:" << listConnectionsReply.error().message();
-            return;
-        }
-
         ConnectionSettings nmSettings;
         nmSettings["connection"] = ConnectionSettingsItem{
             { "type", "802-3-ethernet" },
@@ -502,12 +461,27 @@ void NetworkPage::connectNetwork()
         if (activateConnectionReply.isValid())
         {
             qDebug() << "Successfully initiated Ethernet connection";
+            newNetworkConnection->monitor(activateConnectionReply.value());
+            NetworkStateStore::instance()->track(newNetworkConnection);
         } else {
             qCritical() << "Could not activate Ethernet connection" << activateConnectionReply.error().message();
         }
     }
 }
 
+void NetworkPage::updateNetworkState()
+{
+    NetworkDevice* networkDevice = getNetworkDevice(deviceList->currentItem());
+
+    if (!networkDevice)
+    {
+        networkStateLabel->clear();
+        return;
+    }
+
+    networkStateLabel->setText(NetworkStateStore::deviceStateName(NetworkStateStore::instance()->deviceState(networkDevice->dbusPath)));
+}
+
 QString NetworkPage::requestAccessPointPassword(const QString& wifiAccessPoint)
 {
     bool wifiAccessPointPasswordSent;
@@ -532,14 +506,7 @@ QString NetworkPage::requestAccessPointPassword(const QString& wifiAccessPoint)
 
 void NetworkPage::updateConnectionSettings(QDBusObjectPath connectionPath, ConnectionSettings nmSettings)
 {
-    qDebug() << "Using connection settings:";
-    for (const QString& key : nmSettings.keys())
-    {
-        qDebug() << nmSettings[key];
-    }
-
-
-    QDBusInterface connectionInterface(NM_SERVICE, connectionPath.path(), "org.freedesktop.NetworkManager.Settings.Connection", QDBusConnection::systemBus());
+    QDBusInterface connectionInterface(NM_SERVICE, connectionPath.path(), "org.freedesktop.NetworkManager.Settings.Connection", networkBus());
     QDBusReply<void> updateSettingsReply = connectionInterface.call("Update", QVariant::fromValue(nmSettings));
     if (updateSettingsReply.isValid())
     {
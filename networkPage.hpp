@@ -16,21 +16,29 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "mainWindow.hpp"
+#include "wifiAccessPointModel.hpp"
+#include "savedConnectionIndex.hpp"
+#include "networkStateStore.hpp"
 #include <QMap>
 
 
 class NetworkPage : QWidget
 {
 Q_OBJECT
+// Drives the page against the mock NetworkManager
+friend class NetworkBenchmark;
+
 private:
     // Network
     PageContent* page;
 
     QFormLayout* formLayout;
     QListWidget* deviceList;
+    QLabel* networkStateLabel;
 
-    // Wi-Fi access points list
+    // Wi-Fi access points list, mirroring accessPointModel row by row
     QListWidget* wifiAccessPointList;
+    WifiAccessPointModel* accessPointModel;
 
     // Network function buttons
     QHBoxLayout* functionButtons;
@@ -38,6 +46,12 @@ private:
     QPushButton* disconnectButton;
     QPushButton* connectButton;
 
+    // NetworkManager objects, fetched asynchronously on every refresh
+    NetworkObjectTree* networkObjectTree;
+
+    // Saved connection profiles by SSID and UUID, kept current from NetworkManager signals
+    SavedConnectionIndex* savedConnectionIndex;
+
     void populateNetworkDevices();
     void updateNetworkSettings(QDBusObjectPath connectionPath, QMap<QString, QMap<QString, QVariant>> nmSettings);
     QString requestAccessPointPassword(const QString& wifiAccessPoint);
@@ -78,16 +92,25 @@ private:
         }
     }
 
-    void clearNetworkDevices(QList<NetworkDevice*>& list, QListWidget* networkDeviceList)
+    QString getAccessPointText(const WifiAccessPoint* accessPoint)
     {
-        qDeleteAll(list);
-        list.clear();
+        return QString("%1 (%2%)").arg(accessPoint->ssid).arg(accessPoint->strength());
+    }
 
-        networkDeviceList->clear();
+    // Find a listed device by its D-Bus path. May return nullptr.
+    NetworkDevice* findNetworkDevice(const QDBusObjectPath& devicePath)
+    {
+        for (NetworkDevice* networkDevice : networkDevices)
+        {
+            if (networkDevice->dbusPath == devicePath) return networkDevice;
+        }
+        return nullptr;
     }
 
 private slots:
+    void onNetworkObjectsRefreshed(bool success);
     void updateNetworkDevice();
+    void updateNetworkState();
     void updateConnectionSettings(QDBusObjectPath connectionPath, ConnectionSettings nmSettings);
     void connectNetwork();
 
@@ -0,0 +1,143 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "networkStateStore.hpp"
+#include <QCoreApplication>
+#include <algorithm>
+
+NetworkStateStore::NetworkStateStore(QObject* parent) : QObject(parent)
+{
+    coalesceTimer.setSingleShot(true);
+    coalesceTimer.setInterval(frameInterval);
+    connect(&coalesceTimer, &QTimer::timeout, this, &NetworkStateStore::flush);
+}
+
+NetworkStateStore* NetworkStateStore::instance()
+{
+    static NetworkStateStore* store = new NetworkStateStore(QCoreApplication::instance());
+    return store;
+}
+
+void NetworkStateStore::track(NetworkDevice* device)
+{
+    const QString path = device->dbusPath.path();
+
+    setDeviceState(path, device->state);
+    connect(device, &NetworkDevice::stateChanged, this, [this, path](uint state) {
+        setDeviceState(path, state);
+    });
+
+    connect(device, &QObject::destroyed, this, [this, path]() {
+        deviceStates.remove(path);
+        changedDevices.insert(path);
+        if (!coalesceTimer.isActive()) coalesceTimer.start();
+    });
+}
+
+void NetworkStateStore::track(NetworkConnection* connection)
+{
+    const QString path = connection->dbusPath.path();
+
+    setConnectionState(path, connection->state);
+    connect(connection, &NetworkConnection::stateChanged, this, [this, path](uint state) {
+        setConnectionState(path, state);
+    });
+
+    connect(connection, &QObject::destroyed, this, [this, path]() {
+        connectionStates.remove(path);
+        changedConnections.insert(path);
+        if (!coalesceTimer.isActive()) coalesceTimer.start();
+    });
+}
+
+void NetworkStateStore::setDeviceState(const QString& path, uint state)
+{
+    if (deviceStates.contains(path) && deviceStates.value(path) == state) return;
+
+    deviceStates.insert(path, state);
+    changedDevices.insert(path);
+
+    // A burst of changes is reported when the first frame ends, instead of once per change
+    if (!coalesceTimer.isActive()) coalesceTimer.start();
+}
+
+void NetworkStateStore::setConnectionState(const QString& path, uint state)
+{
+    if (connectionStates.contains(path) && connectionStates.value(path) == state) return;
+
+    connectionStates.insert(path, state);
+    changedConnections.insert(path);
+
+    if (!coalesceTimer.isActive()) coalesceTimer.start();
+}
+
+void NetworkStateStore::flush()
+{
+    QList<QDBusObjectPath> devicePaths;
+    for (const QString& path : std::as_const(changedDevices)) devicePaths << QDBusObjectPath(path);
+
+    QList<QDBusObjectPath> connectionPaths;
+    for (const QString& path : std::as_const(changedConnections)) connectionPaths << QDBusObjectPath(path);
+
+    changedDevices.clear();
+    changedConnections.clear();
+
+    emit changed(devicePaths, connectionPaths);
+
+    bool isAnyDeviceActivated = std::any_of(deviceStates.constBegin(), deviceStates.constEnd(),
+        [](uint state) { return state == NM_DEVICE_STATE_ACTIVATED; });
+
+    if (isAnyDeviceActivated != connected)
+    {
+        connected = isAnyDeviceActivated;
+        qDebug() << (connected ? "Network connected" : "Network disconnected");
+        emit connectedChanged(connected);
+    }
+}
+
+void NetworkStateStore::whenConnected(QObject* context, const std::function<void()>& function)
+{
+    if (connected)
+    {
+        function();
+        return;
+    }
+
+    connect(this, &NetworkStateStore::connectedChanged, context, [function](bool isConnected) {
+        if (isConnected) function();
+    }, Qt::SingleShotConnection);
+}
+
+QString NetworkStateStore::deviceStateName(uint state)
+{
+    switch (state)
+    {
+        case 10:  return "Não gerenciado";
+        case 20:  return "Indisponível";
+        case 30:  return "Desconectado";
+        case 40:  return "Preparando";
+        case 50:  return "Configurando";
+        case 60:  return "Aguardando autenticação";
+        case 70:  return "Obtendo endereço IP";
+        case 80:  return "Verificando conexão";
+        case 90:  return "Aguardando conexões secundárias";
+        case 100: return "Conectado";
+        case 110: return "Desconectando";
+        case 120: return "Falha na conexão";
+        default:  return "Desconhecido";
+    }
+}
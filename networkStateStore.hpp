@@ -0,0 +1,92 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "networkDBus.hpp"
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <functional>
+
+#ifndef NETWORKSTATESTORE_H
+#define NETWORKSTATESTORE_H
+
+// NMDeviceState and NMActiveConnectionState values the store reasons about
+const uint NM_DEVICE_STATE_ACTIVATED = 100;
+const uint NM_ACTIVE_CONNECTION_STATE_ACTIVATED = 2;
+
+// State of the network devices and of the connections being activated, fed by the stateChanged signals of
+// NetworkDevice and NetworkConnection. Bursts of changes are coalesced into at most one changed() per frame, so
+// the pages follow activation without refreshing, and the installation can wait for a connection without polling.
+class NetworkStateStore : public QObject
+{
+Q_OBJECT
+private:
+    QHash<QString, uint> deviceStates;      // NMDeviceState by device path
+    QHash<QString, uint> connectionStates;  // NMActiveConnectionState by settings connection path
+
+    QSet<QString> changedDevices;
+    QSet<QString> changedConnections;
+    QTimer coalesceTimer;
+
+    bool connected = false;
+
+    explicit NetworkStateStore(QObject* parent = nullptr);
+
+    void setDeviceState(const QString& path, uint state);
+    void setConnectionState(const QString& path, uint state);
+    void flush();
+
+public:
+    // Changes arriving within this many milliseconds are reported together
+    static constexpr int frameInterval = 16;
+
+    // The store shared by every page
+    static NetworkStateStore* instance();
+
+    // Follow the state of a device or connection until it is destroyed
+    void track(NetworkDevice* device);
+    void track(NetworkConnection* connection);
+
+    uint deviceState(const QDBusObjectPath& devicePath) const
+    {
+        return deviceStates.value(devicePath.path());
+    }
+
+    uint connectionState(const QDBusObjectPath& connectionPath) const
+    {
+        return connectionStates.value(connectionPath.path());
+    }
+
+    // Whether any device is activated
+    bool isConnected() const
+    {
+        return connected;
+    }
+
+    // Call function once a device is activated, right away if one already is. Nothing is called if context is destroyed first.
+    void whenConnected(QObject* context, const std::function<void()>& function);
+
+    // Name of a device state to show to the user
+    static QString deviceStateName(uint state);
+
+signals:
+    void changed(const QList<QDBusObjectPath>& devicePaths, const QList<QDBusObjectPath>& connectionPaths);
+    void connectedChanged(bool connected);
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "osProber.hpp"
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+
+void OsProber::start()
+{
+    if (isRunning())
+    {
+        restartRequested = true;
+        return;
+    }
+
+    restartRequested = false;
+    entries.clear();
+    linuxBootEntries.clear();
+    pendingLinuxPartitions.clear();
+
+    runProber("os-prober", {});
+}
+
+void OsProber::runProber(const QString& program, const QStringList& arguments)
+{
+    // Diagnostics go to stderr, only the results are printed on stdout
+    proberProcess = new QProcess(this);
+
+    connect(proberProcess, &QProcess::finished, this, [this, program, arguments](int exitCode, QProcess::ExitStatus exitStatus) {
+        QByteArray output = proberProcess->readAllStandardOutput();
+        proberProcess->deleteLater();
+        proberProcess = nullptr;
+        onProberFinished(program, arguments, output, exitStatus == QProcess::NormalExit && exitCode == 0);
+    });
+
+    connect(proberProcess, &QProcess::errorOccurred, this, [this, program, arguments](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+
+        qWarning() << "Failed to start" << program;
+        proberProcess->deleteLater();
+        proberProcess = nullptr;
+        onProberFinished(program, arguments, QByteArray(), false);
+    });
+
+    proberProcess->start(program, arguments);
+}
+
+void OsProber::onProberFinished(const QString& program, const QStringList& arguments, const QByteArray& output, bool success)
+{
+    // The results of a probe that was superseded are dropped
+    if (restartRequested)
+    {
+        start();
+        return;
+    }
+
+    if (program == "os-prober")
+    {
+        if (!success)
+        {
+            // os-prober also fails when it finds nothing, so only a missing program is an error
+            qDebug() << "os-prober found no other operating systems";
+        }
+
+        entries = QString::fromLocal8Bit(output).split('\n', Qt::SkipEmptyParts);
+
+        for (const QString& entry : entries)
+        {
+            QStringList fields = entry.split(':');
+            if (fields.count() >= 4 && fields.at(3) == "linux") pendingLinuxPartitions << fields.at(0);
+        }
+    } else if (success) {
+        linuxBootEntries.insert(arguments.first(), output);
+    }
+
+    probeNextLinuxPartition();
+}
+
+void OsProber::probeNextLinuxPartition()
+{
+    if (!pendingLinuxPartitions.isEmpty())
+    {
+        runProber("linux-boot-prober", { pendingLinuxPartitions.takeFirst() });
+        return;
+    }
+
+    qDebug() << "Detected operating systems:" << entries;
+    emit finished(writeCache());
+}
+
+bool OsProber::writeCache()
+{
+    // The cache is written next to the previous one and swapped in, so the installation never copies a partial cache
+    const QString temporaryDirectory = cacheDirectory() + ".new";
+    QDir(temporaryDirectory).removeRecursively();
+
+    if (!QDir().mkpath(temporaryDirectory + "/linux-boot-prober"))
+    {
+        qWarning() << "OsProber: Could not create" << temporaryDirectory;
+        return false;
+    }
+
+    QFile entriesFile(temporaryDirectory + "/os-prober");
+    if (!entriesFile.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "OsProber: Could not write" << entriesFile.fileName();
+        return false;
+    }
+    entriesFile.write(entries.isEmpty() ? QByteArray() : entries.join('\n').toLocal8Bit() + '\n');
+    entriesFile.close();
+
+    // Partitions are named with their slashes replaced, e.g. _dev_sda2
+    for (auto it = linuxBootEntries.constBegin(); it != linuxBootEntries.constEnd(); it++)
+    {
+        QFile bootEntriesFile(temporaryDirectory + "/linux-boot-prober/" + QString(it.key()).replace('/', '_'));
+        if (!bootEntriesFile.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "OsProber: Could not write" << bootEntriesFile.fileName();
+            return false;
+        }
+        bootEntriesFile.write(it.value());
+    }
+
+    QDir(cacheDirectory()).removeRecursively();
+    if (!QDir().rename(temporaryDirectory, cacheDirectory()))
+    {
+        qWarning() << "OsProber: Could not move the cache to" << cacheDirectory();
+        return false;
+    }
+
+    return true;
+}
+
+QStringList OsProber::detectedSystems() const
+{
+    QStringList systems;
+
+    for (const QString& entry : entries)
+    {
+        // device:long name:short name:type
+        QStringList fields = entry.split(':');
+        if (fields.count() < 2) continue;
+
+        QString device = fields.at(0).section('@', 0, 0); // EFI entries are device@path
+        systems << fields.at(1) + " (" + device + ")";
+    }
+
+    return systems;
+}
@@ -0,0 +1,71 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QObject>
+#include <QProcess>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+
+#ifndef OSPROBER_H
+#define OSPROBER_H
+
+// Detects the other operating systems on the devices with os-prober in the background, and caches the results
+// so the bootloader configuration of the installed system does not probe every partition again. Linux systems
+// are also probed with linux-boot-prober, which grub-mkconfig would otherwise run for each of them.
+class OsProber : public QObject
+{
+Q_OBJECT
+private:
+    QProcess* proberProcess = nullptr;
+    bool restartRequested = false;
+
+    QStringList entries;                        // Lines printed by os-prober, e.g. /dev/sda1:Windows Boot Manager:Windows:efi
+    QMap<QString, QByteArray> linuxBootEntries; // Output of linux-boot-prober by partition
+    QStringList pendingLinuxPartitions;
+
+    void runProber(const QString& program, const QStringList& arguments);
+    void onProberFinished(const QString& program, const QStringList& arguments, const QByteArray& output, bool success);
+    void probeNextLinuxPartition();
+    bool writeCache();
+
+public:
+    explicit OsProber(QObject* parent = nullptr) : QObject(parent) {};
+
+    // Where the results are cached, copied into the new root by the installation script
+    static QString cacheDirectory()
+    {
+        return "/tmp/delphinos-installer/os-prober";
+    }
+
+    // Probe all devices. A probe started while another one runs restarts once the running one finishes,
+    // so the cache always reflects the last scan.
+    void start();
+
+    bool isRunning() const
+    {
+        return proberProcess != nullptr;
+    }
+
+    // Human-readable names of the detected systems with their partitions
+    QStringList detectedSystems() const;
+
+signals:
+    void finished(bool success);
+};
+
+#endif
@@ -0,0 +1,585 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "packageDownloader.hpp"
+#include "mirrorRanker.hpp"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QCryptographicHash>
+#include <QUrl>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+
+// Reserve the blocks of a whole file up front, so it is written contiguously and a full disk is found before the
+// download. The size of the file is kept, since it marks how much of a partial file was downloaded.
+static void preallocate(QFile& file, qint64 size)
+{
+    if (size <= file.size()) return;
+
+    if (fallocate(file.handle(), FALLOC_FL_KEEP_SIZE, 0, size) != 0 && errno != EOPNOTSUPP)
+    {
+        qDebug() << "Could not preallocate" << size << "bytes for" << file.fileName() << ":" << strerror(errno);
+    }
+}
+
+PackageDownloader::PackageDownloader(QObject* parent) : QObject(parent)
+{
+    networkAccessManager = new QNetworkAccessManager(this);
+    health = QSharedPointer<MirrorHealth>::create();
+    health->load();
+
+    watchdogTimer.setInterval(watchdogInterval);
+    connect(&watchdogTimer, &QTimer::timeout, this, &PackageDownloader::checkHealth);
+}
+
+PackageDownloader::~PackageDownloader()
+{
+    for (Download* download : active)
+    {
+        stopRequest(download);
+        closeOutput(download);
+    }
+    qDeleteAll(active);
+    qDeleteAll(queued);
+}
+
+void PackageDownloader::start(const QList<PackageFile>& files)
+{
+    if (running) return;
+
+    qDeleteAll(queued);
+    queued.clear();
+    totalBytes = 0;
+    completedBytes = 0;
+    failedFiles = 0;
+    failovers = 0;
+    networkBytes = 0;
+
+    concurrencyStep = 1;
+    bestConcurrency = 0;
+    bestBytesPerSecond = 0.;
+    previousBytesPerSecond = 0.;
+    baselineLatency = -1.;
+    intervalBytes = 0;
+    intervalLatencies.clear();
+    intervalSaturated = true;
+
+    QDir().mkpath(destination);
+
+    for (const PackageFile& file : files)
+    {
+        totalBytes += file.size;
+
+        // Files already in the cache are checked by pacman when they are installed
+        QFileInfo cached(destination + "/" + file.fileName);
+        if (cached.exists() && cached.size() == file.size)
+        {
+            completedBytes += file.size;
+            continue;
+        }
+
+        Download* download = new Download;
+        download->file = file;
+        queued << download;
+    }
+
+    qDebug() << "Downloading" << queued.count() << "of" << files.count() << "package files," << totalBytes - completedBytes << "bytes";
+
+    running = true;
+    tickTimer.start();
+    adjustTimer.start();
+    watchdogTimer.start();
+
+    if (!queued.isEmpty()) connectToMirrors();
+    startNextDownloads();
+}
+
+void PackageDownloader::cancel()
+{
+    if (!running) return;
+    running = false;
+    watchdogTimer.stop();
+
+    for (Download* download : active)
+    {
+        stopRequest(download);
+        closeOutput(download);
+    }
+    qDeleteAll(active);
+    active.clear();
+    qDeleteAll(queued);
+    queued.clear();
+
+    health->save();
+    emit finished(false);
+}
+
+qint64 PackageDownloader::bytesReceived() const
+{
+    qint64 bytes = completedBytes;
+    for (const Download* download : active)
+    {
+        if (download->output) bytes += download->output->pos();
+    }
+    return bytes;
+}
+
+QMap<QString, double> PackageDownloader::mirrorThroughput() const
+{
+    QMap<QString, double> throughput;
+    for (const Download* download : active) throughput[download->server] += download->bytesPerSecond;
+    return throughput;
+}
+
+void PackageDownloader::connectToMirrors()
+{
+    // The connections to the healthiest mirrors are opened while the first requests are prepared, and kept open
+    // by the access manager for the requests that follow
+    QStringList healthiest = health->byHealth(servers).mid(0, concurrency);
+    for (const QString& server : healthiest)
+    {
+        QUrl url(MirrorRanker::repositoryUrl(server, "core", ""));
+        if (url.scheme() == "https")
+        {
+            networkAccessManager->connectToHostEncrypted(url.host(), url.port(443));
+        } else {
+            networkAccessManager->connectToHost(url.host(), url.port(80));
+        }
+    }
+}
+
+int PackageDownloader::activeDownloads(const QString& server) const
+{
+    return std::count_if(active.constBegin(), active.constEnd(), [&server](const Download* download) { return download->server == server; });
+}
+
+QString PackageDownloader::chooseServer(Download* download) const
+{
+    QStringList candidates;
+    for (const QString& server : health->byHealth(servers))
+    {
+        if (!download->triedServers.contains(server)) candidates << server;
+    }
+
+    // Downloads are spread over the healthiest mirrors, so a single mirror does not bound the throughput
+    for (const QString& server : candidates)
+    {
+        if (activeDownloads(server) < connectionsPerMirror) return server;
+    }
+    return candidates.value(0);
+}
+
+void PackageDownloader::startNextDownloads()
+{
+    while (running && active.count() < concurrency && !queued.isEmpty())
+    {
+        Download* download = queued.takeFirst();
+
+        QString server = chooseServer(download);
+        if (server.isEmpty())
+        {
+            // Every mirror was tried, a new round starts from the healthiest
+            download->triedServers.clear();
+            server = chooseServer(download);
+        }
+
+        if (server.isEmpty() || download->attempts >= maximumAttempts)
+        {
+            qWarning() << "Could not download" << download->file.fileName << "after" << download->attempts << "attempts";
+            failedFiles++;
+            delete download;
+            continue;
+        }
+
+        download->server = server;
+        download->triedServers.insert(server);
+        download->attempts++;
+        active << download;
+        startDownload(download);
+    }
+
+    finishIfDone();
+}
+
+void PackageDownloader::startDownload(Download* download)
+{
+    download->output = new QFile(partialPath(download->file));
+    if (!download->output->open(QIODevice::ReadWrite))
+    {
+        qWarning() << "Could not open" << download->output->fileName() << ":" << download->output->errorString();
+        closeOutput(download);
+        active.removeOne(download);
+        failedFiles++;
+        delete download;
+        return;
+    }
+
+    // A partial file left by an earlier attempt is continued, and hashed up to where it stopped
+    download->hash = new QCryptographicHash(QCryptographicHash::Sha256);
+    if (download->file.size > 0 && download->output->size() > download->file.size) download->output->resize(0);
+    download->hash->addData(download->output);
+    qint64 offset = download->output->pos();
+    download->attemptStartBytes = offset;
+    preallocate(*download->output, download->file.size);
+
+    if (download->file.size > 0 && offset == download->file.size)
+    {
+        completeDownload(download);
+        return;
+    }
+
+    QNetworkRequest request(QUrl(MirrorRanker::repositoryUrl(download->server, download->file.repository, download->file.fileName)));
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+    request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+    if (offset > 0) request.setRawHeader("Range", QString("bytes=%1-").arg(offset).toLatin1());
+
+    download->tickBytes = 0;
+    download->bytesPerSecond = 0.;
+    download->firstByteMilliseconds = -1;
+    download->attemptTimer.start();
+    download->lastByteTimer.start();
+    download->reply = networkAccessManager->get(request);
+
+    connect(download->reply, &QNetworkReply::metaDataChanged, this, [this, download]() { onMetaDataChanged(download); });
+    connect(download->reply, &QNetworkReply::readyRead, this, [this, download]() {
+        if (!onReadyRead(download)) startNextDownloads();
+    });
+    connect(download->reply, &QNetworkReply::finished, this, [this, download]() { onFinished(download); });
+}
+
+void PackageDownloader::onMetaDataChanged(Download* download)
+{
+    int status = download->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    qint64 offset = download->output->pos();
+
+    if (status == 200 && offset > 0)
+    {
+        // The mirror ignored the range and sends the whole file
+        download->output->resize(0);
+        download->output->seek(0);
+        download->hash->reset();
+        download->attemptStartBytes = 0;
+    }
+    else if (status == 206)
+    {
+        QByteArray contentRange = download->reply->rawHeader("Content-Range");
+        qint64 start = contentRange.mid(contentRange.indexOf(' ') + 1, contentRange.indexOf('-') - contentRange.indexOf(' ') - 1).toLongLong();
+
+        if (start != offset)
+        {
+            qWarning() << download->server << "answered" << download->file.fileName << "from byte" << start << "instead of" << offset;
+            health->recordFailure(download->server);
+            download->output->resize(0);
+            requeue(download);
+            startNextDownloads();
+        }
+    }
+}
+
+bool PackageDownloader::onReadyRead(Download* download)
+{
+    // Bodies of error responses are discarded
+    int status = download->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QByteArray data = download->reply->readAll();
+    if (status < 200 || status >= 300 || data.isEmpty()) return true;
+
+    if (download->output->write(data) != data.size())
+    {
+        failLocally(download);
+        return false;
+    }
+    download->hash->addData(data);
+    download->tickBytes += data.size();
+    download->lastByteTimer.restart();
+    intervalBytes += data.size();
+    networkBytes += data.size();
+
+    if (download->firstByteMilliseconds < 0)
+    {
+        download->firstByteMilliseconds = download->attemptTimer.elapsed();
+        intervalLatencies << download->firstByteMilliseconds;
+    }
+    return true;
+}
+
+void PackageDownloader::onFinished(Download* download)
+{
+    if (!onReadyRead(download))
+    {
+        startNextDownloads();
+        return;
+    }
+
+    int status = download->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    // 416 means the partial file already holds the whole file
+    if (download->reply->error() == QNetworkReply::NoError || status == 416)
+    {
+        recordAttempt(download);
+        stopRequest(download);
+        completeDownload(download);
+    } else {
+        qDebug() << "Download of" << download->file.fileName << "from" << download->server << "failed:" << download->reply->errorString();
+        health->recordFailure(download->server);
+        requeue(download);
+    }
+
+    startNextDownloads();
+}
+
+void PackageDownloader::completeDownload(Download* download)
+{
+    // Writes are buffered, so a full disk may only show when they are flushed
+    if (!download->output->flush())
+    {
+        failLocally(download);
+        return;
+    }
+
+    qint64 size = download->output->size();
+    QByteArray digest = download->hash->result().toHex();
+
+    if (download->file.size > 0 && size != download->file.size)
+    {
+        qDebug() << download->server << "closed" << download->file.fileName << "at" << size << "of" << download->file.size << "bytes";
+        health->recordFailure(download->server);
+        requeue(download);
+        return;
+    }
+
+    if (!download->file.sha256.isEmpty() && digest != download->file.sha256)
+    {
+        qWarning() << "Checksum of" << download->file.fileName << "from" << download->server << "does not match, downloading it again";
+        health->recordFailure(download->server);
+        download->output->resize(0);
+        requeue(download);
+        return;
+    }
+
+    closeOutput(download);
+
+    QString path = destination + "/" + download->file.fileName;
+    QFile::remove(path);
+    if (!QFile::rename(partialPath(download->file), path))
+    {
+        qWarning() << "Could not move the download of" << download->file.fileName << "into" << destination;
+        failedFiles++;
+    }
+
+    health->recordSuccess(download->server);
+    completedBytes += size;
+    active.removeOne(download);
+    delete download;
+}
+
+void PackageDownloader::failLocally(Download* download)
+{
+    qWarning() << "Could not write" << download->output->fileName() << ":" << download->output->errorString();
+
+    // The mirror is not to blame, and downloading the file again would fail the same way
+    stopRequest(download);
+    closeOutput(download);
+    active.removeOne(download);
+    failedFiles++;
+    delete download;
+}
+
+void PackageDownloader::recordAttempt(Download* download)
+{
+    if (!download->output) return;
+    health->recordTransfer(download->server, download->output->pos() - download->attemptStartBytes, download->attemptTimer.nsecsElapsed() / 1e9);
+}
+
+void PackageDownloader::stopRequest(Download* download)
+{
+    if (!download->reply) return;
+
+    disconnect(download->reply, nullptr, this, nullptr);
+    download->reply->abort();
+    download->reply->deleteLater();
+    download->reply = nullptr;
+}
+
+void PackageDownloader::closeOutput(Download* download)
+{
+    delete download->output;
+    download->output = nullptr;
+    delete download->hash;
+    download->hash = nullptr;
+}
+
+void PackageDownloader::requeue(Download* download)
+{
+    stopRequest(download);
+    closeOutput(download);
+    active.removeOne(download);
+    queued.prepend(download);
+}
+
+void PackageDownloader::moveDownload(Download* download, bool stalled)
+{
+    qDebug() << "Moving" << download->file.fileName << "away from" << download->server << (stalled ? "(stalled)" : "(too slow)");
+
+    recordAttempt(download);
+    failovers++;
+    requeue(download);
+}
+
+void PackageDownloader::checkHealth()
+{
+    double seconds = tickTimer.restart() / 1000.;
+    if (seconds <= 0) return;
+
+    for (Download* download : active)
+    {
+        double bytesPerSecond = download->tickBytes / seconds;
+        download->bytesPerSecond = download->attemptTimer.elapsed() <= watchdogInterval * 2
+            ? bytesPerSecond : 0.5 * download->bytesPerSecond + 0.5 * bytesPerSecond;
+        download->tickBytes = 0;
+    }
+
+    // Requests that stopped receiving
+    for (Download* download : QList<Download*>(active))
+    {
+        if (download->lastByteTimer.elapsed() > stallTimeout)
+        {
+            health->recordFailure(download->server);
+            moveDownload(download, true);
+        }
+    }
+
+    // Mirrors whose throughput fell below the threshold, counting the requests past their grace period
+    QMap<QString, double> mirrorBytesPerSecond;
+    for (const Download* download : active)
+    {
+        if (download->attemptTimer.elapsed() >= gracePeriod) mirrorBytesPerSecond[download->server] += download->bytesPerSecond;
+    }
+
+    for (auto it = mirrorBytesPerSecond.constBegin(); it != mirrorBytesPerSecond.constEnd(); it++)
+    {
+        double bestScore = 0.;
+        for (const QString& server : servers)
+        {
+            if (server != it.key()) bestScore = std::max(bestScore, health->score(server));
+        }
+
+        double threshold = std::max(minimumBytesPerSecond, slowFraction * bestScore);
+        if (it.value() >= threshold) continue;
+
+        bool moved = false;
+        for (Download* download : QList<Download*>(active))
+        {
+            if (download->server != it.key() || download->attemptTimer.elapsed() < gracePeriod) continue;
+
+            // Only moved while a mirror is left to try in this round
+            if (chooseServer(download).isEmpty()) continue;
+
+            moveDownload(download, false);
+            moved = true;
+        }
+
+        if (moved)
+        {
+            qDebug() << it.key() << "fell to" << it.value() / 1024. << "KiB/s, below" << threshold / 1024. << "KiB/s";
+            health->recordFailure(it.key());
+        }
+    }
+
+    startNextDownloads();
+
+    if (!running) return;
+
+    if (active.count() != concurrency) intervalSaturated = false;
+    if (adaptiveConcurrency && adjustTimer.elapsed() >= adjustInterval) adjustConcurrency();
+
+    emit progress(bytesReceived(), totalBytes);
+}
+
+void PackageDownloader::adjustConcurrency()
+{
+    double seconds = adjustTimer.restart() / 1000.;
+    double bytesPerSecond = intervalBytes / seconds;
+    bool saturated = intervalSaturated;
+
+    std::sort(intervalLatencies.begin(), intervalLatencies.end());
+    qint64 latency = intervalLatencies.isEmpty() ? -1 : intervalLatencies.at(intervalLatencies.count() / 2);
+
+    intervalBytes = 0;
+    intervalLatencies.clear();
+    intervalSaturated = true;
+
+    // Only an interval with every slot busy measures the current concurrency
+    if (!saturated) return;
+
+    if (latency >= 0 && (baselineLatency < 0 || latency < baselineLatency)) baselineLatency = latency;
+
+    if (bytesPerSecond > bestBytesPerSecond * (1. + throughputTolerance)
+        || (bytesPerSecond >= bestBytesPerSecond * (1. - throughputTolerance) && concurrency < bestConcurrency))
+    {
+        bestBytesPerSecond = std::max(bestBytesPerSecond, bytesPerSecond);
+        bestConcurrency = concurrency;
+    }
+
+    int next = concurrency;
+    if (latency >= 0 && baselineLatency > 0 && latency > latencyFactor * baselineLatency)
+    {
+        // Requests queue up behind each other on a congested link
+        concurrencyStep = -1;
+        next = concurrency - 1;
+    }
+    else if (previousBytesPerSecond > 0 && bytesPerSecond < previousBytesPerSecond * (1. - throughputTolerance))
+    {
+        // The last change lowered the throughput, so it is undone
+        concurrencyStep = -concurrencyStep;
+        next = concurrency + concurrencyStep;
+    }
+    else if (previousBytesPerSecond == 0 || bytesPerSecond > previousBytesPerSecond * (1. + throughputTolerance))
+    {
+        next = concurrency + concurrencyStep;
+    }
+
+    previousBytesPerSecond = bytesPerSecond;
+    next = std::clamp(next, minimumConcurrency, maximumConcurrency);
+
+    if (next != concurrency)
+    {
+        qDebug() << "Download concurrency" << concurrency << "->" << next << "at" << bytesPerSecond / 1024. << "KiB/s,"
+                 << "time to first byte" << latency << "ms";
+        concurrency = next;
+    }
+}
+
+void PackageDownloader::finishIfDone()
+{
+    if (!running || !active.isEmpty() || !queued.isEmpty()) return;
+
+    running = false;
+    watchdogTimer.stop();
+    health->save();
+
+    qDebug() << "Package downloads finished," << failedFiles << "files failed," << failovers << "moved between mirrors,"
+             << "best concurrency" << bestConcurrency;
+
+    emit progress(bytesReceived(), totalBytes);
+    emit finished(failedFiles == 0);
+}
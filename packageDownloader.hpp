@@ -0,0 +1,256 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "packageResolver.hpp"
+#include "mirrorHealth.hpp"
+#include <QObject>
+#include <QList>
+#include <QSet>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QSharedPointer>
+#include <algorithm>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QFile;
+class QCryptographicHash;
+
+#ifndef PACKAGEDOWNLOADER_H
+#define PACKAGEDOWNLOADER_H
+
+// Downloads package files into a pacman cache directory from a list of mirrors. Connections to the mirrors are
+// kept open and requests are pipelined on them, and every file is written in place, preallocated, as a partial
+// file that a later attempt continues with a range request. Throughput and errors of every mirror are tracked
+// while the downloads run: a mirror that stalls or falls below a throughput threshold has its outstanding
+// downloads moved to the next healthiest mirror.
+class PackageDownloader : public QObject
+{
+Q_OBJECT
+private:
+    struct Download
+    {
+        PackageFile file;
+        QString server;
+        QSet<QString> triedServers;     // Mirrors this file was requested from in the current round
+        int attempts = 0;
+
+        QNetworkReply* reply = nullptr;
+        QFile* output = nullptr;
+        QCryptographicHash* hash = nullptr;
+        qint64 attemptStartBytes = 0;   // Size of the partial file when the request was sent
+        qint64 tickBytes = 0;           // Bytes received since the last watchdog tick
+        double bytesPerSecond = 0.;     // Smoothed throughput of the request
+        qint64 firstByteMilliseconds = -1;
+        QElapsedTimer attemptTimer;
+        QElapsedTimer lastByteTimer;
+    };
+
+    QNetworkAccessManager* networkAccessManager;
+    QSharedPointer<MirrorHealth> health;
+
+    QStringList servers;
+    QString destination;
+
+    QList<Download*> queued;
+    QList<Download*> active;
+    QTimer watchdogTimer;
+    QElapsedTimer tickTimer;
+
+    qint64 totalBytes = 0;
+    qint64 completedBytes = 0;
+    qint64 networkBytes = 0;
+    int failedFiles = 0;
+    int failovers = 0;
+    bool running = false;
+
+    // The number of concurrent downloads is tuned while they run. A download is added while it raises the aggregate
+    // throughput, a change that lowers it is undone, and downloads are removed when the time to the first byte of
+    // the requests grows, as it does on a congested link.
+    int concurrency = 5;
+    int minimumConcurrency = 1;
+    int maximumConcurrency = 16;
+    bool adaptiveConcurrency = true;
+    int concurrencyStep = 1;                        // Direction of the next change
+    int bestConcurrency = 0;                        // Fewest downloads that reached the best throughput
+    double bestBytesPerSecond = 0.;
+    double previousBytesPerSecond = 0.;
+    double baselineLatency = -1.;                   // Lowest median time to first byte, in milliseconds
+    qint64 intervalBytes = 0;
+    QList<qint64> intervalLatencies;
+    bool intervalSaturated = true;                  // Whether every download slot was busy during the interval
+    QElapsedTimer adjustTimer;
+
+    static constexpr int adjustInterval = 2000;
+    static constexpr double throughputTolerance = 0.1;
+    static constexpr double latencyFactor = 2.;
+
+    int connectionsPerMirror = 2;
+    int maximumAttempts = 8;
+
+    static constexpr int watchdogInterval = 500;
+    int gracePeriod = 5000;                         // Milliseconds before the throughput of a request is judged
+    int stallTimeout = 10000;                       // Milliseconds without a byte before a request is abandoned
+    double minimumBytesPerSecond = 64 * 1024;
+    double slowFraction = 0.25;                     // Of the health score of the best mirror left to try
+
+    QString partialPath(const PackageFile& file) const
+    {
+        return destination + "/" + file.fileName + ".part";
+    }
+
+    QString chooseServer(Download* download) const;
+    void connectToMirrors();
+    int activeDownloads(const QString& server) const;
+
+    void startNextDownloads();
+    void startDownload(Download* download);
+    void onMetaDataChanged(Download* download);
+    // Returns false if the data could not be written, in which case download was failed and deleted
+    bool onReadyRead(Download* download);
+    void onFinished(Download* download);
+    void completeDownload(Download* download);
+
+    // Fail the file on a local write error, such as a full cache, without penalizing its mirror
+    void failLocally(Download* download);
+
+    // Record the transfer of the current request of download in the mirror health
+    void recordAttempt(Download* download);
+
+    void stopRequest(Download* download);
+    void closeOutput(Download* download);
+
+    // Stop the request of download and queue it again, to be continued on another mirror
+    void requeue(Download* download);
+    void moveDownload(Download* download, bool stalled);
+    void checkHealth();
+    void adjustConcurrency();
+    void finishIfDone();
+
+public:
+    explicit PackageDownloader(QObject* parent = nullptr);
+    ~PackageDownloader();
+
+    // Mirrors to download from, e.g. the ranked mirrorlist. The healthiest are tried first.
+    void setServers(const QStringList& _servers)
+    {
+        servers = _servers;
+    }
+
+    // The pacman cache directory
+    void setDestination(const QString& _destination)
+    {
+        destination = _destination;
+    }
+
+    // Concurrency the downloads start with
+    void setConcurrency(int _concurrency)
+    {
+        concurrency = std::clamp(_concurrency, minimumConcurrency, maximumConcurrency);
+    }
+
+    void setAdaptiveConcurrency(bool adaptive)
+    {
+        adaptiveConcurrency = adaptive;
+    }
+
+    // Concurrency that reached the best throughput of the last downloads, 0 if it was never measured
+    int tunedConcurrency() const
+    {
+        return bestConcurrency;
+    }
+
+    void setStallTimeout(int milliseconds)
+    {
+        stallTimeout = milliseconds;
+    }
+
+    void setGracePeriod(int milliseconds)
+    {
+        gracePeriod = milliseconds;
+    }
+
+    void setMinimumBytesPerSecond(double bytesPerSecond)
+    {
+        minimumBytesPerSecond = bytesPerSecond;
+    }
+
+    MirrorHealth& mirrorHealth()
+    {
+        return *health;
+    }
+
+    // Where the mirror health is kept across sessions, MirrorHealth::defaultPath() unless set
+    void setHealthPath(const QString& path)
+    {
+        health = QSharedPointer<MirrorHealth>::create(path);
+        health->load();
+    }
+
+    // Downloaders in the same process share one mirror health, so they learn from each other and neither
+    // overwrites what the other saved
+    QSharedPointer<MirrorHealth> sharedMirrorHealth() const
+    {
+        return health;
+    }
+
+    void setMirrorHealth(const QSharedPointer<MirrorHealth>& _health)
+    {
+        health = _health;
+    }
+
+    // Download every file that is not in the destination yet. Does nothing while downloads run.
+    void start(const QList<PackageFile>& files);
+    void cancel();
+
+    bool isRunning() const
+    {
+        return running;
+    }
+
+    // Bytes of the files in the destination, complete or partial
+    qint64 bytesReceived() const;
+
+    qint64 bytesTotal() const
+    {
+        return totalBytes;
+    }
+
+    // Bytes received from the mirrors by the last downloads, which excludes what was already in the destination
+    qint64 bytesDownloaded() const
+    {
+        return networkBytes;
+    }
+
+    // Current throughput of the mirrors being downloaded from, in bytes per second
+    QMap<QString, double> mirrorThroughput() const;
+
+    // Downloads moved from one mirror to another
+    int failoverCount() const
+    {
+        return failovers;
+    }
+
+signals:
+    void progress(qint64 bytesReceived, qint64 bytesTotal);
+    void finished(bool success);
+};
+
+#endif
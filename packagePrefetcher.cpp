@@ -0,0 +1,141 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "packagePrefetcher.hpp"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+#include <sys/statvfs.h>
+
+// Memory the kernel can hand out without swapping, from /proc/meminfo
+static qint64 availableMemoryBytes()
+{
+    QFile meminfo("/proc/meminfo");
+    if (!meminfo.open(QIODevice::ReadOnly | QIODevice::Text)) return 0;
+
+    while (!meminfo.atEnd())
+    {
+        QList<QByteArray> fields = meminfo.readLine().simplified().split(' ');
+        if (fields.value(0) == "MemAvailable:") return fields.value(1).toLongLong() * 1024;
+    }
+    return 0;
+}
+
+void CacheMover::run()
+{
+    QDir().mkpath(destination);
+
+    for (const QFileInfo& file : QDir(source).entryInfoList(QDir::Files))
+    {
+        QString target = destination + "/" + file.fileName();
+
+        // A complete copy may already be in the destination from an earlier attempt
+        if (QFileInfo(target).size() >= file.size())
+        {
+            QFile::remove(file.filePath());
+            continue;
+        }
+
+        QFile::remove(target);
+        if (!QFile::rename(file.filePath(), target))
+        {
+            qWarning() << "Could not move" << file.filePath() << "to" << destination;
+            continue;
+        }
+        bytesMoved += file.size();
+    }
+}
+
+PackagePrefetcher::PackagePrefetcher(QObject* parent) : QObject(parent)
+{
+    resolver = new PackageResolver(this);
+    packageDownloader = new PackageDownloader(this);
+    packageDownloader->setDestination(cachePath());
+
+    connect(resolver, &PackageResolver::resolved, this, [this](bool success) {
+        if (!success)
+        {
+            qWarning() << "Could not resolve the packages to prefetch";
+            return;
+        }
+
+        // Files are taken in the order pacman installs them, skipping those that no longer fit
+        QList<PackageFile> files;
+        qint64 bytes = 0;
+        for (const PackageFile& file : resolver->files())
+        {
+            if (bytes + file.size > budget) continue;
+            bytes += file.size;
+            files << file;
+        }
+
+        qDebug() << "Prefetching" << files.count() << "of" << resolver->files().count() << "package files,"
+                 << bytes / (1024 * 1024) << "MiB of a budget of" << budget / (1024 * 1024) << "MiB";
+        packageDownloader->start(files);
+    });
+}
+
+qint64 PackagePrefetcher::memoryBudget()
+{
+    QDir().mkpath(cachePath());
+
+    struct statvfs info;
+    qint64 freeBytes = statvfs(cachePath().toLocal8Bit().constData(), &info) == 0 ? static_cast<qint64>(info.f_bavail) * info.f_frsize : 0;
+
+    return std::min(availableMemoryBytes() / 2, freeBytes);
+}
+
+void PackagePrefetcher::start(const QStringList& servers, const QStringList& packages)
+{
+    if (isRunning() || cacheMover) return;
+
+    budget = memoryBudget();
+    if (budget <= 0)
+    {
+        qWarning() << "No memory left to prefetch packages";
+        return;
+    }
+
+    packageDownloader->setServers(servers);
+    resolver->resolve(packages);
+}
+
+void PackagePrefetcher::stop()
+{
+    resolver->cancel();
+    packageDownloader->cancel();
+}
+
+void PackagePrefetcher::moveTo(const QString& destination)
+{
+    if (cacheMover) return;
+
+    stop();
+
+    cacheMover = new CacheMover(cachePath(), destination, this);
+    connect(cacheMover, &QThread::finished, this, [this]() {
+        qint64 bytes = cacheMover->bytesMoved;
+        qDebug() << "Moved" << bytes / (1024 * 1024) << "MiB of prefetched packages";
+
+        cacheMover->deleteLater();
+        cacheMover = nullptr;
+        emit moved(bytes);
+    });
+    cacheMover->start();
+}
@@ -0,0 +1,91 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "packageResolver.hpp"
+#include "packageDownloader.hpp"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+
+#ifndef PACKAGEPREFETCHER_H
+#define PACKAGEPREFETCHER_H
+
+// Moves the files of a cache directory into another one, out of the interface thread, since the files are
+// copied when the directories are on different filesystems
+class CacheMover : public QThread
+{
+private:
+    QString source;
+    QString destination;
+
+protected:
+    void run() override;
+
+public:
+    CacheMover(const QString& _source, const QString& _destination, QObject* parent = nullptr)
+        : QThread(parent), source(_source), destination(_destination) {};
+
+    qint64 bytesMoved = 0;
+};
+
+// Downloads packages in the background while the user still goes through the pages before the installation, into
+// a cache in the memory of the live environment. The cache is kept within a memory budget, and is moved into the
+// cache of the new root once it is mounted, so the installation starts with most of its packages already local.
+class PackagePrefetcher : public QObject
+{
+Q_OBJECT
+private:
+    PackageResolver* resolver;
+    PackageDownloader* packageDownloader;
+    CacheMover* cacheMover = nullptr;
+    qint64 budget = 0;
+
+public:
+    explicit PackagePrefetcher(QObject* parent = nullptr);
+
+    // /tmp is a tmpfs in the live environment
+    static QString cachePath()
+    {
+        return "/tmp/delphinos-installer/prefetch";
+    }
+
+    // Half of the available memory, bounded by the free space of the filesystem of the cache
+    static qint64 memoryBudget();
+
+    PackageDownloader* downloader()
+    {
+        return packageDownloader;
+    }
+
+    // Resolve packages and download their files from servers, the first ones up to the memory budget
+    void start(const QStringList& servers, const QStringList& packages);
+    void stop();
+
+    bool isRunning() const
+    {
+        return resolver->isRunning() || packageDownloader->isRunning();
+    }
+
+    // Stop prefetching and move the cache into destination, partial files included, so their downloads continue
+    void moveTo(const QString& destination);
+
+signals:
+    void moved(qint64 bytes);
+};
+
+#endif
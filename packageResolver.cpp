@@ -0,0 +1,135 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "packageResolver.hpp"
+#include <QProcess>
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+
+QList<PackageFile> PackageResolver::parseTargets(const QByteArray& output)
+{
+    QList<PackageFile> files;
+
+    for (const QByteArray& line : output.split('\n'))
+    {
+        QList<QByteArray> fields = line.trimmed().split(' ');
+        if (fields.count() != 4) continue;
+
+        bool sizeIsInt;
+        PackageFile file;
+        file.repository = QString::fromUtf8(fields.at(0));
+        file.fileName = QString::fromUtf8(fields.at(1));
+        file.size = fields.at(2).toLongLong(&sizeIsInt);
+        file.sha256 = fields.at(3).toLower();
+
+        // Lines of other output, such as warnings, do not have a size
+        if (!sizeIsInt || file.fileName.isEmpty()) continue;
+
+        files << file;
+    }
+
+    return files;
+}
+
+void PackageResolver::resolve(const QStringList& _packages)
+{
+    if (process) return;
+
+    packages = _packages;
+    resolvedFiles.clear();
+
+    QDir().mkpath(databasePath());
+    synchronize();
+}
+
+void PackageResolver::cancel()
+{
+    if (!process) return;
+
+    disconnect(process, nullptr, this, nullptr);
+    process->kill();
+    process->waitForFinished(1000);
+    process->deleteLater();
+    process = nullptr;
+
+    // pacman leaves its lock behind when it is killed
+    QFile::remove(databasePath() + "/db.lck");
+}
+
+void PackageResolver::synchronize()
+{
+    process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+
+    connect(process, &QProcess::finished, this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
+        if (exitStatus != QProcess::NormalExit || exitCode != 0)
+        {
+            qWarning() << "Could not synchronize the package databases, exit code" << exitCode;
+            fail();
+            return;
+        }
+
+        process->deleteLater();
+        printTargets();
+    });
+    connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+
+        qWarning() << "Failed to start pacman";
+        fail();
+    });
+
+    process->start("pacman", { "--dbpath", databasePath(), "--noconfirm", "-Sy" });
+}
+
+void PackageResolver::printTargets()
+{
+    process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+
+    connect(process, &QProcess::finished, this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
+        if (exitStatus != QProcess::NormalExit || exitCode != 0)
+        {
+            qWarning() << "Could not resolve the packages" << packages << ", exit code" << exitCode;
+            fail();
+            return;
+        }
+
+        resolvedFiles = parseTargets(process->readAllStandardOutput());
+        process->deleteLater();
+        process = nullptr;
+
+        qDebug() << "Resolved" << packages.count() << "packages to" << resolvedFiles.count() << "files";
+        emit resolved(!resolvedFiles.isEmpty());
+    });
+    connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+
+        qWarning() << "Failed to start pacman";
+        fail();
+    });
+
+    process->start("pacman", QStringList{ "--dbpath", databasePath(), "--noconfirm", "-Sp", "--print-format", "%r %f %s %h" } + packages);
+}
+
+void PackageResolver::fail()
+{
+    process->deleteLater();
+    process = nullptr;
+    emit resolved(false);
+}
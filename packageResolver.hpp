@@ -0,0 +1,83 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+class QProcess;
+
+#ifndef PACKAGERESOLVER_H
+#define PACKAGERESOLVER_H
+
+// A package file to download from a repository
+struct PackageFile
+{
+    QString repository;
+    QString fileName;
+    qint64 size = 0;
+    QByteArray sha256;      // Hexadecimal, empty if unknown
+};
+
+// Resolves the files of a set of packages and of their dependencies, as pacman would install them on an empty root.
+// The sync databases are kept in a database path of their own, so the system being installed is not touched.
+class PackageResolver : public QObject
+{
+Q_OBJECT
+private:
+    QProcess* process = nullptr;
+    QStringList packages;
+    QList<PackageFile> resolvedFiles;
+
+    void synchronize();
+    void printTargets();
+    void fail();
+
+public:
+    explicit PackageResolver(QObject* parent = nullptr) : QObject(parent) {};
+
+    static QString databasePath()
+    {
+        return "/tmp/delphinos-installer/pacman";
+    }
+
+    // Files of the lines printed by pacman -Sp --print-format "%r %f %s %h"
+    static QList<PackageFile> parseTargets(const QByteArray& output);
+
+    // Does nothing while a resolution runs
+    void resolve(const QStringList& _packages);
+
+    // Stop a running resolution, without emitting resolved
+    void cancel();
+
+    bool isRunning() const
+    {
+        return process != nullptr;
+    }
+
+    QList<PackageFile> files() const
+    {
+        return resolvedFiles;
+    }
+
+signals:
+    void resolved(bool success);
+};
+
+#endif
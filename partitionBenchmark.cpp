@@ -0,0 +1,484 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Headless benchmark of the partitioning steps of the installer: device scan, system partition
+// planning, operation execution, discard, mkfs and mount. Runs either on the KPMcore dummy backend or on
+// sparse image files attached as loop devices, and reports latency percentiles of every phase.
+//
+//   delphinos-partition-benchmark --iterations 20
+//   sudo delphinos-partition-benchmark --loop 2 --image-size 16 --root-fs btrfs
+//   sudo delphinos-partition-benchmark --loop 1 --discard
+
+#include "partitionLayoutPlanner.hpp"
+#include "fileSystemFormatter.hpp"
+#include "rangeDiscarder.hpp"
+#include "benchmarkHelpers.hpp"
+#include <kpmcore/backend/corebackendmanager.h>
+#include <kpmcore/core/devicescanner.h>
+#include <kpmcore/core/device.h>
+#include <kpmcore/core/partition.h>
+#include <kpmcore/core/partitiontable.h>
+#include <kpmcore/core/operationstack.h>
+#include <kpmcore/ops/newoperation.h>
+#include <kpmcore/ops/createpartitiontableoperation.h>
+#include <kpmcore/fs/filesystemfactory.h>
+#include <kpmcore/util/report.h>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QProcess>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QMap>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+#include <sys/stat.h>
+
+const qint64 MiB = 1024 * 1024;
+const qint64 GiB = MiB * 1024;
+
+// Latencies of one phase, in milliseconds
+struct PhaseSamples
+{
+    QString name;
+    QList<double> milliseconds;
+};
+
+// Run a command to completion, optionally storing its standard output
+static bool runCommand(const QString& program, const QStringList& arguments, QString* output = nullptr)
+{
+    QProcess process;
+    process.start(program, arguments);
+
+    if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+    {
+        qWarning() << program << arguments << "failed:" << process.readAllStandardError().trimmed();
+        return false;
+    }
+
+    if (output) *output = QString::fromLocal8Bit(process.readAllStandardOutput()).trimmed();
+    return true;
+}
+
+// Bytes actually allocated on disk by a file, which shrinks when holes are punched into it
+static qint64 allocatedBytes(const QString& path)
+{
+    struct stat fileStatus;
+    if (stat(path.toLocal8Bit().constData(), &fileStatus) != 0) return -1;
+    return static_cast<qint64>(fileStatus.st_blocks) * 512;
+}
+
+// Image file a loop device is attached to
+static QString loopBackingFile(const QString& loopDeviceNode)
+{
+    QFile backingFile(QString("/sys/block/%1/loop/backing_file").arg(QFileInfo(loopDeviceNode).fileName()));
+    if (!backingFile.open(QIODevice::ReadOnly | QIODevice::Text)) return QString();
+    return QString::fromLocal8Bit(backingFile.readAll()).trimmed();
+}
+
+// Fill the beginning of a partition with data, so the image has allocated blocks that a discard must release
+static bool writeSeedData(const QString& partitionNode, qint64 size)
+{
+    QFile partition(partitionNode);
+    if (!partition.open(QIODevice::WriteOnly)) return false;
+
+    const QByteArray block(MiB, char(0xA5));
+    for (qint64 written = 0; written < size; written += block.size())
+    {
+        if (partition.write(block) != block.size()) return false;
+    }
+
+    return partition.flush() && fsync(partition.handle()) == 0;
+}
+
+// Partition device node of a loop, nvme or similar device
+static QString partitionNode(const QString& deviceNode, int number)
+{
+    return deviceNode.back().isDigit() ? QString("%1p%2").arg(deviceNode).arg(number) : QString("%1%2").arg(deviceNode).arg(number);
+}
+
+class PartitionBenchmark
+{
+private:
+    OperationStack* operationStack;
+    DeviceScanner* deviceScanner;
+    Report* rootReport;
+
+    QStringList targetDeviceNodes; // Devices to partition, every scanned device when empty
+    bool useLoopDevices;
+    bool discardPartitions;
+    FileSystem::Type rootFileSystemType;
+    MkfsProfile mkfsProfile;
+
+    QMap<QString, PhaseSamples> phases;
+    QStringList phaseOrder;
+
+    void addSample(const QString& phase, const QElapsedTimer& timer)
+    {
+        if (!phases.contains(phase))
+        {
+            phases.insert(phase, PhaseSamples{ phase, {} });
+            phaseOrder.append(phase);
+        }
+        phases[phase].milliseconds.append(timer.nsecsElapsed() / 1e6);
+    }
+
+    Device* findDevice(const QString& deviceNode)
+    {
+        for (Device* device : operationStack->previewDevices())
+        {
+            if (device && device->deviceNode() == deviceNode) return device;
+        }
+        return nullptr;
+    }
+
+    // Plan, apply, format and mount the system partitions on one device
+    bool partitionDevice(Device* device)
+    {
+        QElapsedTimer timer;
+        const QString deviceNode = device->deviceNode();
+
+        // Plan: a new GPT table and the aligned system partitions across the whole device, as the installer does
+        timer.start();
+
+        operationStack->push(new CreatePartitionTableOperation(*device, PartitionTable::TableType::gpt));
+        PartitionTable* partitionTable = device->partitionTable();
+
+        PartitionLayoutPlanner layoutPlanner(DeviceTopology::read(deviceNode), device->logicalSize());
+        SystemPartitionLayout layout = layoutPlanner.planSystemPartitions(partitionTable->firstUsable(), partitionTable->lastUsable(),
+            (partitionTable->lastUsable() - partitionTable->firstUsable() + 1) * device->logicalSize(), MiB * 256);
+
+        if (!layout.isValid())
+        {
+            qWarning() << "Could not plan the system partitions of" << deviceNode;
+            operationStack->clearOperations();
+            return false;
+        }
+
+        PartitionTable::Flags availableFlags;
+        for (PartitionTable::Flag flag : partitionTable->flagList()) availableFlags |= flag;
+
+        Partition* bootPartition = new Partition(partitionTable, *device, PartitionRole(PartitionRole::Primary),
+            FileSystemFactory::create(FileSystem::Type::Unformatted, layout.firstBootSector, layout.lastBootSector, device->logicalSize()),
+            layout.firstBootSector, layout.lastBootSector, partitionNode(deviceNode, 1), availableFlags, QString(), false, PartitionTable::Flag::Boot);
+
+        Partition* rootPartition = new Partition(partitionTable, *device, PartitionRole(PartitionRole::Primary),
+            FileSystemFactory::create(FileSystem::Type::Unformatted, layout.firstRootSector, layout.lastRootSector, device->logicalSize()),
+            layout.firstRootSector, layout.lastRootSector, partitionNode(deviceNode, 2), availableFlags, QString(), false, PartitionTable::Flag::None);
+
+        operationStack->push(new NewOperation(*device, bootPartition));
+        operationStack->push(new NewOperation(*device, rootPartition));
+
+        addSample("plan", timer);
+
+        // Apply: the whole stack in one batch, as PartitionPage::runOperations() does
+        timer.start();
+
+        bool applied = true;
+        for (Operation* op : operationStack->operations())
+        {
+            Report* childReport = new Report(rootReport, op->description());
+            applied = op->execute(*childReport) && applied;
+            delete childReport;
+        }
+
+        // The partition nodes must exist before they can be formatted
+        if (useLoopDevices) runCommand("udevadm", { "settle" });
+
+        addSample("apply", timer);
+
+        const QString bootNode = bootPartition->deviceNode();
+        const QString rootNode = rootPartition->deviceNode();
+        const qint64 bootSize = bootPartition->capacity();
+        const qint64 rootSize = rootPartition->capacity();
+        operationStack->clearOperations();
+
+        if (!applied)
+        {
+            qWarning() << "Could not apply the operations on" << deviceNode;
+            return false;
+        }
+
+        // The dummy backend does not write to any device, so there is nothing to discard, format or mount
+        if (!useLoopDevices) return true;
+
+        if (discardPartitions && !discardDevicePartitions(deviceNode, bootNode, bootSize, rootNode, rootSize)) return false;
+
+        // mkfs: both filesystems concurrently, with the same formatter the installer uses
+        timer.start();
+
+        FileSystemFormatter formatter(mkfsProfile);
+        formatter.addFileSystem(rootNode, rootFileSystemType, "DelphinOS");
+        formatter.addFileSystem(bootNode, FileSystem::Type::Fat32, "DELPHINOS");
+
+        bool formatted = false;
+        QEventLoop formatLoop;
+        QObject::connect(&formatter, &FileSystemFormatter::finished, &formatLoop, [&](bool success) {
+            formatted = success;
+            formatLoop.quit();
+        });
+        formatter.start();
+        if (formatter.isRunning()) formatLoop.exec();
+
+        addSample("mkfs", timer);
+
+        if (!formatted)
+        {
+            qWarning() << "Could not format the system partitions of" << deviceNode;
+            return false;
+        }
+
+        // mount: root and then boot inside of it
+        QTemporaryDir mountPoint;
+
+        timer.start();
+        bool mounted = runCommand("mount", { rootNode, mountPoint.path() })
+            && QDir().mkpath(mountPoint.path() + "/boot")
+            && runCommand("mount", { bootNode, mountPoint.path() + "/boot" });
+        addSample("mount", timer);
+
+        runCommand("umount", { "-R", mountPoint.path() });
+
+        return mounted;
+    }
+
+    // discard: both partitions with the discarder the installer uses. The loop driver punches holes into the
+    // image for discarded ranges, so the data seeded into the root partition must be deallocated afterwards.
+    bool discardDevicePartitions(const QString& deviceNode, const QString& bootNode, qint64 bootSize, const QString& rootNode, qint64 rootSize)
+    {
+        const qint64 seedSize = 64 * MiB;
+        const QString imagePath = loopBackingFile(deviceNode);
+
+        if (imagePath.isEmpty() || !writeSeedData(rootNode, seedSize))
+        {
+            qWarning() << "Could not seed data into" << rootNode << "of image" << imagePath;
+            return false;
+        }
+
+        const qint64 allocatedBefore = allocatedBytes(imagePath);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        RangeDiscarder discarder;
+        discarder.addRange(bootNode, 0, bootSize);
+        discarder.addRange(rootNode, 0, rootSize);
+        discarder.start();
+        discarder.wait();
+
+        addSample("discard", timer);
+
+        const qint64 allocatedAfter = allocatedBytes(imagePath);
+        qDebug() << "Allocated bytes of" << imagePath << "before discard:" << allocatedBefore << "after:" << allocatedAfter
+                 << (discarder.usedZeroout() ? "(zeroed out)" : "");
+
+        if (!discarder.succeeded())
+        {
+            qWarning() << "Could not discard the system partitions of" << deviceNode;
+            return false;
+        }
+
+        if (allocatedBefore < 0 || allocatedAfter < 0 || allocatedBefore - allocatedAfter < seedSize)
+        {
+            qWarning() << "Discarding the partitions of" << deviceNode << "did not punch holes into" << imagePath
+                       << "- released" << allocatedBefore - allocatedAfter << "bytes, expected at least" << seedSize;
+            return false;
+        }
+
+        return true;
+    }
+
+public:
+    PartitionBenchmark(const QStringList& _targetDeviceNodes, bool _useLoopDevices, bool _discardPartitions, FileSystem::Type _rootFileSystemType, MkfsProfile _mkfsProfile)
+        : targetDeviceNodes(_targetDeviceNodes), useLoopDevices(_useLoopDevices), discardPartitions(_discardPartitions), rootFileSystemType(_rootFileSystemType), mkfsProfile(_mkfsProfile)
+    {
+        rootReport = new Report(nullptr, "Partitioning benchmark");
+        operationStack = new OperationStack();
+        deviceScanner = new DeviceScanner(nullptr, *operationStack);
+    }
+
+    ~PartitionBenchmark()
+    {
+        delete deviceScanner;
+        delete operationStack;
+        delete rootReport;
+    }
+
+    bool runIteration()
+    {
+        QElapsedTimer timer;
+
+        timer.start();
+        deviceScanner->scan();
+        addSample("scan", timer);
+
+        QList<Device*> devices;
+        if (targetDeviceNodes.isEmpty())
+        {
+            devices = operationStack->previewDevices();
+        } else {
+            for (const QString& deviceNode : targetDeviceNodes)
+            {
+                Device* device = findDevice(deviceNode);
+                if (!device)
+                {
+                    qWarning() << "Device" << deviceNode << "was not found by the scan";
+                    return false;
+                }
+                devices.append(device);
+            }
+        }
+
+        for (Device* device : devices)
+        {
+            if (!partitionDevice(device)) return false;
+        }
+
+        return true;
+    }
+
+    void printReport(QTextStream& out) const
+    {
+        out << QString("%1 %2 %3 %4 %5 %6\n").arg("phase", -8).arg("samples", 8).arg("p50 ms", 10).arg("p90 ms", 10).arg("p99 ms", 10).arg("max ms", 10);
+
+        for (const QString& phase : phaseOrder)
+        {
+            QList<double> samples = phases.value(phase).milliseconds;
+            std::sort(samples.begin(), samples.end());
+
+            out << QString("%1 %2 %3 %4 %5 %6\n").arg(phase, -8).arg(samples.size(), 8)
+                .arg(percentile(samples, 50), 10, 'f', 2).arg(percentile(samples, 90), 10, 'f', 2)
+                .arg(percentile(samples, 99), 10, 'f', 2).arg(samples.isEmpty() ? 0. : samples.last(), 10, 'f', 2);
+        }
+    }
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("delphinos-partition-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark of the partitioning steps of delphinos-installer");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "iterations", "Number of times every phase is run.", "n", "10" },
+        { "backend", "KPMcore backend. Defaults to the dummy backend, or to KPMCORE_BACKEND and the default backend with --loop.", "name" },
+        { "loop", "Partition n sparse image files attached as loop devices instead of the dummy devices. Requires root.", "n", "0" },
+        { "image-size", "Size of each sparse image in GiB.", "GiB", "16" },
+        { "image-dir", "Directory where the sparse images are created.", "dir", "/var/tmp" },
+        { "root-fs", "Filesystem of the root partition: ext4 or btrfs.", "fs", "ext4" },
+        { "mkfs-profile", "mkfs profile: fast or full.", "profile", "fast" },
+        { "discard", "Discard the new partitions before formatting them and check that holes were punched into the images. Requires --loop." },
+    });
+    parser.process(app);
+
+    const int iterations = std::max(1, parser.value("iterations").toInt());
+    const int loopDeviceCount = std::max(0, parser.value("loop").toInt());
+    const bool useLoopDevices = loopDeviceCount > 0;
+    const bool discardPartitions = parser.isSet("discard");
+    const FileSystem::Type rootFileSystemType = parser.value("root-fs") == "btrfs" ? FileSystem::Type::Btrfs : FileSystem::Type::Ext4;
+    const MkfsProfile mkfsProfile = parser.value("mkfs-profile") == "full" ? MkfsProfile::FullyInitialized : MkfsProfile::FastInstall;
+
+    if (discardPartitions && !useLoopDevices)
+    {
+        qCritical() << "--discard requires --loop, the dummy backend does not write to any device";
+        return 1;
+    }
+
+    if (useLoopDevices && geteuid() != 0)
+    {
+        qCritical() << "Loop devices can only be attached by root";
+        return 1;
+    }
+
+    // Same backend selection as PartitionPage::initialize(), except that the dummy backend is the default
+    QString backendName = parser.value("backend");
+    if (backendName.isEmpty())
+    {
+        QByteArray env = qgetenv("KPMCORE_BACKEND");
+        backendName = useLoopDevices ? (env.isEmpty() ? CoreBackendManager::defaultBackendName() : QString::fromLocal8Bit(env)) : "pmdummybackendplugin";
+    }
+
+    if (!CoreBackendManager::self()->load(backendName))
+    {
+        qCritical() << "Failed to load KPMCore backend" << backendName;
+        return 1;
+    }
+
+    // Attach the sparse images. Nothing is allocated on disk until the filesystems are written.
+    QTemporaryDir imageDir(parser.value("image-dir") + "/delphinos-partition-benchmark-XXXXXX");
+    QStringList loopDeviceNodes;
+
+    for (int i = 0; i < loopDeviceCount; i++)
+    {
+        QFile image(imageDir.filePath(QString("disk%1.img").arg(i)));
+        if (!image.open(QIODevice::WriteOnly) || !image.resize(parser.value("image-size").toLongLong() * GiB))
+        {
+            qCritical() << "Could not create the sparse image" << image.fileName();
+            return 1;
+        }
+        image.close();
+
+        QString loopDeviceNode;
+        if (!runCommand("losetup", { "--find", "--show", "--partscan", image.fileName() }, &loopDeviceNode) || loopDeviceNode.isEmpty())
+        {
+            qCritical() << "Could not attach" << image.fileName() << "to a loop device";
+            return 1;
+        }
+        loopDeviceNodes.append(loopDeviceNode);
+    }
+
+    int exitCode = 0;
+    {
+        PartitionBenchmark benchmark(loopDeviceNodes, useLoopDevices, discardPartitions, rootFileSystemType, mkfsProfile);
+
+        for (int i = 0; i < iterations; i++)
+        {
+            if (!benchmark.runIteration())
+            {
+                qCritical() << "Iteration" << i + 1 << "failed";
+                exitCode = 1;
+                break;
+            }
+
+            // Start every iteration from blank devices
+            for (const QString& loopDeviceNode : loopDeviceNodes)
+            {
+                runCommand("wipefs", { "--all", "--quiet", loopDeviceNode });
+            }
+        }
+
+        QTextStream out(stdout);
+        out << "Backend: " << backendName << ", devices: " << (useLoopDevices ? loopDeviceNodes.join(" ") : QString("dummy"))
+            << ", iterations: " << iterations << "\n";
+        benchmark.printReport(out);
+    }
+
+    for (const QString& loopDeviceNode : loopDeviceNodes)
+    {
+        runCommand("losetup", { "--detach", loopDeviceNode });
+    }
+
+    return exitCode;
+}
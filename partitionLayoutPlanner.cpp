@@ -0,0 +1,144 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "partitionLayoutPlanner.hpp"
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+#include <numeric>
+
+// Read a single integer attribute from sysfs. Returns fallback if it does not exist.
+static qint64 readSysfsValue(const QString& path, qint64 fallback)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return fallback;
+    }
+
+    bool isInt;
+    qint64 value = file.readAll().trimmed().toLongLong(&isInt);
+    return isInt ? value : fallback;
+}
+
+DeviceTopology DeviceTopology::read(const QString& deviceNode, const QString& sysfsRoot)
+{
+    DeviceTopology topology;
+
+    // Resolve symlinks such as /dev/mapper/name to the kernel name of the device (dm-0)
+    QFileInfo deviceNodeInfo(deviceNode);
+    QString blockName = deviceNodeInfo.exists() ? QFileInfo(deviceNodeInfo.canonicalFilePath()).fileName() : deviceNodeInfo.fileName();
+    QString blockPath = sysfsRoot + "/class/block/" + blockName;
+
+    if (!QFileInfo::exists(blockPath))
+    {
+        qWarning() << "DeviceTopology::read(): No sysfs entry for" << deviceNode << "- using default topology";
+        return topology;
+    }
+
+    topology.logicalBlockSize = readSysfsValue(blockPath + "/queue/logical_block_size", topology.logicalBlockSize);
+    topology.physicalBlockSize = readSysfsValue(blockPath + "/queue/physical_block_size", topology.logicalBlockSize);
+    topology.minimumIoSize = readSysfsValue(blockPath + "/queue/minimum_io_size", 0);
+    topology.optimalIoSize = readSysfsValue(blockPath + "/queue/optimal_io_size", 0);
+    topology.alignmentOffset = readSysfsValue(blockPath + "/alignment_offset", 0);
+    topology.rotational = readSysfsValue(blockPath + "/queue/rotational", 0) != 0;
+
+    // SD cards and eMMC report their erase block, other flash devices at most hint it through the discard granularity
+    topology.eraseBlockSize = readSysfsValue(blockPath + "/device/preferred_erase_size", 0);
+    if (topology.eraseBlockSize == 0 && !topology.rotational)
+    {
+        topology.eraseBlockSize = readSysfsValue(blockPath + "/queue/discard_granularity", 0);
+    }
+
+    qDebug() << "Topology of" << deviceNode << "- physical block:" << topology.physicalBlockSize
+             << "optimal I/O:" << topology.optimalIoSize << "alignment offset:" << topology.alignmentOffset
+             << "erase block:" << topology.eraseBlockSize << "rotational:" << topology.rotational;
+
+    return topology;
+}
+
+PartitionLayoutPlanner::PartitionLayoutPlanner(const DeviceTopology& _topology, qint64 _sectorSize) : topology(_topology), sectorSize(_sectorSize)
+{
+    if (sectorSize <= 0)
+    {
+        sectorSize = topology.logicalBlockSize > 0 ? topology.logicalBlockSize : 512;
+    }
+
+    // Boundaries must be a multiple of every granularity the device reports, and never smaller than 1 MiB.
+    // Some controllers report nonsense such as an optimal I/O size of 33553920 bytes, so only power of two
+    // granularities up to maximumAlignment are honoured; anything else would waste gigabytes between partitions.
+    alignment = std::lcm(minimumAlignment, sectorSize);
+
+    for (qint64 granularity : { topology.physicalBlockSize, topology.minimumIoSize, topology.optimalIoSize, topology.eraseBlockSize })
+    {
+        if (granularity <= 0)
+        {
+            continue;
+        }
+
+        if ((granularity & (granularity - 1)) != 0 || granularity % sectorSize != 0 || granularity > maximumAlignment)
+        {
+            qDebug() << "PartitionLayoutPlanner: Ignoring implausible granularity of" << granularity << "bytes";
+            continue;
+        }
+
+        alignment = std::lcm(alignment, granularity);
+    }
+
+    // Devices that are not naturally aligned have their aligned sectors shifted by the alignment offset
+    alignmentOffset = (topology.alignmentOffset / sectorSize) % (alignment / sectorSize);
+}
+
+qint64 PartitionLayoutPlanner::alignUp(qint64 sector) const
+{
+    const qint64 alignmentSectors = alignment / sectorSize;
+    qint64 remainder = ((sector - alignmentOffset) % alignmentSectors + alignmentSectors) % alignmentSectors;
+    return remainder == 0 ? sector : sector + (alignmentSectors - remainder);
+}
+
+qint64 PartitionLayoutPlanner::alignDown(qint64 sector) const
+{
+    const qint64 alignmentSectors = alignment / sectorSize;
+    qint64 remainder = ((sector - alignmentOffset) % alignmentSectors + alignmentSectors) % alignmentSectors;
+    return sector - remainder;
+}
+
+SystemPartitionLayout PartitionLayoutPlanner::planSystemPartitions(qint64 firstFreeSector, qint64 lastFreeSector, qint64 systemSizeBytes, qint64 bootSizeBytes) const
+{
+    SystemPartitionLayout layout;
+
+    // Partitions start on aligned sectors and end right before one, so the next partition is aligned as well
+    layout.firstBootSector = alignUp(firstFreeSector);
+    layout.lastBootSector = alignUp(layout.firstBootSector + bootSizeBytes / sectorSize) - 1;
+
+    layout.firstRootSector = layout.lastBootSector + 1;
+
+    qint64 systemEndSector = std::min(firstFreeSector + systemSizeBytes / sectorSize, lastFreeSector + 1);
+    layout.lastRootSector = alignDown(systemEndSector) - 1;
+
+    if (!layout.isValid() || layout.lastRootSector > lastFreeSector)
+    {
+        qWarning() << "planSystemPartitions(): System partitions do not fit between sectors" << firstFreeSector << "and" << lastFreeSector;
+        return SystemPartitionLayout();
+    }
+
+    qDebug() << "Planned system partitions aligned to" << alignment << "bytes: boot" << layout.firstBootSector << "-" << layout.lastBootSector
+             << "root" << layout.firstRootSector << "-" << layout.lastRootSector;
+
+    return layout;
+}
@@ -0,0 +1,87 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QString>
+#include <QtGlobal>
+
+#ifndef PARTITIONLAYOUTPLANNER_H
+#define PARTITIONLAYOUTPLANNER_H
+
+// I/O topology of a block device, as exported by the kernel in sysfs
+struct DeviceTopology
+{
+    qint64 logicalBlockSize = 512;
+    qint64 physicalBlockSize = 512;
+    qint64 minimumIoSize = 0;
+    qint64 optimalIoSize = 0;      // Stripe width on RAID devices, 0 when not reported
+    qint64 alignmentOffset = 0;    // Bytes the beginning of the device is offset from its natural alignment
+    qint64 eraseBlockSize = 0;     // Preferred erase size of flash devices, 0 when not reported
+    bool rotational = false;
+
+    // Read the topology of deviceNode (e.g. /dev/nvme0n1) from sysfsRoot. A different sysfsRoot
+    // can be given to read fixture topologies.
+    static DeviceTopology read(const QString& deviceNode, const QString& sysfsRoot = "/sys");
+};
+
+// Sectors of the boot and root partitions of the system, inclusive
+struct SystemPartitionLayout
+{
+    qint64 firstBootSector = -1;
+    qint64 lastBootSector = -1;
+    qint64 firstRootSector = -1;
+    qint64 lastRootSector = -1;
+
+    bool isValid() const
+    {
+        return firstBootSector >= 0 && lastBootSector > firstBootSector
+            && firstRootSector > lastBootSector && lastRootSector > firstRootSector;
+    }
+};
+
+// Plans partitions so that their boundaries fall on the erase block and I/O size of the device
+class PartitionLayoutPlanner
+{
+private:
+    DeviceTopology topology;
+    qint64 sectorSize;
+    qint64 alignment;          // Alignment of partition boundaries in bytes
+    qint64 alignmentOffset;    // Offset of aligned boundaries in sectors
+
+public:
+    static constexpr qint64 minimumAlignment = 1024 * 1024; // 1 MiB, the usual partitioning tools default
+    static constexpr qint64 maximumAlignment = 8 * 1024 * 1024; // 8 MiB, the largest erase block of common flash devices
+
+    PartitionLayoutPlanner(const DeviceTopology& _topology, qint64 _sectorSize);
+
+    qint64 getAlignment() const
+    {
+        return alignment;
+    }
+
+    // First aligned sector at or after sector
+    qint64 alignUp(qint64 sector) const;
+
+    // Last aligned sector at or before sector
+    qint64 alignDown(qint64 sector) const;
+
+    // Plan the boot and root partitions inside the free space [firstFreeSector, lastFreeSector].
+    // systemSizeBytes is the total space used by both partitions, counted from firstFreeSector.
+    // Returns an invalid layout if the partitions do not fit.
+    SystemPartitionLayout planSystemPartitions(qint64 firstFreeSector, qint64 lastFreeSector, qint64 systemSizeBytes, qint64 bootSizeBytes) const;
+};
+
+#endif
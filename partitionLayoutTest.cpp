@@ -0,0 +1,157 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Checks the partition alignment chosen for fixture sysfs topologies of common and broken devices.
+// Registered with CTest, and can be run by hand:
+//
+//   delphinos-partition-layout-test
+
+#include "partitionLayoutPlanner.hpp"
+#include <QTemporaryDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QMap>
+#include <QTextStream>
+#include <QDebug>
+
+const qint64 KiB = 1024;
+const qint64 MiB = KiB * 1024;
+
+static int failures = 0;
+
+static void check(bool condition, const QString& description)
+{
+    QTextStream out(stdout);
+    out << (condition ? "PASS " : "FAIL ") << description << Qt::endl;
+    if (!condition) failures++;
+}
+
+// Write a fake /sys/class/block/<name> tree with the given attributes, relative to the block directory
+static bool writeFixture(const QString& sysfsRoot, const QString& name, const QMap<QString, qint64>& attributes)
+{
+    const QString blockPath = sysfsRoot + "/class/block/" + name;
+
+    for (auto it = attributes.cbegin(); it != attributes.cend(); ++it)
+    {
+        const QString path = blockPath + "/" + it.key();
+        if (!QDir().mkpath(QFileInfo(path).path())) return false;
+
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+        file.write(QByteArray::number(it.value()) + "\n");
+    }
+    return true;
+}
+
+int main()
+{
+    QTemporaryDir sysfsRoot;
+    if (!sysfsRoot.isValid())
+    {
+        qWarning() << "Could not create the fixture directory";
+        return 1;
+    }
+
+    // The device nodes do not exist, so DeviceTopology::read() looks them up by file name
+    writeFixture(sysfsRoot.path(), "fixture-512e", {
+        { "queue/logical_block_size", 512 }, { "queue/physical_block_size", 4096 },
+        { "queue/minimum_io_size", 4096 }, { "queue/optimal_io_size", 0 },
+        { "queue/rotational", 1 }, { "alignment_offset", 0 } });
+
+    writeFixture(sysfsRoot.path(), "fixture-4kn", {
+        { "queue/logical_block_size", 4096 }, { "queue/physical_block_size", 4096 },
+        { "queue/minimum_io_size", 4096 }, { "queue/optimal_io_size", 0 },
+        { "queue/rotational", 0 }, { "queue/discard_granularity", 4096 }, { "alignment_offset", 0 } });
+
+    // Older 512e drives jumpered for Windows XP start 7 logical sectors into a physical sector
+    writeFixture(sysfsRoot.path(), "fixture-offset", {
+        { "queue/logical_block_size", 512 }, { "queue/physical_block_size", 4096 },
+        { "queue/minimum_io_size", 4096 }, { "queue/rotational", 1 }, { "alignment_offset", 3584 } });
+
+    // USB bridges that report a bogus optimal I/O size of 0xFFFF sectors minus one
+    writeFixture(sysfsRoot.path(), "fixture-bogus", {
+        { "queue/logical_block_size", 512 }, { "queue/physical_block_size", 512 },
+        { "queue/minimum_io_size", 512 }, { "queue/optimal_io_size", 33553920 },
+        { "queue/rotational", 1 }, { "alignment_offset", 0 } });
+
+    writeFixture(sysfsRoot.path(), "fixture-sdcard", {
+        { "queue/logical_block_size", 512 }, { "queue/physical_block_size", 512 },
+        { "queue/rotational", 0 }, { "device/preferred_erase_size", 4 * MiB } });
+
+    writeFixture(sysfsRoot.path(), "fixture-huge-erase", {
+        { "queue/logical_block_size", 512 }, { "queue/physical_block_size", 512 },
+        { "queue/rotational", 0 }, { "device/preferred_erase_size", 64 * MiB } });
+
+    {
+        DeviceTopology topology = DeviceTopology::read("/dev/fixture-512e", sysfsRoot.path());
+        check(topology.logicalBlockSize == 512 && topology.physicalBlockSize == 4096, "512e: block sizes are read");
+
+        PartitionLayoutPlanner planner(topology, topology.logicalBlockSize);
+        check(planner.getAlignment() == MiB, "512e: aligned to 1 MiB");
+        check(planner.alignUp(34) == 2048, "512e: first partition starts at sector 2048");
+    }
+
+    {
+        DeviceTopology topology = DeviceTopology::read("/dev/fixture-4kn", sysfsRoot.path());
+        PartitionLayoutPlanner planner(topology, topology.logicalBlockSize);
+        check(planner.getAlignment() == MiB, "4Kn: aligned to 1 MiB");
+        check(planner.alignUp(6) == 256 && planner.alignDown(511) == 256, "4Kn: boundaries every 256 sectors");
+    }
+
+    {
+        DeviceTopology topology = DeviceTopology::read("/dev/fixture-offset", sysfsRoot.path());
+        check(topology.alignmentOffset == 3584, "alignment offset: offset is read");
+
+        PartitionLayoutPlanner planner(topology, topology.logicalBlockSize);
+        check(planner.getAlignment() == MiB, "alignment offset: aligned to 1 MiB");
+        check(planner.alignUp(34) == 2048 + 7, "alignment offset: boundaries shifted by 7 sectors");
+        check(planner.alignDown(2048 + 6) == 7, "alignment offset: alignDown stays on shifted boundaries");
+    }
+
+    {
+        DeviceTopology topology = DeviceTopology::read("/dev/fixture-bogus", sysfsRoot.path());
+        check(topology.optimalIoSize == 33553920, "bogus optimal I/O: value is read as reported");
+
+        PartitionLayoutPlanner planner(topology, topology.logicalBlockSize);
+        check(planner.getAlignment() == MiB, "bogus optimal I/O: ignored, aligned to 1 MiB");
+
+        SystemPartitionLayout layout = planner.planSystemPartitions(34, 8 * 1024 * 1024 * 2 - 34, 8 * 1024 * MiB - 64 * KiB, 256 * MiB);
+        check(layout.isValid() && layout.firstBootSector == 2048, "bogus optimal I/O: system partitions fit");
+    }
+
+    {
+        DeviceTopology topology = DeviceTopology::read("/dev/fixture-sdcard", sysfsRoot.path());
+        PartitionLayoutPlanner planner(topology, topology.logicalBlockSize);
+        check(planner.getAlignment() == 4 * MiB, "SD card: aligned to the 4 MiB erase block");
+    }
+
+    {
+        DeviceTopology topology = DeviceTopology::read("/dev/fixture-huge-erase", sysfsRoot.path());
+        PartitionLayoutPlanner planner(topology, topology.logicalBlockSize);
+        check(planner.getAlignment() == MiB, "64 MiB erase block: above the limit, aligned to 1 MiB");
+    }
+
+    {
+        DeviceTopology topology = DeviceTopology::read("/dev/fixture-missing", sysfsRoot.path());
+        PartitionLayoutPlanner planner(topology, 512);
+        check(planner.getAlignment() == MiB, "missing device: default topology, aligned to 1 MiB");
+    }
+
+    QTextStream(stdout) << (failures == 0 ? "All checks passed" : QString("%1 checks failed").arg(failures)) << Qt::endl;
+    return failures == 0 ? 0 : 1;
+}
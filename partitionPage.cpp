@@ -21,6 +21,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <kpmcore/core/partitiontable.h>
 #include <kpmcore/ops/newoperation.h>
 #include <kpmcore/ops/deleteoperation.h>
+#include <kpmcore/ops/resizeoperation.h>
 #include <kpmcore/ops/createpartitiontableoperation.h>
 #include <kpmcore/ops/createfilesystemoperation.h>
 #include <kpmcore/fs/fat32.h>
@@ -32,6 +33,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <QLineEdit>
 #include <cmath>
 #include <QDir>
+#include <QApplication>
 
 Q_DECLARE_METATYPE(Device*);
 
@@ -58,6 +60,13 @@ PartitionPage::PartitionPage(QWidget* parent) : QWidget(parent)
 
     connect(rescanDevicesButton, &QPushButton::clicked, this, [this](bool checked){
         scanDevices();
+        probeDevices();
+        detectOtherSystems();
+    });
+
+    // Devices are only preselected by the probe until the user picks one
+    connect(deviceCombobox, &QComboBox::activated, this, [this](int index){
+        deviceSelectedByUser = true;
     });
     
     deviceLayout->addWidget(deviceCombobox);
@@ -85,8 +94,10 @@ PartitionPage::PartitionPage(QWidget* parent) : QWidget(parent)
     deletePartitionButton = new QPushButton("Deletar partição");
     mountPartitionButton = new QPushButton("Montar partição");
     unmountPartitionButton = new QPushButton("Desmontar partição");
+    shrinkPartitionButton = new QPushButton("Reduzir partição");
     partitionFunctionButtons->addWidget(createPartitionButton);
     partitionFunctionButtons->addWidget(deletePartitionButton);
+    partitionFunctionButtons->addWidget(shrinkPartitionButton);
     partitionFunctionButtons->addWidget(mountPartitionButton);
     partitionFunctionButtons->addWidget(unmountPartitionButton);
     partitionLayout->addLayout(partitionFunctionButtons);
@@ -97,8 +108,17 @@ PartitionPage::PartitionPage(QWidget* parent) : QWidget(parent)
     createSystemPartitionsButton = new QPushButton("Criar partições do sistema");
 
 
+    // Planned operations are only applied to the devices when "Aplicar alterações" is clicked
+    applyOperationsButton = new QPushButton("Aplicar alterações");
+    discardOperationsButton = new QPushButton("Descartar alterações");
+    applyOperationsButton->setEnabled(false);
+    discardOperationsButton->setEnabled(false);
+
     functionButtons->addWidget(newPartitionTableButton);
     functionButtons->addWidget(createSystemPartitionsButton);
+    functionButtons->addStretch();
+    functionButtons->addWidget(discardOperationsButton);
+    functionButtons->addWidget(applyOperationsButton);
 
     deviceFormLayout->addRow(partitionLayout);
     deviceFormLayout->addRow(functionButtons);
@@ -106,8 +126,15 @@ PartitionPage::PartitionPage(QWidget* parent) : QWidget(parent)
     deletePartitionButton->setEnabled(false);
     mountPartitionButton->setEnabled(false);
     unmountPartitionButton->setEnabled(false);
+    shrinkPartitionButton->setEnabled(false);
     createSystemPartitionsButton->setEnabled(false);
 
+    connect(shrinkPartitionButton, &QPushButton::clicked, this, [this](bool checked)
+    {
+        shrinkPartitionButton->setEnabled(false);
+        PartitionPage::onShrinkPartitionButtonClicked(checked);
+    });
+
     connect(newPartitionTableButton, &QPushButton::clicked, this, [this](bool checked)
     {
         newPartitionTableButton->setEnabled(false);
@@ -158,6 +185,9 @@ PartitionPage::PartitionPage(QWidget* parent) : QWidget(parent)
         newPartitionTableButton->setEnabled(true);
     });
 
+    connect(applyOperationsButton, &QPushButton::clicked, this, &PartitionPage::onApplyOperationsButtonClicked);
+    connect(discardOperationsButton, &QPushButton::clicked, this, &PartitionPage::onDiscardOperationsButtonClicked);
+
     // System size spinbox
     systemSizeSpinbox = new QDoubleSpinBox;
     systemSizeSpinbox->setEnabled(false);
@@ -167,6 +197,132 @@ PartitionPage::PartitionPage(QWidget* parent) : QWidget(parent)
     systemSizeSpinbox->setValue(0.);
     spinboxFormLayout->addRow("Espaço utilizado pelo sistema:", systemSizeSpinbox);
 
+    // Root filesystem
+    QHBoxLayout* rootFileSystemLayout = new QHBoxLayout;
+    rootFileSystemCombobox = new QComboBox;
+    rootFileSystemCombobox->addItem("Ext4", static_cast<int>(FileSystem::Type::Ext4));
+    rootFileSystemCombobox->addItem("Btrfs (com subvolumes)", static_cast<int>(FileSystem::Type::Btrfs));
+    rootFileSystemCombobox->addItem("F2FS (cartões SD e eMMC)", static_cast<int>(FileSystem::Type::F2fs));
+    rootFileSystemCombobox->setCurrentIndex(0);
+
+    // Transparent compression reduces the bytes written during the installation, mostly noticeable on slow USB and SD targets
+    compressionCheckbox = new QCheckBox("Compressão transparente (zstd)");
+    compressionCheckbox->setChecked(true);
+    compressionCheckbox->setEnabled(false);
+
+    // A Btrfs root can be striped across several devices, adding up their throughput
+    stripeCheckbox = new QCheckBox("Distribuir o sistema em vários dispositivos (RAID0)");
+    stripeCheckbox->setChecked(false);
+    stripeCheckbox->setEnabled(false);
+
+    connect(rootFileSystemCombobox, &QComboBox::currentIndexChanged, this, [this](int index) {
+        bool isBtrfs = static_cast<FileSystem::Type>(rootFileSystemCombobox->itemData(index).toInt()) == FileSystem::Type::Btrfs;
+        compressionCheckbox->setEnabled(isBtrfs);
+        stripeCheckbox->setEnabled(isBtrfs);
+        if (!isBtrfs) stripeCheckbox->setChecked(false);
+    });
+
+    rootFileSystemLayout->addWidget(rootFileSystemCombobox);
+    rootFileSystemLayout->addWidget(compressionCheckbox);
+    spinboxFormLayout->addRow("Sistema de arquivos:", rootFileSystemLayout);
+
+    connect(rootFileSystemCombobox, &QComboBox::activated, this, [this]() { rootFileSystemSelectedByUser = true; });
+
+    // Media of the selected device, which the recommended filesystem and the tuning of the installed system depend on
+    storageMediaLabel = new QLabel;
+    spinboxFormLayout->addRow("Tipo de mídia:", storageMediaLabel);
+
+    // Other systems are added to the boot menu of the installed system
+    otherSystemsLabel = new QLabel;
+    otherSystemsLabel->setWordWrap(true);
+    spinboxFormLayout->addRow("Outros sistemas:", otherSystemsLabel);
+
+    spinboxFormLayout->addRow(stripeCheckbox);
+
+    stripeDevicesListWidget = new QListWidget;
+    stripeDevicesListWidget->setToolTip("Uma partição do mesmo tamanho da partição do sistema é criada no maior espaço livre de cada dispositivo marcado");
+    stripeDevicesListWidget->setMaximumHeight(100);
+    stripeDevicesListWidget->hide();
+    spinboxFormLayout->addRow(stripeDevicesListWidget);
+
+    connect(stripeCheckbox, &QCheckBox::toggled, this, [this](bool checked) {
+        stripeDevicesListWidget->setVisible(checked);
+        if (checked) updateStripeDevices();
+    });
+
+    // Filesystem creation profile
+    mkfsProfileCombobox = new QComboBox;
+    mkfsProfileCombobox->addItem("Instalação rápida (inicialização adiada para o primeiro uso)", QVariant::fromValue(MkfsProfile::FastInstall));
+    mkfsProfileCombobox->addItem("Totalmente inicializado (primeiro uso mais rápido)", QVariant::fromValue(MkfsProfile::FullyInitialized));
+    mkfsProfileCombobox->setCurrentIndex(0);
+    spinboxFormLayout->addRow("Formatação:", mkfsProfileCombobox);
+
+    discardCheckbox = new QCheckBox("Descartar (TRIM) os dados antigos do espaço das novas partições antes de formatar");
+    discardCheckbox->setChecked(false);
+    spinboxFormLayout->addRow(discardCheckbox);
+
+    // Encrypted root. The cipher is chosen by measuring the candidates on this machine.
+    encryptionCheckbox = new QCheckBox("Criptografar a partição do sistema (LUKS2)");
+    encryptionCheckbox->setChecked(false);
+    spinboxFormLayout->addRow(encryptionCheckbox);
+
+    QHBoxLayout* encryptionPassphraseLayout = new QHBoxLayout;
+    encryptionPassphraseLineEdit = new QLineEdit;
+    encryptionPassphraseLineEdit->setEchoMode(QLineEdit::Password);
+    encryptionPassphraseLineEdit->setPlaceholderText("Senha de criptografia");
+    encryptionPassphraseConfirmationLineEdit = new QLineEdit;
+    encryptionPassphraseConfirmationLineEdit->setEchoMode(QLineEdit::Password);
+    encryptionPassphraseConfirmationLineEdit->setPlaceholderText("Confirme a senha");
+    encryptionPassphraseLayout->addWidget(encryptionPassphraseLineEdit);
+    encryptionPassphraseLayout->addWidget(encryptionPassphraseConfirmationLineEdit);
+
+    encryptionPassphraseWidget = new QWidget;
+    encryptionPassphraseWidget->setLayout(encryptionPassphraseLayout);
+    encryptionPassphraseWidget->hide();
+    spinboxFormLayout->addRow(encryptionPassphraseWidget);
+
+    encryptionCipherLabel = new QLabel;
+    encryptionCipherLabel->hide();
+    spinboxFormLayout->addRow(encryptionCipherLabel);
+
+    connect(encryptionCheckbox, &QCheckBox::toggled, this, [this](bool checked) {
+        encryptionPassphraseWidget->setVisible(checked);
+        encryptionCipherLabel->setVisible(checked);
+
+        // The ciphers are only measured once, and only if encryption is wanted
+        if (checked && !cipherBenchmark)
+        {
+            cipherBenchmark = new CipherBenchmark(this);
+            connect(cipherBenchmark, &CipherBenchmark::finished, this, [this]() {
+                CipherCandidate cipher = cipherBenchmark->selectedCipher();
+                if (cipher.measured)
+                {
+                    encryptionCipherLabel->setText(QString("Cifra: %1 (%2 bits), %3 MiB/s neste computador")
+                        .arg(cipher.description).arg(cipher.keySize).arg(cipher.throughputMiBps(), 0, 'f', 0));
+                } else {
+                    encryptionCipherLabel->setText(QString("Cifra: %1 (%2 bits)").arg(cipher.description).arg(cipher.keySize));
+                }
+            });
+
+            encryptionCipherLabel->setText("Medindo o desempenho das cifras neste computador...");
+            cipherBenchmark->start();
+        }
+    });
+
+    // Status of the system partitions creation
+    QHBoxLayout* systemPartitionsStatusLayout = new QHBoxLayout;
+    systemPartitionsStatusLayout->setAlignment(Qt::AlignHCenter);
+    systemPartitionsStatusIndicator = new StatusIndicator;
+    systemPartitionsStatusLabel = new QLabel;
+    systemPartitionsStatusLabel->hide();
+    systemPartitionsStatusLayout->addWidget(systemPartitionsStatusIndicator);
+    systemPartitionsStatusLayout->addWidget(systemPartitionsStatusLabel);
+    systemPartitionsProgressBar = new QProgressBar;
+    systemPartitionsProgressBar->setRange(0, 100);
+    systemPartitionsProgressBar->hide();
+    layout->addWidget(systemPartitionsProgressBar);
+    layout->addLayout(systemPartitionsStatusLayout);
+
     page->addLayout(layout);
 }
 
@@ -203,6 +359,99 @@ void PartitionPage::initialize()
     connect(partitionTableWidget, &QTableWidget::currentItemChanged, this, &PartitionPage::onPartitionItemChanged);
     deviceCombobox->setCurrentIndex(0);
     onDeviceChanged(0);
+
+    probeDevices();
+    detectOtherSystems();
+}
+
+void PartitionPage::detectOtherSystems()
+{
+    if (!osProber)
+    {
+        osProber = new OsProber(this);
+        connect(osProber, &OsProber::finished, this, [this](bool success) {
+            QStringList systems = osProber->detectedSystems();
+            otherSystemsLabel->setText(systems.isEmpty() ? "Nenhum" : systems.join(", "));
+            if (!success) qWarning() << "Could not cache the detected operating systems";
+        });
+    }
+
+    otherSystemsLabel->setText("Detectando...");
+    osProber->start();
+}
+
+void PartitionPage::probeDevices()
+{
+    if (deviceProbe) return;
+
+    deviceProbe = new DeviceProbe(this);
+
+    // Devices are probed once, their results are kept across rescans
+    for (int i = 0; i < deviceCombobox->count(); i++)
+    {
+        Device* device = deviceCombobox->itemData(i).value<Device*>();
+        if (device && !deviceProbeResults.contains(device->deviceNode()))
+        {
+            deviceProbe->addDevice(device->deviceNode());
+        }
+    }
+
+    qRegisterMetaType<DeviceProbeResult>();
+    connect(deviceProbe, &DeviceProbe::deviceProbed, this, &PartitionPage::onDeviceProbed);
+    connect(deviceProbe, &QThread::finished, this, &PartitionPage::onDevicesProbed);
+
+    deviceProbe->start(QThread::LowPriority);
+}
+
+void PartitionPage::onDeviceProbed(const DeviceProbeResult& result)
+{
+    deviceProbeResults.insert(result.deviceNode, result);
+
+    for (int i = 0; i < deviceCombobox->count(); i++)
+    {
+        Device* device = deviceCombobox->itemData(i).value<Device*>();
+        if (device && device->deviceNode() == result.deviceNode)
+        {
+            deviceCombobox->setItemText(i, getDeviceItemText(device));
+        }
+    }
+}
+
+void PartitionPage::onDevicesProbed()
+{
+    deviceProbe->deleteLater();
+    deviceProbe = nullptr;
+
+    // Do not change the device under the user, or while operations are planned on it
+    if (deviceSelectedByUser || operationStack->size() > 0) return;
+
+    int fastestIndex = -1;
+    double fastestWorkloadSeconds = 0.;
+
+    for (int i = 0; i < deviceCombobox->count(); i++)
+    {
+        Device* device = deviceCombobox->itemData(i).value<Device*>();
+
+        // Only devices that can hold the system are suitable. Devices in use, such as the live USB stick whose low
+        // latency would otherwise beat an HDD, are left for the user to choose.
+        if (!device || device->capacity() < minimumSystemSize || !deviceProbeResults.contains(device->deviceNode())) continue;
+        if (isDeviceInUse(device)) continue;
+
+        double workloadSeconds = deviceProbeResults.value(device->deviceNode()).estimatedWorkloadSeconds();
+        if (workloadSeconds < 0.) continue;
+
+        if (fastestIndex == -1 || workloadSeconds < fastestWorkloadSeconds)
+        {
+            fastestIndex = i;
+            fastestWorkloadSeconds = workloadSeconds;
+        }
+    }
+
+    if (fastestIndex >= 0 && fastestIndex != deviceCombobox->currentIndex())
+    {
+        qDebug() << "Preselecting the fastest device" << deviceCombobox->itemData(fastestIndex).value<Device*>()->deviceNode();
+        deviceCombobox->setCurrentIndex(fastestIndex);
+    }
 }
 
 void PartitionPage::scanDevices()
@@ -233,7 +482,7 @@ void PartitionPage::scanDevices()
 
     // Repopulate the combobox
     for (Device* device : devices) {
-        deviceCombobox->addItem(device->deviceNode() + " (" + getSize(device) + ")", QVariant::fromValue(device));
+        deviceCombobox->addItem(getDeviceItemText(device), QVariant::fromValue(device));
     }
 
     // Restore the previously selected device
@@ -268,9 +517,7 @@ void PartitionPage::runOperations()
 
         delete childReport;
     }
-    qDebug() << "Finished all operations. Clearing operation stack";
-    operationStack->clearOperations();
-    qDebug() << "Operation stack is clear";
+    qDebug() << "Finished all operations";
 }
 
 void PartitionPage::updatePartitionTable()
@@ -304,7 +551,12 @@ void PartitionPage::updatePartitionTable()
         const QString partSizeGb = getSize(part);
         QString partMountpoint;
 
-        if (part->isMounted())
+        bool partIsPending = part->state() == Partition::State::New;
+
+        if (partIsPending)
+        {
+            partMountpoint = "Pendente";
+        } else if (part->isMounted())
         {
             partMountpoint = FileSystem::detectMountPoint(&part->fileSystem(), part->deviceNode());
         } else {
@@ -332,9 +584,131 @@ void PartitionPage::updatePartitionTable()
         partitionTableWidget->setItem(row, 2, partTypeItem);
         partitionTableWidget->setItem(row, 3, partSizeItem);
         partitionTableWidget->setItem(row, 4, partMountpointItem);
+
+        // Partitions that only exist in the plan are shown in italic until the operations are applied
+        if (partIsPending)
+        {
+            for (int column = 0; column < partitionTableWidget->columnCount(); column++)
+            {
+                QFont pendingFont = partitionTableWidget->item(row, column)->font();
+                pendingFont.setItalic(true);
+                partitionTableWidget->item(row, column)->setFont(pendingFont);
+            }
+        }
     }
 
     partitionTableWidget->resizeColumnsToContents();
+
+    // The free space of the other devices changes with the plan too
+    if (stripeCheckbox->isChecked()) updateStripeDevices();
+}
+
+void PartitionPage::updateStripeDevices()
+{
+    // Keep the devices the user already checked
+    QStringList checkedDeviceNodes;
+    for (int row = 0; row < stripeDevicesListWidget->count(); row++)
+    {
+        QListWidgetItem* item = stripeDevicesListWidget->item(row);
+        if (item->checkState() == Qt::Checked) checkedDeviceNodes << item->data(deviceRole).toString();
+    }
+
+    stripeDevicesListWidget->clear();
+
+    Device* selectedDevice = getSelectedDevice();
+
+    for (Device* device : operationStack->previewDevices())
+    {
+        if (!device || device == selectedDevice) continue;
+
+        Partition* freeSpace = findLargestUnallocated(device);
+        QString text = getDeviceItemText(device) + " — maior espaço livre: " + (freeSpace ? getSize(freeSpace) : QString("nenhum"));
+
+        QListWidgetItem* item = new QListWidgetItem(text, stripeDevicesListWidget);
+        item->setData(deviceRole, device->deviceNode());
+        item->setFlags(freeSpace ? item->flags() | Qt::ItemIsUserCheckable : item->flags() & ~Qt::ItemIsEnabled);
+        item->setCheckState(freeSpace && checkedDeviceNodes.contains(device->deviceNode()) ? Qt::Checked : Qt::Unchecked);
+    }
+}
+
+bool PartitionPage::planStripePartitions(qint64 rootLength, QString& errorMessage)
+{
+    QList<NewOperation*> stripeOperations;
+    QList<Partition*> stripePartitions;
+
+    for (int row = 0; row < stripeDevicesListWidget->count(); row++)
+    {
+        QListWidgetItem* item = stripeDevicesListWidget->item(row);
+        if (item->checkState() != Qt::Checked) continue;
+
+        Device* device = findDevice(item->data(deviceRole).toString());
+        Partition* freeSpace = findLargestUnallocated(device);
+
+        if (!device || !freeSpace)
+        {
+            errorMessage = "O dispositivo " + item->data(deviceRole).toString() + " não possui espaço livre.";
+            break;
+        }
+
+        if (device->partitionTable()->typeName() == "msdos" && countPrimaryPartitions(device) >= 4)
+        {
+            errorMessage = "O dispositivo " + device->deviceNode() + " já possui 4 partições primárias.";
+            break;
+        }
+
+        // Every stripe has the size of the root partition. RAID0 only stripes over the space all devices have,
+        // so a larger stripe would leave space that is never used.
+        PartitionLayoutPlanner layoutPlanner(DeviceTopology::read(device->deviceNode()), freeSpace->sectorSize());
+        qint64 firstSector = layoutPlanner.alignUp(freeSpace->firstSector());
+        qint64 lastSector = firstSector + rootLength / freeSpace->sectorSize() - 1;
+
+        if (lastSector > freeSpace->lastSector())
+        {
+            errorMessage = "O maior espaço livre de " + device->deviceNode() + " (" + getSize(freeSpace)
+                + ") é menor do que a partição do sistema (" + QString::number(static_cast<double>(rootLength) / GiB, 'f', 2) + " GiB).";
+            break;
+        }
+
+        PartitionTable::Flags availableFlags;
+        for (PartitionTable::Flag _flag : device->partitionTable()->flagList())
+        {
+            availableFlags |= _flag;
+        }
+
+        Partition* stripePartition = new Partition(
+            device->partitionTable(),
+            *device,
+            PartitionRole(PartitionRole::Primary),
+            FileSystemFactory::create(FileSystem::Type::Unformatted, firstSector, lastSector, freeSpace->sectorSize()),
+            firstSector, lastSector,
+            determineNewPartitionNodePath(device->deviceNode(), countPrimaryPartitions(device) + 1),
+            availableFlags,
+            QString(),
+            false,
+            PartitionTable::Flag::None
+        );
+        stripePartition->setLabel("DelphinOS Root Stripe");
+
+        stripePartitions << stripePartition;
+        stripeOperations << new NewOperation(*device, stripePartition);
+    }
+
+    if (!errorMessage.isEmpty() || stripeOperations.isEmpty())
+    {
+        if (errorMessage.isEmpty()) errorMessage = "Selecione ao menos um dispositivo adicional para distribuir o sistema.";
+
+        // Operations that were never pushed still own their partitions
+        qDeleteAll(stripeOperations);
+        return false;
+    }
+
+    for (NewOperation* operation : stripeOperations)
+    {
+        operationStack->push(operation);
+    }
+    newStripePartitions = stripePartitions;
+
+    return true;
 }
 
 void PartitionPage::onDeviceChanged(int index)
@@ -351,6 +725,15 @@ void PartitionPage::onDeviceChanged(int index)
         return;
     }
 
+    StorageMedia media = StorageAdvisor::classify(device->deviceNode());
+    FileSystem::Type recommendedFileSystem = StorageAdvisor::rootFileSystem(media);
+    storageMediaLabel->setText(StorageAdvisor::mediaName(media) + " — recomendado: " + FileSystem::nameForType(recommendedFileSystem));
+
+    if (!rootFileSystemSelectedByUser)
+    {
+        int recommendedIndex = rootFileSystemCombobox->findData(static_cast<int>(recommendedFileSystem));
+        if (recommendedIndex != -1) rootFileSystemCombobox->setCurrentIndex(recommendedIndex);
+    }
 
     updatePartitionTable();
 }
@@ -379,6 +762,7 @@ void PartitionPage::onPartitionItemChanged(const QTableWidgetItem* currentItem,
         deletePartitionButton->setEnabled(false);
         mountPartitionButton->setEnabled(false);
         unmountPartitionButton->setEnabled(false);
+        shrinkPartitionButton->setEnabled(false);
 
         maxSystemSizeBytes = partition->capacity(); // Full precision maximum size
         maxSystemSizeRoundedGib = std::round((static_cast<double>(maxSystemSizeBytes) / static_cast<double>(GiB)) * 100.0) / 100.0; // Rounded maximum size
@@ -388,8 +772,14 @@ void PartitionPage::onPartitionItemChanged(const QTableWidgetItem* currentItem,
     } else {
         createPartitionButton->setEnabled(false);
         deletePartitionButton->setEnabled(true);
-        mountPartitionButton->setEnabled(true);
-        unmountPartitionButton->setEnabled(true);
+
+        // Partitions that only exist in the plan can not be mounted yet
+        bool partitionExists = partition->state() != Partition::State::New;
+        mountPartitionButton->setEnabled(partitionExists);
+        unmountPartitionButton->setEnabled(partitionExists);
+
+        // Filesystems that can only be shrunk offline must be unmounted first
+        shrinkPartitionButton->setEnabled(partitionExists && ResizeOperation::canShrink(partition));
 
         maxSystemSizeBytes = 0;
         maxSystemSizeRoundedGib = 0.;
@@ -514,10 +904,8 @@ void PartitionPage::onCreatePartitionButtonClicked(bool checked)
     qDebug() << "Pushing the operations to create partitions to the operation stack";
     operationStack->push(createPartition);
 
-    runOperations();
-
-    newFileSystem->create(*rootReport, partitionNode);
-
+    // The filesystem is created by the NewOperation when the operations are applied
+    updatePlanButtons();
     updatePartitionTable();
 }
 
@@ -542,50 +930,45 @@ void PartitionPage::onDeletePartitionButtonClicked(bool checked)
     partitionTableWidget->clearContents();
     partitionTableWidget->setRowCount(0);
 
-    // If the selected partition to delete is from DelphinOS, delete both partitions
+    // If the selected partition to delete is from DelphinOS, delete all of its partitions
     if (newBootPartition && newRootPartition)
     {
         qDebug() << "newBootPartition and newRootPartition found";
-        if (partition->deviceNode() == newBootPartition->deviceNode() || partition->deviceNode() == newRootPartition->deviceNode())
+        if (isSystemPartition(partition))
         {
+            QStringList systemDeviceNodes = QStringList{ newBootPartition->deviceNode() } + getRootStripeDeviceNodes();
+
             // Wait for user confirmation before deleting partition
             QMessageBox::StandardButtons warning;
             warning = QMessageBox::warning(this, "Atenção", "Essa operação irá deletar as partições do DelphinOS "
-                + newBootPartition->deviceNode() + " e " + newRootPartition->deviceNode() + ".\n\nDeseja continuar?", QMessageBox::Ok | QMessageBox::Cancel); 
+                + systemDeviceNodes.join(", ") + ".\n\nDeseja continuar?", QMessageBox::Ok | QMessageBox::Cancel); 
 
             if (warning == QMessageBox::Cancel) return;
 
-            DeleteOperation* deleteNewBootPartitionOperation = new DeleteOperation(*device, newBootPartition);
-            DeleteOperation* deleteNewRootPartitionOperation = new DeleteOperation(*device, newRootPartition);
+            // The system partitions are all on the selected device, except for the stripes of a multi-device root
+            Device* systemDevice = findDevice(newRootPartition->devicePath());
+            if (!systemDevice) systemDevice = device;
 
-            // Unmount partitions for deletion
-            if (newRootPartition->isMounted())
-            {
-                if (!newRootPartition->unmount(*rootReport))
-                {
-                    qWarning() << "Could not unmount newRootPartition";
-                    updatePartitionTable();
-                    return;
-                }
-            }
-
-            if (newBootPartition->isMounted())
-            {
-                if (!newBootPartition->unmount(*rootReport))
-                {
-                    qWarning() << "Could not unmount newBootPartition";
-                    updatePartitionTable();
-                    return;
-                }
-            }
+            DeleteOperation* deleteNewBootPartitionOperation = new DeleteOperation(*systemDevice, newBootPartition);
+            DeleteOperation* deleteNewRootPartitionOperation = new DeleteOperation(*systemDevice, newRootPartition);
 
+            // Partitions are unmounted when the operations are applied. Deleting system partitions that were only
+            // planned cancels their creation.
             operationStack->push(deleteNewBootPartitionOperation);
             operationStack->push(deleteNewRootPartitionOperation);
 
-            runOperations();
-            updatePartitionTable();
+            for (Partition* stripePartition : newStripePartitions)
+            {
+                Device* stripeDevice = findDevice(stripePartition->devicePath());
+                if (stripeDevice) operationStack->push(new DeleteOperation(*stripeDevice, stripePartition));
+            }
+            newStripePartitions.clear();
 
+            systemPartitionsPending = false;
             newSystemPartitionsDeleted = true;
+
+            updatePlanButtons();
+            updatePartitionTable();
             return;
         }
     }
@@ -597,18 +980,10 @@ void PartitionPage::onDeletePartitionButtonClicked(bool checked)
     QMessageBox::StandardButtons warning;
     warning = QMessageBox::warning(this, "Atenção", "Essa operação irá deletar a partição " + partition->deviceNode() + " de " + getSize(partition) + ".\n\nDeseja continuar?", QMessageBox::Ok | QMessageBox::Cancel); 
 
-    if (warning == QMessageBox::Cancel) return;
-
-    qDebug() << "Unmounting partition" << partition->deviceNode();
-    // Unmount partitions for deletion
-    if (partition->isMounted())
+    if (warning == QMessageBox::Cancel)
     {
-        if (!partition->unmount(*rootReport))
-        {
-            qWarning() << "Could not unmount" << partition->deviceNode();
-            updatePartitionTable();
-            return;
-        }
+        updatePartitionTable();
+        return;
     }
 
     qDebug() << "Creating delete operation";
@@ -617,11 +992,183 @@ void PartitionPage::onDeletePartitionButtonClicked(bool checked)
     qDebug() << "Pushing delete operation to operation stack";
     operationStack->push(deleteOperation);
 
-    qDebug() << "Running delete operation";
-    runOperations();
+    updatePlanButtons();
+    updatePartitionTable();
+}
+
+void PartitionPage::onShrinkPartitionButtonClicked(bool checked)
+{
+    Partition* partition = getSelectedPartition();
+    Device* device = getSelectedDevice();
+
+    if (!partition || !device)
+    {
+        qWarning() << "onShrinkPartitionButtonClicked(): Invalid partition or device pointer";
+        return;
+    }
+
+    if (shrinkProbe) return;
+
+    const qint64 length = partition->capacity();
+    const qint64 usedBytes = partition->fileSystem().sectorsUsed() > 0 ? partition->fileSystem().sectorsUsed() * partition->sectorSize() : length;
+
+    // Reading the used blocks of a large filesystem takes a moment, so it is done in the background
+    // and the dialog is shown once it finished
+    shrinkProbe = new ShrinkProbe(ShrinkPlanner(partition->deviceNode(), partition->fileSystem().type(), length, usedBytes,
+        partition->fileSystem().minCapacity()), device->deviceNode(), this);
+    connect(shrinkProbe, &QThread::finished, this, &PartitionPage::onShrinkPartitionProbed);
+
+    setPartitioningEnabled(false);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    shrinkProbe->start();
+}
+
+void PartitionPage::onShrinkPartitionProbed()
+{
+    QApplication::restoreOverrideCursor();
+    setPartitioningEnabled(true);
+
+    const ShrinkPlanner shrinkPlanner = shrinkProbe->getPlanner();
+    Device* device = findDevice(shrinkProbe->getDeviceNode());
+    Partition* partition = findPartition(shrinkPlanner.getDeviceNode());
+
+    shrinkProbe->deleteLater();
+    shrinkProbe = nullptr;
+
+    if (!partition || !device)
+    {
+        qWarning() << "onShrinkPartitionProbed(): The partition is gone";
+        updatePartitionTable();
+        return;
+    }
+
+    const qint64 sectorSize = partition->sectorSize();
+    const qint64 length = partition->capacity();
+
+    // The start of the partition stays in place, only its end moves to an aligned sector
+    PartitionLayoutPlanner layoutPlanner(DeviceTopology::read(device->deviceNode()), sectorSize);
+    auto alignedLength = [&](qint64 requestedLength) {
+        qint64 newLastSector = layoutPlanner.alignDown(partition->firstSector() + requestedLength / sectorSize) - 1;
+        return (newLastSector - partition->firstSector() + 1) * sectorSize;
+    };
+
+    if (alignedLength(length) - shrinkPlanner.getMinimumLength() < GiB)
+    {
+        QMessageBox::warning(this, "Atenção", "A partição " + partition->deviceNode() + " não tem espaço livre suficiente para ser reduzida.", QMessageBox::Ok);
+        return;
+    }
+
+    // Throughput measured by the device probe, or a conservative estimate for HDDs
+    const double bytesPerSecond = deviceProbeResults.value(device->deviceNode()).valid
+        ? deviceProbeResults.value(device->deviceNode()).sequentialBytesPerSecond : 100e6;
+
+    QPointer<QDialog> shrinkDialog = new QDialog(this);
+    shrinkDialog->setWindowTitle("Reduzir partição " + partition->deviceNode());
+    QVBoxLayout* dialogLayout = new QVBoxLayout;
+    QFormLayout* dialogForm = new QFormLayout;
+
+    QDoubleSpinBox* newSizeSpinbox = new QDoubleSpinBox;
+    newSizeSpinbox->setDecimals(2);
+    newSizeSpinbox->setSuffix("GiB");
+    newSizeSpinbox->setRange(std::ceil(static_cast<double>(shrinkPlanner.getMinimumLength()) / GiB * 100.) / 100.,
+        std::floor(static_cast<double>(alignedLength(length) - GiB) / GiB * 100.) / 100.);
+
+    // Default to the end that moves the least data, rounded up so the aligned end stays beyond the used blocks
+    const qint64 leastMoveLength = shrinkPlanner.leastMoveLength(shrinkPlanner.getMinimumLength(), alignedLength(length) - GiB);
+    newSizeSpinbox->setValue(std::ceil(static_cast<double>(alignedLength(leastMoveLength + layoutPlanner.getAlignment())) / GiB * 100.) / 100.);
+    dialogForm->addRow("Novo tamanho:", newSizeSpinbox);
+
+    QLabel* estimateLabel = new QLabel;
+    estimateLabel->setWordWrap(true);
+    dialogForm->addRow(estimateLabel);
+
+    // Show how much data the chosen size moves and how long it takes
+    auto updateEstimate = [&, estimateLabel](double newSizeGib) {
+        qint64 newLength = alignedLength(static_cast<qint64>(newSizeGib * GiB));
+        qint64 moveBytes = shrinkPlanner.bytesToMove(newLength);
+        double moveSeconds = ShrinkPlanner::estimateMoveSeconds(moveBytes, bytesPerSecond);
+
+        estimateLabel->setText(QString("Espaço liberado: %1 GiB\nDados a mover: %2 GiB%3\nTempo estimado: %4 min")
+            .arg(static_cast<double>(length - newLength) / GiB, 0, 'f', 2)
+            .arg(static_cast<double>(moveBytes) / GiB, 0, 'f', 2)
+            .arg(shrinkPlanner.isExact() ? "" : " (estimativa)")
+            .arg(std::ceil(moveSeconds / 60.), 0, 'f', 0));
+    };
+    connect(newSizeSpinbox, &QDoubleSpinBox::valueChanged, shrinkDialog, updateEstimate);
+    updateEstimate(newSizeSpinbox->value());
+
+    QDialogButtonBox* dialogButtons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    dialogLayout->addLayout(dialogForm);
+    dialogLayout->addWidget(dialogButtons);
+    shrinkDialog->setLayout(dialogLayout);
+
+    connect(dialogButtons, &QDialogButtonBox::accepted, shrinkDialog, &QDialog::accept);
+    connect(dialogButtons, &QDialogButtonBox::rejected, shrinkDialog, &QDialog::reject);
+
+    if (shrinkDialog->exec() != QDialog::Accepted)
+    {
+        delete shrinkDialog;
+        updatePartitionTable();
+        return;
+    }
+
+    const qint64 newLength = alignedLength(static_cast<qint64>(newSizeSpinbox->value() * GiB));
+    const qint64 newLastSector = partition->firstSector() + newLength / sectorSize - 1;
+    delete shrinkDialog;
+
+    if (newLastSector <= partition->firstSector() || newLastSector >= partition->lastSector())
+    {
+        qWarning() << "Invalid new end" << newLastSector << "for" << partition->deviceNode();
+        updatePartitionTable();
+        return;
+    }
+
+    ResizeOperation* resizeOperation = new ResizeOperation(*device, *partition, partition->firstSector(), newLastSector);
+
+    plannedMoveBytes += shrinkPlanner.bytesToMove(newLength);
+    if (!plannedMoveDeviceNodes.contains(device->deviceNode())) plannedMoveDeviceNodes.append(device->deviceNode());
+
+    operationStack->push(resizeOperation);
+
+    updatePlanButtons();
     updatePartitionTable();
 }
 
+void PartitionPage::startMoveProgress()
+{
+    // The filesystem resizers do not report their progress, so it is measured from the bytes written to the devices
+    moveProgressStartBytes = 0;
+    for (const QString& deviceNode : plannedMoveDeviceNodes)
+    {
+        moveProgressStartBytes += std::max<qint64>(0, ShrinkPlanner::deviceBytesWritten(deviceNode));
+    }
+    moveProgressElapsed.start();
+
+    systemPartitionsProgressBar->setValue(0);
+    systemPartitionsProgressBar->show();
+    systemPartitionsStatusIndicator->setStatus(StatusIndicator::Loading);
+    systemPartitionsStatusLabel->setText("Movendo dados");
+    systemPartitionsStatusLabel->show();
+
+    moveProgressTimer = new QTimer(this);
+    connect(moveProgressTimer, &QTimer::timeout, this, [this]() {
+        qint64 writtenBytes = -moveProgressStartBytes;
+        for (const QString& deviceNode : plannedMoveDeviceNodes)
+        {
+            writtenBytes += std::max<qint64>(0, ShrinkPlanner::deviceBytesWritten(deviceNode));
+        }
+        writtenBytes = std::max<qint64>(0, writtenBytes);
+
+        double bytesPerSecond = writtenBytes / std::max(moveProgressElapsed.elapsed() / 1000., 0.001);
+        systemPartitionsProgressBar->setValue(static_cast<int>(std::min<qint64>(100, writtenBytes * 100 / plannedMoveBytes)));
+        systemPartitionsStatusLabel->setText(QString("Movendo dados (%1 de %2 GiB, %3 MB/s)")
+            .arg(static_cast<double>(writtenBytes) / GiB, 0, 'f', 2)
+            .arg(static_cast<double>(plannedMoveBytes) / GiB, 0, 'f', 2)
+            .arg(bytesPerSecond / 1e6, 0, 'f', 0));
+    });
+    moveProgressTimer->start(500);
+}
+
 void PartitionPage::onMountPartitionButtonClicked(bool checked)
 {
     Partition* partition = getSelectedPartition();
@@ -690,7 +1237,7 @@ void PartitionPage::onUnmountPartitionButtonClicked(bool checked)
 
     if (newBootPartition && newRootPartition)
     {
-        if (partition->deviceNode() == newBootPartition->deviceNode() || partition->deviceNode() == newRootPartition->deviceNode())
+        if (isSystemPartition(partition))
         {
             // Wait for user confirmation before deleting partition
             QMessageBox::critical(this, "Erro", "Não é possível desmontar uma partição do sistema DelphinOS pois isso irá impedir a instalação.", QMessageBox::Ok); 
@@ -773,8 +1320,7 @@ void PartitionPage::onNewPartitionTableButtonClicked(bool checked)
     }
 
     operationStack->push(createPartitionTableOperation);
-    runOperations();
-    scanDevices();
+    updatePlanButtons();
     updatePartitionTable();
 }
 
@@ -785,6 +1331,7 @@ void PartitionPage::onCreateSystemPartitionsButtonClicked(bool checked)
         qDebug() << "Resetting newBootPartition and newRootPartition pointers";
         newBootPartition = nullptr;
         newRootPartition = nullptr;
+        newStripePartitions.clear();
         qDebug() << "Successfully reset newBootPartition and newRootPartition pointers";
         newSystemPartitionsDeleted = false;
     } else if (newBootPartition || newRootPartition)
@@ -860,19 +1407,31 @@ void PartitionPage::onCreateSystemPartitionsButtonClicked(bool checked)
     
     // Create new partitions for the system
 
-    qint64 firstBootSector = partition->firstSector();
-    qint64 lastBootSector = partition->firstSector() + (MiB * 256) / partition->sectorSize() - 1;
-    qint64 firstRootSector = lastBootSector + 1;
-    qint64 lastRootSector = systemSize / partition->sectorSize();
+    // Align the partitions to the erase block and I/O size of the device
+    PartitionLayoutPlanner layoutPlanner(DeviceTopology::read(device->deviceNode()), partition->sectorSize());
+    SystemPartitionLayout systemLayout = layoutPlanner.planSystemPartitions(partition->firstSector(), partition->lastSector(), systemSize, MiB * 256);
+
+    if (!systemLayout.isValid())
+    {
+        QMessageBox::critical(this, "Erro", "Não foi possível alinhar as partições do sistema ao espaço livre selecionado de " + getSize(partition) + ".", QMessageBox::Ok);
+        return;
+    }
+
+    qint64 firstBootSector = systemLayout.firstBootSector;
+    qint64 lastBootSector = systemLayout.lastBootSector;
+    qint64 firstRootSector = systemLayout.firstRootSector;
+    qint64 lastRootSector = systemLayout.lastRootSector;
 
     QString bootDeviceNode = determineNewPartitionNodePath(device->deviceNode(), countPrimaryPartitions(device) + 1);
     QString rootDeviceNode = determineNewPartitionNodePath(device->deviceNode(), countPrimaryPartitions(device) + 2);
 
-    FileSystem* newBootFs = FileSystemFactory::create(FileSystem::Type::Fat32,
+    // The partitions are created unformatted. Their filesystems are created afterwards by FileSystemFormatter, concurrently
+    // and with the selected mkfs profile, instead of sequentially by the NewOperation jobs.
+    FileSystem* newBootFs = FileSystemFactory::create(FileSystem::Type::Unformatted,
         firstBootSector, lastBootSector, partition->sectorSize()
     );
         
-    FileSystem* newRootFs = FileSystemFactory::create(FileSystem::Type::Ext4,
+    FileSystem* newRootFs = FileSystemFactory::create(FileSystem::Type::Unformatted,
         firstRootSector, lastRootSector, partition->sectorSize()
     );
         
@@ -932,36 +1491,557 @@ void PartitionPage::onCreateSystemPartitionsButtonClicked(bool checked)
         return;
     }
 
+    // The stripes of a multi-device root are planned first, so nothing is pushed if any of them does not fit
+    if (stripeCheckbox->isChecked())
+    {
+        QString stripeError;
+        if (!planStripePartitions(newRootPartition->capacity(), stripeError))
+        {
+            QMessageBox::critical(this, "Erro", "Não foi possível distribuir o sistema em vários dispositivos.\n\n" + stripeError, QMessageBox::Ok);
+            delete createBootPartition;
+            delete createRootPartition;
+            newBootPartition = nullptr;
+            newRootPartition = nullptr;
+            newSystemPartitionsDeleted = true;
+            return;
+        }
+    }
+
     qDebug() << "Pushing the operations to create partitions to the operation stack";
     operationStack->push(createBootPartition);
     operationStack->push(createRootPartition);
 
-    runOperations();
+    // The partitions are discarded, formatted and mounted after the plan is applied
+    systemPartitionsPending = true;
 
-    newRootFs->create(*rootReport, rootDeviceNode);
-    newBootFs->create(*rootReport, bootDeviceNode);
+    systemPartitionsStatusIndicator->setStatus(StatusIndicator::Warning);
+    systemPartitionsStatusLabel->setText("Partições do sistema planejadas. Clique em \"Aplicar alterações\" para criá-las");
+    systemPartitionsStatusLabel->show();
 
+    updatePlanButtons();
+    updatePartitionTable();
+}
+
+void PartitionPage::updatePlanButtons()
+{
+    bool hasPlannedOperations = operationStack && operationStack->size() > 0;
+    applyOperationsButton->setEnabled(hasPlannedOperations);
+    discardOperationsButton->setEnabled(hasPlannedOperations);
+
+    // Rescanning the devices would drop the plan
+    rescanDevicesButton->setEnabled(!hasPlannedOperations);
+
+    // The installation can only continue once the plan is applied and the system partitions are mounted
+    page->setCanAdvance(!hasPlannedOperations && !newSystemPartitionsDeleted && newBootPartition && newRootPartition
+        && newBootPartition->isMounted() && newRootPartition->isMounted());
+}
+
+void PartitionPage::setPartitioningEnabled(bool enabled)
+{
+    deviceCombobox->setEnabled(enabled);
+    rescanDevicesButton->setEnabled(enabled);
+    partitionTableWidget->setEnabled(enabled);
+    newPartitionTableButton->setEnabled(enabled);
+    rootFileSystemCombobox->setEnabled(enabled);
+    compressionCheckbox->setEnabled(enabled && static_cast<FileSystem::Type>(rootFileSystemCombobox->currentData().toInt()) == FileSystem::Type::Btrfs);
+    stripeCheckbox->setEnabled(enabled && static_cast<FileSystem::Type>(rootFileSystemCombobox->currentData().toInt()) == FileSystem::Type::Btrfs);
+    stripeDevicesListWidget->setEnabled(enabled);
+    mkfsProfileCombobox->setEnabled(enabled);
+    discardCheckbox->setEnabled(enabled);
+    encryptionCheckbox->setEnabled(enabled);
+    encryptionPassphraseWidget->setEnabled(enabled);
+
+    // Buttons that depend on the selected partition are enabled again by onPartitionItemChanged
+    if (!enabled)
+    {
+        createPartitionButton->setEnabled(false);
+        deletePartitionButton->setEnabled(false);
+        mountPartitionButton->setEnabled(false);
+        unmountPartitionButton->setEnabled(false);
+        shrinkPartitionButton->setEnabled(false);
+        createSystemPartitionsButton->setEnabled(false);
+        applyOperationsButton->setEnabled(false);
+        discardOperationsButton->setEnabled(false);
+    } else {
+        updatePlanButtons();
+    }
+}
+
+bool PartitionPage::validateOperations(QString& errorMessage)
+{
+    if (operationStack->size() == 0)
+    {
+        errorMessage = "Nenhuma operação foi planejada.";
+        return false;
+    }
+
+    // The preview devices already reflect every planned operation, so their partitions must not overlap
+    for (Device* device : operationStack->previewDevices())
+    {
+        if (!device || !device->partitionTable()) continue;
+
+        qint64 previousLastSector = -1;
+        for (const Partition* part : device->partitionTable()->children())
+        {
+            if (part->roles().has(PartitionRole::Unallocated)) continue;
+
+            if (part->firstSector() <= previousLastSector)
+            {
+                errorMessage = "A partição " + part->deviceNode() + " se sobrepõe a outra partição em " + device->deviceNode() + ".";
+                return false;
+            }
+
+            if (part->lastSector() >= device->totalLogical())
+            {
+                errorMessage = "A partição " + part->deviceNode() + " ultrapassa o fim do dispositivo " + device->deviceNode() + ".";
+                return false;
+            }
+
+            previousLastSector = part->lastSector();
+        }
+    }
+
+    return true;
+}
+
+void PartitionPage::onApplyOperationsButtonClicked(bool checked)
+{
+    QString validationError;
+    if (!validateOperations(validationError) || !validateEncryption(validationError))
+    {
+        QMessageBox::critical(this, "Erro", "Não é possível aplicar as alterações planejadas.\n\n" + validationError, QMessageBox::Ok);
+        return;
+    }
+
+    // os-prober mounts every candidate partition while it probes, and a partition mounted at the wrong moment
+    // would fail a delete or a shrink half-way through the plan. It is started again once the plan is applied.
+    if (osProber && osProber->isRunning())
+    {
+        QMessageBox::warning(this, "Atenção", "Aguarde o fim da detecção de outros sistemas operacionais antes de aplicar as alterações.", QMessageBox::Ok);
+        return;
+    }
+
+    QStringList operationDescriptions;
+    for (Operation* op : operationStack->operations())
+    {
+        if (op) operationDescriptions.append("• " + op->description());
+    }
+
+    QMessageBox::StandardButton confirmation;
+    confirmation = QMessageBox::warning(this, "Atenção", "As seguintes operações serão aplicadas:\n\n" + operationDescriptions.join("\n") + "\n\nDeseja continuar?", QMessageBox::Ok | QMessageBox::Cancel);
+
+    if (confirmation == QMessageBox::Cancel) return;
+
+    setPartitioningEnabled(false);
+
+    // Keep the passphrase only until the root partition is encrypted
+    newRootEncrypted = systemPartitionsPending && encryptionCheckbox->isChecked();
+    newRootStriped = systemPartitionsPending && !newStripePartitions.isEmpty();
+    if (newRootEncrypted)
+    {
+        newRootPassphrase = encryptionPassphraseLineEdit->text();
+        encryptionPassphraseLineEdit->clear();
+        encryptionPassphraseConfirmationLineEdit->clear();
+    }
+
+    // Partitions to be deleted are only unmounted now that the plan is applied
+    for (Operation* op : operationStack->operations())
+    {
+        DeleteOperation* deleteOperation = dynamic_cast<DeleteOperation*>(op);
+
+        if (!deleteOperation || !deleteOperation->deletedPartition().isMounted()) continue;
+
+        Partition& deletedPartition = deleteOperation->deletedPartition();
+
+        // The boot partition and the Btrfs subvolumes are mounted inside /mnt/new_root, so unmount the whole tree at once.
+        // The first system partition unmounts the whole tree, so the second one finds it already unmounted.
+        bool isAppliedSystemPartition = deletedPartition.deviceNode() == appliedBootDeviceNode || deletedPartition.deviceNode() == appliedRootDeviceNode
+            || appliedStripeDeviceNodes.contains(deletedPartition.deviceNode());
+        if (isAppliedSystemPartition && (QProcess::execute("mountpoint", { "-q", "/mnt/new_root" }) != 0
+            || QProcess::execute("umount", { "-R", "/mnt/new_root" }) == 0))
+        {
+            // An encrypted root must be closed before its partition can be deleted
+            if (QFile::exists(LuksEncryptor::mapperNode(rootMapperName)))
+            {
+                QProcess::execute("cryptsetup", { "close", rootMapperName });
+            }
+
+            deletedPartition.setMounted(false);
+            continue;
+        }
+
+        if (!deletedPartition.unmount(*rootReport))
+        {
+            qWarning() << "Could not unmount" << deletedPartition.deviceNode();
+            QMessageBox::critical(this, "Erro", "Não foi possível desmontar a partição " + deletedPartition.deviceNode() + ". Nenhuma alteração foi aplicada.", QMessageBox::Ok);
+            setPartitioningEnabled(true);
+            return;
+        }
+    }
+
+    // Execute the whole plan in one batch, off the GUI thread so the progress of long operations such as
+    // shrinking can be shown. KPMcore still commits the partition table once per NewOperation and
+    // DeleteOperation; the batch only saves the rescans and confirmations between them.
+    if (plannedMoveBytes > 0)
+    {
+        startMoveProgress();
+    } else {
+        systemPartitionsStatusIndicator->setStatus(StatusIndicator::Loading);
+        systemPartitionsStatusLabel->setText("Aplicando alterações");
+        systemPartitionsStatusLabel->show();
+    }
+
+    operationsThread = QThread::create([this]() { runOperations(); });
+    connect(operationsThread, &QThread::finished, this, &PartitionPage::onOperationsApplied);
+    operationsThread->start();
+}
+
+void PartitionPage::onOperationsApplied()
+{
+    operationsThread->deleteLater();
+    operationsThread = nullptr;
+
+    qDebug() << "Clearing operation stack";
+    operationStack->clearOperations();
+
+    if (moveProgressTimer)
+    {
+        moveProgressTimer->stop();
+        moveProgressTimer->deleteLater();
+        moveProgressTimer = nullptr;
+        systemPartitionsProgressBar->hide();
+    }
+    plannedMoveBytes = 0;
+    plannedMoveDeviceNodes.clear();
+
+    if (systemPartitionsStatusIndicator->getStatus() == StatusIndicator::Loading)
+    {
+        systemPartitionsStatusIndicator->setStatus(StatusIndicator::None);
+        systemPartitionsStatusLabel->hide();
+    }
+
+    if (systemPartitionsPending)
+    {
+        systemPartitionsPending = false;
+
+        newRootFileSystemType = static_cast<FileSystem::Type>(rootFileSystemCombobox->currentData().toInt());
+        newRootCompression = newRootFileSystemType == FileSystem::Type::Btrfs && compressionCheckbox->isChecked();
+
+        // The devices are rescanned only once the system partitions are formatted and mounted
+        if (discardCheckbox->isChecked())
+        {
+            discardSystemPartitions();
+        } else if (newRootEncrypted) {
+            encryptRootPartition();
+        } else {
+            formatSystemPartitions();
+        }
+        return;
+    }
+
+    finishApplyingOperations();
+}
+
+void PartitionPage::onDiscardOperationsButtonClicked(bool checked)
+{
+    // Undo every planned operation on the preview devices. Partitions created by the plan are destroyed,
+    // partitions deleted by the plan are restored.
+    operationStack->clearOperations();
+    plannedMoveBytes = 0;
+    plannedMoveDeviceNodes.clear();
+
+    if (systemPartitionsPending)
+    {
+        systemPartitionsPending = false;
+        systemPartitionsStatusIndicator->setStatus(StatusIndicator::None);
+        systemPartitionsStatusLabel->hide();
+    }
+
+    // Point back to the system partitions that were already applied, if any
+    if (!appliedBootDeviceNode.isEmpty() && !appliedRootDeviceNode.isEmpty())
+    {
+        newBootPartition = findPartition(appliedBootDeviceNode);
+        newRootPartition = findPartition(appliedRootDeviceNode);
+        newSystemPartitionsDeleted = false;
+    } else {
+        newBootPartition = nullptr;
+        newRootPartition = nullptr;
+        newSystemPartitionsDeleted = true;
+    }
+
+    newStripePartitions.clear();
+    for (const QString& stripeDeviceNode : appliedStripeDeviceNodes)
+    {
+        if (Partition* stripePartition = findPartition(stripeDeviceNode)) newStripePartitions << stripePartition;
+    }
+
+    updatePlanButtons();
+    updatePartitionTable();
+}
+
+void PartitionPage::finishApplyingOperations()
+{
+    if (newSystemPartitionsDeleted || !newBootPartition || !newRootPartition)
+    {
+        appliedBootDeviceNode.clear();
+        appliedRootDeviceNode.clear();
+        appliedStripeDeviceNodes.clear();
+    } else {
+        appliedBootDeviceNode = newBootPartition->deviceNode();
+        appliedRootDeviceNode = newRootPartition->deviceNode();
+        appliedStripeDeviceNodes = getRootStripeDeviceNodes().mid(1);
+    }
+
+    // A single rescan after the whole plan was applied. The scan replaces every device, so the
+    // system partitions are looked up again on the new devices.
+    scanDevices();
+
+    // The plan may have deleted other systems
+    detectOtherSystems();
+
+    newBootPartition = appliedBootDeviceNode.isEmpty() ? nullptr : findPartition(appliedBootDeviceNode);
+    newRootPartition = appliedRootDeviceNode.isEmpty() ? nullptr : findPartition(appliedRootDeviceNode);
+
+    newStripePartitions.clear();
+    for (const QString& stripeDeviceNode : appliedStripeDeviceNodes)
+    {
+        if (Partition* stripePartition = findPartition(stripeDeviceNode)) newStripePartitions << stripePartition;
+    }
+
+    setPartitioningEnabled(true);
+    updatePartitionTable();
+}
+
+void PartitionPage::discardSystemPartitions()
+{
+    // Discard exactly the sectors of the new partitions, through their own device nodes
+    rangeDiscarder = new RangeDiscarder(this);
+    rangeDiscarder->addRange(newBootPartition->deviceNode(), 0, newBootPartition->capacity());
+    rangeDiscarder->addRange(newRootPartition->deviceNode(), 0, newRootPartition->capacity());
+    for (Partition* stripePartition : newStripePartitions)
+    {
+        rangeDiscarder->addRange(stripePartition->deviceNode(), 0, stripePartition->capacity());
+    }
+
+    connect(rangeDiscarder, &RangeDiscarder::progress, this, [this](qint64 processedBytes, qint64 totalBytes) {
+        if (totalBytes <= 0) return;
+        systemPartitionsProgressBar->setValue(static_cast<int>(processedBytes * 100 / totalBytes));
+        systemPartitionsStatusLabel->setText(QString("Descartando dados antigos (%1 de %2 GiB)")
+            .arg(static_cast<double>(processedBytes) / GiB, 0, 'f', 2)
+            .arg(static_cast<double>(totalBytes) / GiB, 0, 'f', 2));
+    });
+
+    connect(rangeDiscarder, &QThread::finished, this, &PartitionPage::onSystemPartitionsDiscarded);
+
+    systemPartitionsProgressBar->setValue(0);
+    systemPartitionsProgressBar->show();
+    systemPartitionsStatusIndicator->setStatus(StatusIndicator::Loading);
+    systemPartitionsStatusLabel->setText("Descartando dados antigos");
+    systemPartitionsStatusLabel->show();
+
+    rangeDiscarder->start();
+}
+
+void PartitionPage::onSystemPartitionsDiscarded()
+{
+    // Discarding is only an optimization, so the installation continues if it fails
+    if (!rangeDiscarder->succeeded())
+    {
+        qWarning() << "Could not discard the system partitions. Continuing without discarding";
+    } else if (rangeDiscarder->usedZeroout()) {
+        qDebug() << "Device does not support discard, the system partitions were zeroed instead";
+    }
+
+    rangeDiscarder->deleteLater();
+    rangeDiscarder = nullptr;
+
+    systemPartitionsProgressBar->hide();
+
+    if (newRootEncrypted)
+    {
+        encryptRootPartition();
+    } else {
+        formatSystemPartitions();
+    }
+}
+
+bool PartitionPage::validateEncryption(QString& errorMessage)
+{
+    if (!systemPartitionsPending || !encryptionCheckbox->isChecked()) return true;
+
+    // Every stripe would need its own LUKS device, unlocked together by the initramfs
+    if (!newStripePartitions.isEmpty())
+    {
+        errorMessage = "A criptografia não está disponível com o sistema distribuído em vários dispositivos.";
+        return false;
+    }
+
+    if (encryptionPassphraseLineEdit->text().isEmpty())
+    {
+        errorMessage = "Digite a senha de criptografia da partição do sistema.";
+        return false;
+    }
+
+    if (encryptionPassphraseLineEdit->text() != encryptionPassphraseConfirmationLineEdit->text())
+    {
+        errorMessage = "As senhas de criptografia não coincidem.";
+        return false;
+    }
+
+    if (cipherBenchmark && cipherBenchmark->isRunning())
+    {
+        errorMessage = "Aguarde o fim da medição de desempenho das cifras.";
+        return false;
+    }
+
+    return true;
+}
+
+void PartitionPage::encryptRootPartition()
+{
+    CipherCandidate cipher = cipherBenchmark ? cipherBenchmark->selectedCipher() : CipherBenchmark().selectedCipher();
+
+    luksEncryptor = new LuksEncryptor(this);
+    connect(luksEncryptor, &LuksEncryptor::finished, this, &PartitionPage::onRootPartitionEncrypted);
+
+    systemPartitionsStatusIndicator->setStatus(StatusIndicator::Loading);
+    systemPartitionsStatusLabel->setText("Criptografando a partição do sistema com " + cipher.description);
+    systemPartitionsStatusLabel->show();
+
+    // Unlocking the installed system takes about a second on this machine
+    luksEncryptor->start(newRootPartition->deviceNode(), rootMapperName, newRootPassphrase, cipher.cipher, cipher.keySize, 1000);
+
+    newRootPassphrase.fill('\0');
+    newRootPassphrase.clear();
+}
+
+void PartitionPage::onRootPartitionEncrypted(bool success)
+{
+    luksEncryptor->deleteLater();
+    luksEncryptor = nullptr;
+
+    if (!success)
+    {
+        systemPartitionsStatusIndicator->setStatus(StatusIndicator::Error);
+        systemPartitionsStatusLabel->setText("Não foi possível criptografar a partição do sistema");
+        finishApplyingOperations();
+        return;
+    }
+
+    formatSystemPartitions();
+}
+
+void PartitionPage::formatSystemPartitions()
+{
+    // Create both filesystems concurrently, off the GUI thread
+    MkfsProfile mkfsProfile = mkfsProfileCombobox->currentData().value<MkfsProfile>();
+
+    fileSystemFormatter = new FileSystemFormatter(mkfsProfile, this);
+    if (newRootStriped)
+    {
+        fileSystemFormatter->addStripedFileSystem(getRootStripeDeviceNodes(), "DelphinOS");
+    } else {
+        // Features such as ext4 fast commits are chosen for the media the root is on
+        StorageMedia rootMedia = StorageAdvisor::classify(newRootPartition->devicePath());
+        fileSystemFormatter->addFileSystem(getRootFileSystemNode(), newRootFileSystemType, "DelphinOS",
+            StorageAdvisor::mkfsFeatures(rootMedia, newRootFileSystemType));
+    }
+    fileSystemFormatter->addFileSystem(newBootPartition->deviceNode(), FileSystem::Type::Fat32, "DELPHINOS");
+
+    connect(fileSystemFormatter, &FileSystemFormatter::finished, this, &PartitionPage::onSystemFileSystemsCreated);
+
+    systemPartitionsStatusIndicator->setStatus(StatusIndicator::Loading);
+    systemPartitionsStatusLabel->setText("Formatando as partições do sistema");
+    systemPartitionsStatusLabel->show();
+
+    fileSystemFormatter->start();
+}
+
+void PartitionPage::onSystemFileSystemsCreated(bool success)
+{
+    fileSystemFormatter->deleteLater();
+    fileSystemFormatter = nullptr;
+
+    if (!success || !newBootPartition || !newRootPartition)
+    {
+        systemPartitionsStatusIndicator->setStatus(StatusIndicator::Error);
+        systemPartitionsStatusLabel->setText("Não foi possível formatar as partições do sistema");
+        finishApplyingOperations();
+        return;
+    }
+
+    // Replace the placeholder unformatted filesystems so the partitions can be mounted
+    newBootPartition->deleteFileSystem();
+    newBootPartition->setFileSystem(FileSystemFactory::create(FileSystem::Type::Fat32,
+        newBootPartition->firstSector(), newBootPartition->lastSector(), newBootPartition->sectorSize()
+    ));
+
+    newRootPartition->deleteFileSystem();
+    newRootPartition->setFileSystem(FileSystemFactory::create(newRootFileSystemType,
+        newRootPartition->firstSector(), newRootPartition->lastSector(), newRootPartition->sectorSize()
+    ));
+
+    for (Partition* stripePartition : newStripePartitions)
+    {
+        stripePartition->deleteFileSystem();
+        stripePartition->setFileSystem(FileSystemFactory::create(FileSystem::Type::Btrfs,
+            stripePartition->firstSector(), stripePartition->lastSector(), stripePartition->sectorSize()
+        ));
+    }
+
+    mountSystemPartitions();
+}
+
+void PartitionPage::mountSystemPartitions()
+{
     if (!QDir("/mnt/new_root").exists()) {
         if (!QDir().mkpath("/mnt/new_root")) {
             qWarning() << "Failed to create mountpoint: /mnt/new_root";
+            systemPartitionsStatusIndicator->setStatus(StatusIndicator::Error);
+            systemPartitionsStatusLabel->setText("Não foi possível criar o ponto de montagem /mnt/new_root");
+            finishApplyingOperations();
             return;
         }
     }
     
-    newRootPartition->mount(*rootReport);
-
-    qDebug() << "Mountpoint created: /mnt/new_root";
-
-    if (!QDir("/mnt/new_root/boot").exists()) {
-        if (!QDir().mkpath("/mnt/new_root/boot")) {
-            qWarning() << "Failed to create mountpoint: /mnt/new_root/boot";
+    if (newRootFileSystemType == FileSystem::Type::Btrfs)
+    {
+        // Btrfs roots are mounted subvolume by subvolume, with the mount options the installed system will use.
+        // A striped root can only be mounted once the kernel knows all of its devices.
+        if ((newRootStriped && !BtrfsLayout::registerDevices(getRootStripeDeviceNodes()))
+            || !BtrfsLayout::createSubvolumes(getRootFileSystemNode())
+            || !BtrfsLayout::mountSubvolumes(getRootFileSystemNode(), "/mnt/new_root", newRootCompression))
+        {
+            qWarning() << "Failed to create and mount the Btrfs subvolumes of" << getRootFileSystemNode();
+            systemPartitionsStatusIndicator->setStatus(StatusIndicator::Error);
+            systemPartitionsStatusLabel->setText("Não foi possível criar os subvolumes Btrfs");
+            finishApplyingOperations();
             return;
         }
+        newRootPartition->setMounted(true);
+    } else if (newRootEncrypted) {
+        // KPMcore would mount the encrypted partition itself, not the opened device
+        if (QProcess::execute("mount", { getRootFileSystemNode(), "/mnt/new_root" }) != 0)
+        {
+            qWarning() << "Failed to mount" << getRootFileSystemNode();
+            systemPartitionsStatusIndicator->setStatus(StatusIndicator::Error);
+            systemPartitionsStatusLabel->setText("Não foi possível montar a partição do sistema criptografada");
+            finishApplyingOperations();
+            return;
+        }
+        newRootPartition->setMounted(true);
+    } else {
+        newRootPartition->mount(*rootReport);
     }
 
+    qDebug() << "Mountpoint created: /mnt/new_root";
+
     if (!QDir("/mnt/new_root/boot").exists()) {
         if (!QDir().mkpath("/mnt/new_root/boot")) {
             qWarning() << "Failed to create mountpoint: /mnt/new_root/boot";
+            systemPartitionsStatusIndicator->setStatus(StatusIndicator::Error);
+            systemPartitionsStatusLabel->setText("Não foi possível criar o ponto de montagem /mnt/new_root/boot");
+            finishApplyingOperations();
             return;
         }
     }
@@ -970,8 +2050,22 @@ void PartitionPage::onCreateSystemPartitionsButtonClicked(bool checked)
 
     newBootPartition->mount(*rootReport);
 
-    updatePartitionTable();
+    finishApplyingOperations();
+
+    // The rescan looks the system partitions up again, and does not find them if the kernel has not
+    // picked up the new partition table yet
+    if (!newBootPartition || !newRootPartition)
+    {
+        qWarning() << "The system partitions were not found after rescanning the devices";
+        systemPartitionsStatusIndicator->setStatus(StatusIndicator::Error);
+        systemPartitionsStatusLabel->setText("As partições do sistema não foram encontradas após aplicar as alterações");
+        page->setCanAdvance(false);
+        return;
+    }
+
+    systemPartitionsStatusIndicator->setStatus(StatusIndicator::Ok);
+    systemPartitionsStatusLabel->setText("Partições do sistema criadas e montadas em /mnt/new_root");
 
-    page->setConfirmationMessage("Instalar o DelphinOS nas partições " + newBootPartition->deviceNode() + " e " + newRootPartition->deviceNode() + "?");
+    page->setConfirmationMessage("Instalar o DelphinOS nas partições " + newBootPartition->deviceNode() + " e " + getRootStripeDeviceNodes().join(", ") + "?");
     page->setCanAdvance(true);
 }
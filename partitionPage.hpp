@@ -16,6 +16,17 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "mainWindow.hpp"
+#include "statusIndicator.hpp"
+#include "fileSystemFormatter.hpp"
+#include "partitionLayoutPlanner.hpp"
+#include "rangeDiscarder.hpp"
+#include "btrfsLayout.hpp"
+#include "deviceProbe.hpp"
+#include "cipherBenchmark.hpp"
+#include "luksEncryptor.hpp"
+#include "shrinkPlanner.hpp"
+#include "storageAdvisor.hpp"
+#include "osProber.hpp"
 #include <QTableWidget>
 #include <kpmcore/core/devicescanner.h>
 #include <kpmcore/core/device.h>
@@ -24,6 +35,15 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <kpmcore/ops/operation.h>
 #include <kpmcore/util/report.h>
 #include <QDoubleSpinBox>
+#include <QCheckBox>
+#include <QProgressBar>
+#include <QMap>
+#include <QListWidget>
+#include <QLineEdit>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStorageInfo>
 
 // Constant values of storage size in bytes
 const qint64 KiB = 1024;
@@ -32,6 +52,9 @@ const qint64 GiB = MiB * 1024;
 const qint64 TiB = GiB * 1024;
 const qint64 PiB = TiB * 1024;
 
+// Smallest device the system can be installed on, the minimum of systemSizeSpinbox
+const qint64 minimumSystemSize = GiB * 10;
+
 class PartitionPage : public QWidget
 {
 Q_OBJECT
@@ -44,10 +67,73 @@ private:
     Partition* newBootPartition = nullptr;
     Partition* newRootPartition = nullptr;
     bool newSystemPartitionsDeleted = true;
+    bool systemPartitionsPending = false; // System partitions are planned but not applied yet
+
+    // Device nodes of the system partitions on the devices, used to find them again after a rescan
+    QString appliedBootDeviceNode;
+    QString appliedRootDeviceNode;
+    QStringList appliedStripeDeviceNodes;
 
     QDoubleSpinBox* systemSizeSpinbox;
     qint64 maxSystemSizeBytes = 0;       // Maximum system size in bytes
     double maxSystemSizeRoundedGib = 0.; // Maximum system size in GiB rounded 
+
+    // Filesystem creation of the system partitions
+    QComboBox* rootFileSystemCombobox;
+    QCheckBox* compressionCheckbox;
+    FileSystem::Type newRootFileSystemType = FileSystem::Type::Ext4;
+    bool newRootCompression = false;
+    bool rootFileSystemSelectedByUser = false; // Otherwise the filesystem recommended for the media of the device is selected
+    QLabel* storageMediaLabel;
+    QComboBox* mkfsProfileCombobox;
+    FileSystemFormatter* fileSystemFormatter = nullptr;
+    StatusIndicator* systemPartitionsStatusIndicator;
+    QLabel* systemPartitionsStatusLabel;
+    QProgressBar* systemPartitionsProgressBar;
+
+    // Optional LUKS2 encryption of the root partition
+    QCheckBox* encryptionCheckbox;
+    QWidget* encryptionPassphraseWidget;
+    QLineEdit* encryptionPassphraseLineEdit;
+    QLineEdit* encryptionPassphraseConfirmationLineEdit;
+    QLabel* encryptionCipherLabel;
+    CipherBenchmark* cipherBenchmark = nullptr;
+    LuksEncryptor* luksEncryptor = nullptr;
+    bool newRootEncrypted = false;
+    QString newRootPassphrase;
+    const QString rootMapperName = "delphinos-root";
+
+    // Optional Btrfs RAID0 root striped across partitions of the same size on further devices
+    QCheckBox* stripeCheckbox;
+    QListWidget* stripeDevicesListWidget;
+    QList<Partition*> newStripePartitions;
+    bool newRootStriped = false;
+
+    // The planned operations run in this thread while they are applied
+    QThread* operationsThread = nullptr;
+
+    // Data moved by planned shrink operations, and the progress of moving it
+    qint64 plannedMoveBytes = 0;
+    QStringList plannedMoveDeviceNodes;
+    QTimer* moveProgressTimer = nullptr;
+
+    // Reads the used blocks of the partition being shrunk
+    ShrinkProbe* shrinkProbe = nullptr;
+    QElapsedTimer moveProgressElapsed;
+    qint64 moveProgressStartBytes = 0;
+
+    // Read performance of the devices, measured in the background to recommend the fastest one
+    DeviceProbe* deviceProbe = nullptr;
+    QMap<QString, DeviceProbeResult> deviceProbeResults;
+    bool deviceSelectedByUser = false;
+
+    // Other operating systems, detected in the background and cached for the bootloader configuration
+    OsProber* osProber = nullptr;
+    QLabel* otherSystemsLabel;
+
+    // Optional discard of the system partitions before their filesystems are created
+    QCheckBox* discardCheckbox;
+    RangeDiscarder* rangeDiscarder = nullptr;
     
     bool hasInitialized = false;
     void showEvent(QShowEvent* event) override
@@ -75,19 +161,59 @@ private:
     QPushButton* deletePartitionButton;
     QPushButton* unmountPartitionButton;
     QPushButton* mountPartitionButton;
+    QPushButton* shrinkPartitionButton;
 
     QPushButton* newPartitionTableButton;
     QPushButton* createSystemPartitionsButton;
 
+    QPushButton* applyOperationsButton;
+    QPushButton* discardOperationsButton;
+
     // Update partition table
     void updatePartitionTable();
 
-    // Run operations in operation stack
+    // Run operations in operation stack. Runs off the GUI thread, the stack is cleared by onOperationsApplied.
     void runOperations();
 
+    // Show the progress of the planned shrink operations while they are applied
+    void startMoveProgress();
+
     // Scan all devices and repopulate deviceCombobox
     void scanDevices();
 
+    // Measure the read performance of the devices that were not probed yet
+    void probeDevices();
+
+    // Detect the other operating systems on the scanned devices
+    void detectOtherSystems();
+
+    // Check that the planned operations leave consistent partition tables
+    bool validateOperations(QString& errorMessage);
+
+    // Check that the encryption passphrase was given and confirmed
+    bool validateEncryption(QString& errorMessage);
+
+    // Rescan the devices after the plan was applied and enable partitioning again
+    void finishApplyingOperations();
+
+    // Enable apply and discard buttons only when there are planned operations
+    void updatePlanButtons();
+
+    // Block every partitioning control while the plan is being applied
+    void setPartitioningEnabled(bool enabled);
+
+    // Repopulate stripeDevicesListWidget with every device other than the selected one
+    void updateStripeDevices();
+
+    // Plan a partition of rootLength bytes on every device checked in stripeDevicesListWidget
+    bool planStripePartitions(qint64 rootLength, QString& errorMessage);
+
+    // Discard, encrypt, format and mount the newly created system partitions
+    void discardSystemPartitions();
+    void encryptRootPartition();
+    void formatSystemPartitions();
+    void mountSystemPartitions();
+
     qint32 countPrimaryPartitions(Device* device)
     {
         if (!device)
@@ -127,6 +253,52 @@ private:
         else                 return QString::number(static_cast<double>(size) / PiB, 'f', 2) + " PiB";
     }
 
+    // Device where the root filesystem is created, the opened LUKS device when the root is encrypted
+    QString getRootFileSystemNode()
+    {
+        return newRootEncrypted ? LuksEncryptor::mapperNode(rootMapperName) : newRootPartition->deviceNode();
+    }
+
+    // Device nodes of every partition holding the root filesystem
+    QStringList getRootStripeDeviceNodes()
+    {
+        QStringList deviceNodes = { newRootPartition->deviceNode() };
+        for (Partition* stripePartition : newStripePartitions)
+        {
+            deviceNodes << stripePartition->deviceNode();
+        }
+        return deviceNodes;
+    }
+
+    // Whether partition is one of the system partitions, including the stripes of the root
+    bool isSystemPartition(const Partition* partition)
+    {
+        if (!newBootPartition || !newRootPartition) return false;
+        if (partition->deviceNode() == newBootPartition->deviceNode() || partition->deviceNode() == newRootPartition->deviceNode()) return true;
+
+        for (Partition* stripePartition : newStripePartitions)
+        {
+            if (partition->deviceNode() == stripePartition->deviceNode()) return true;
+        }
+        return false;
+    }
+
+    // Text of a device in deviceCombobox, with its measured performance once it was probed
+    QString getDeviceItemText(const Device* device)
+    {
+        QString text = device->deviceNode() + " (" + getSize(device) + ")";
+
+        DeviceProbeResult result = deviceProbeResults.value(device->deviceNode());
+        if (result.valid)
+        {
+            text += QString(" — %1 MB/s, %2 ms")
+                .arg(result.sequentialBytesPerSecond / 1e6, 0, 'f', 0)
+                .arg(result.randomReadLatencyMs, 0, 'f', 2);
+        }
+
+        return text;
+    }
+
     // Get human-readable size of partition
     QString getSize(const Partition* partition)
     {
@@ -180,6 +352,83 @@ private:
         return device;
     }
 
+    // Find a device by its node on the preview devices. May return nullptr.
+    Device* findDevice(const QString& deviceNode)
+    {
+        for (Device* device : operationStack->previewDevices())
+        {
+            if (device && device->deviceNode() == deviceNode) return device;
+        }
+
+        qWarning() << "findDevice(): No device" << deviceNode;
+        return nullptr;
+    }
+
+    // Largest unallocated space of a device. May return nullptr.
+    Partition* findLargestUnallocated(Device* device)
+    {
+        if (!device || !device->partitionTable()) return nullptr;
+
+        Partition* largest = nullptr;
+        for (Partition* part : device->partitionTable()->children())
+        {
+            if (part && part->roles().has(PartitionRole::Unallocated) && (!largest || part->capacity() > largest->capacity()))
+            {
+                largest = part;
+            }
+        }
+        return largest;
+    }
+
+    // Find a partition by its device node on the preview devices. May return nullptr.
+    Partition* findPartition(const QString& deviceNode)
+    {
+        for (Device* device : operationStack->previewDevices())
+        {
+            if (!device || !device->partitionTable()) continue;
+
+            for (Partition* part : device->partitionTable()->children())
+            {
+                if (!part) continue;
+                if (part->deviceNode() == deviceNode) return part;
+
+                // Logical partitions are children of the extended partition
+                for (Partition* child : part->children())
+                {
+                    if (child && child->deviceNode() == deviceNode) return child;
+                }
+            }
+        }
+
+        qWarning() << "findPartition(): No partition" << deviceNode;
+        return nullptr;
+    }
+
+    // Whether a device has mounted partitions or holds the live medium, so it should not be suggested for the system
+    bool isDeviceInUse(Device* device)
+    {
+        if (!device) return false;
+
+        // archiso mounts the boot medium here unless it was copied to RAM
+        QStorageInfo liveMedium("/run/archiso/bootmnt");
+        QString liveDeviceNode = liveMedium.isValid() ? QString::fromLocal8Bit(liveMedium.device()) : QString();
+        if (!liveDeviceNode.isEmpty() && liveDeviceNode.startsWith(device->deviceNode())) return true;
+
+        if (!device->partitionTable()) return false;
+
+        for (Partition* part : device->partitionTable()->children())
+        {
+            if (!part) continue;
+            if (part->isMounted()) return true;
+
+            for (Partition* child : part->children())
+            {
+                if (child && child->isMounted()) return true;
+            }
+        }
+        return false;
+    }
+
     // Get currently selected partition. May return nullptr.
     Partition* getSelectedPartition()
     {
@@ -213,6 +462,16 @@ private slots:
     void onUnmountPartitionButtonClicked(bool checked);
     void onNewPartitionTableButtonClicked(bool checked);
     void onCreateSystemPartitionsButtonClicked(bool checked);
+    void onSystemPartitionsDiscarded();
+    void onRootPartitionEncrypted(bool success);
+    void onSystemFileSystemsCreated(bool success);
+    void onApplyOperationsButtonClicked(bool checked);
+    void onOperationsApplied();
+    void onShrinkPartitionButtonClicked(bool checked);
+    void onShrinkPartitionProbed();
+    void onDeviceProbed(const DeviceProbeResult& result);
+    void onDevicesProbed();
+    void onDiscardOperationsButtonClicked(bool checked);
     
 public: 
     PageContent* getPage()
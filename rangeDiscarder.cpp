@@ -0,0 +1,109 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "rangeDiscarder.hpp"
+#include <QDebug>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+void RangeDiscarder::run()
+{
+    const qint64 total = totalBytes();
+    qint64 processedBytes = 0;
+
+    success = true;
+    zeroedOut = false;
+
+    for (const DiscardRange& range : ranges)
+    {
+        int fd = open(range.deviceNode.toLocal8Bit().constData(), O_WRONLY | O_CLOEXEC);
+
+        if (fd < 0)
+        {
+            qWarning() << "RangeDiscarder: Could not open" << range.deviceNode << ":" << strerror(errno);
+            success = false;
+            return;
+        }
+
+        // The kernel only accepts ranges aligned to the logical block size
+        int logicalBlockSize = 512;
+        ioctl(fd, BLKSSZGET, &logicalBlockSize);
+
+        if (range.offset % logicalBlockSize != 0 || range.length % logicalBlockSize != 0)
+        {
+            qWarning() << "RangeDiscarder: Range" << range.offset << "+" << range.length << "of" << range.deviceNode
+                       << "is not aligned to" << logicalBlockSize << "bytes";
+            close(fd);
+            success = false;
+            return;
+        }
+
+        bool discardSupported = true;
+        const qint64 rangeEnd = range.offset + range.length;
+
+        for (qint64 offset = range.offset; offset < rangeEnd && !isInterruptionRequested(); )
+        {
+            uint64_t chunk[2] = { static_cast<uint64_t>(offset), static_cast<uint64_t>(std::min(chunkSize, rangeEnd - offset)) };
+            int result = -1;
+
+            if (discardSupported)
+            {
+                result = ioctl(fd, BLKDISCARD, &chunk);
+
+                if (result != 0 && (errno == EOPNOTSUPP || errno == ENOTTY))
+                {
+                    qDebug() << range.deviceNode << "does not support discard, zeroing the range instead";
+                    discardSupported = false;
+                    zeroedOut = true;
+                }
+            }
+
+            if (!discardSupported)
+            {
+                result = ioctl(fd, BLKZEROOUT, &chunk);
+            }
+
+            if (result != 0)
+            {
+                qWarning() << "RangeDiscarder: Could not discard" << chunk[1] << "bytes at" << offset << "of" << range.deviceNode << ":" << strerror(errno);
+                close(fd);
+                success = false;
+                return;
+            }
+
+            offset += chunk[1];
+            processedBytes += chunk[1];
+            emit progress(processedBytes, total);
+        }
+
+        close(fd);
+
+        if (isInterruptionRequested())
+        {
+            success = false;
+            return;
+        }
+
+        qDebug() << "Discarded" << range.length << "bytes of" << range.deviceNode;
+    }
+}
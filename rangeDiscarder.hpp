@@ -0,0 +1,82 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QThread>
+#include <QList>
+#include <QString>
+#include <atomic>
+
+#ifndef RANGEDISCARDER_H
+#define RANGEDISCARDER_H
+
+// Byte range of a block device to be discarded
+struct DiscardRange
+{
+    QString deviceNode;
+    qint64 offset;
+    qint64 length;
+};
+
+// Discards byte ranges of block devices with BLKDISCARD in a background thread, so SSDs and NVMe drives
+// start the installation without stale data to garbage collect. Devices that do not support discard
+// have their ranges zeroed with BLKZEROOUT instead.
+class RangeDiscarder : public QThread
+{
+Q_OBJECT
+private:
+    static constexpr qint64 chunkSize = 256 * 1024 * 1024; // Bytes per ioctl, so progress can be reported
+
+    QList<DiscardRange> ranges;
+    std::atomic<bool> success { false };
+    std::atomic<bool> zeroedOut { false };
+
+protected:
+    void run() override;
+
+public:
+    explicit RangeDiscarder(QObject* parent = nullptr) : QThread(parent) {};
+
+    // Queue a range to be discarded. Must be called before start().
+    void addRange(const QString& deviceNode, qint64 offset, qint64 length)
+    {
+        ranges.append(DiscardRange{ deviceNode, offset, length });
+    }
+
+    qint64 totalBytes() const
+    {
+        qint64 total = 0;
+        for (const DiscardRange& range : ranges) total += range.length;
+        return total;
+    }
+
+    // Whether all ranges were discarded or zeroed. Valid after the thread finished.
+    bool succeeded() const
+    {
+        return success;
+    }
+
+    // Whether any range had to be zeroed because the device does not support discard
+    bool usedZeroout() const
+    {
+        return zeroedOut;
+    }
+
+signals:
+    void progress(qint64 processedBytes, qint64 totalBytes);
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "savedConnectionIndex.hpp"
+#include <QDBusConnection>
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+
+SavedConnectionIndex::SavedConnectionIndex(QObject* parent) : QObject(parent)
+{
+    qDBusRegisterMetaType<ConnectionSettings>();
+    qDBusRegisterMetaType<ConnectionSettingsItem>();
+
+    QDBusConnection bus = networkBus();
+    bus.connect(NM_SERVICE, NM_SETTINGS_PATH, NM_SETTINGS, "NewConnection", this, SLOT(onNewConnection(QDBusObjectPath)));
+    bus.connect(NM_SERVICE, NM_SETTINGS_PATH, NM_SETTINGS, "ConnectionRemoved", this, SLOT(onConnectionRemoved(QDBusObjectPath)));
+
+    // A single match for the Updated signal of every saved connection
+    bus.connect(NM_SERVICE, QString(), "org.freedesktop.NetworkManager.Settings.Connection", "Updated", this, SLOT(onConnectionUpdated(QDBusMessage)));
+}
+
+void SavedConnectionIndex::build()
+{
+    QDBusMessage listConnections = QDBusMessage::createMethodCall(NM_SERVICE, NM_SETTINGS_PATH, NM_SETTINGS, "ListConnections");
+    QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(networkBus().asyncCall(listConnections), this);
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher* watcher) {
+        QDBusPendingReply<QList<QDBusObjectPath>> reply = *watcher;
+        watcher->deleteLater();
+
+        if (reply.isError())
+        {
+            qWarning() << "Failed to list the saved connections:" << reply.error().message();
+            isBuilt = true;
+            emit built();
+            return;
+        }
+
+        const QList<QDBusObjectPath> connectionPaths = reply.value();
+
+        // The settings of every connection are requested at once, and the index is built when the last one arrives
+        pendingFetches += connectionPaths.count();
+        for (const QDBusObjectPath& connectionPath : connectionPaths)
+        {
+            fetchSettings(connectionPath, true);
+        }
+
+        if (pendingFetches == 0)
+        {
+            isBuilt = true;
+            emit built();
+        }
+    });
+}
+
+void SavedConnectionIndex::fetchSettings(const QDBusObjectPath& path, bool partOfBuild)
+{
+    QDBusMessage getSettings = QDBusMessage::createMethodCall(NM_SERVICE, path.path(), "org.freedesktop.NetworkManager.Settings.Connection", "GetSettings");
+    QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(networkBus().asyncCall(getSettings), this);
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, path, partOfBuild](QDBusPendingCallWatcher* watcher) {
+        QDBusPendingReply<ConnectionSettings> reply = *watcher;
+        watcher->deleteLater();
+
+        if (reply.isError())
+        {
+            qWarning() << "Failed to get connection settings for" << path.path() << ":" << reply.error().message();
+        } else {
+            insert(path.path(), reply.value());
+        }
+
+        // Fetches started by NewConnection and Updated while the index is being built do not count towards it
+        if (partOfBuild && --pendingFetches == 0)
+        {
+            qDebug() << "Indexed" << settingsByPath.count() << "saved connections";
+            isBuilt = true;
+            emit built();
+        }
+    });
+}
+
+void SavedConnectionIndex::insert(const QString& path, const ConnectionSettings& settings)
+{
+    // An updated connection may have changed its SSID
+    remove(path);
+
+    settingsByPath.insert(path, settings);
+
+    QString uuid = settings.value("connection").value("uuid").toString();
+    if (!uuid.isEmpty()) pathByUuid.insert(uuid, path);
+
+    QByteArray ssid = settings.value("802-11-wireless").value("ssid").toByteArray();
+    if (!ssid.isEmpty()) pathBySsid.insert(ssid, path);
+}
+
+void SavedConnectionIndex::remove(const QString& path)
+{
+    if (!settingsByPath.contains(path)) return;
+
+    ConnectionSettings settings = settingsByPath.take(path);
+
+    QString uuid = settings.value("connection").value("uuid").toString();
+    if (pathByUuid.value(uuid) == path) pathByUuid.remove(uuid);
+
+    QByteArray ssid = settings.value("802-11-wireless").value("ssid").toByteArray();
+    if (pathBySsid.value(ssid) == path) pathBySsid.remove(ssid);
+}
+
+void SavedConnectionIndex::onNewConnection(const QDBusObjectPath& path)
+{
+    fetchSettings(path);
+}
+
+void SavedConnectionIndex::onConnectionRemoved(const QDBusObjectPath& path)
+{
+    remove(path.path());
+}
+
+void SavedConnectionIndex::onConnectionUpdated(const QDBusMessage& message)
+{
+    fetchSettings(QDBusObjectPath(message.path()));
+}
@@ -0,0 +1,88 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "networkDBus.hpp"
+#include <QObject>
+#include <QHash>
+#include <QDBusMessage>
+
+#ifndef SAVEDCONNECTIONINDEX_H
+#define SAVEDCONNECTIONINDEX_H
+
+// Index of the connection profiles saved by NetworkManager, by SSID and by UUID. It is built once with
+// asynchronous calls and kept current through the NewConnection, ConnectionRemoved and Updated signals, so
+// finding the profile of a network is a lookup instead of a GetSettings call on every saved connection.
+class SavedConnectionIndex : public QObject
+{
+Q_OBJECT
+private:
+    QHash<QString, ConnectionSettings> settingsByPath;  // Settings without secrets
+    QHash<QByteArray, QString> pathBySsid;
+    QHash<QString, QString> pathByUuid;
+
+    int pendingFetches = 0;     // Fetches started by build() that have not finished
+    bool isBuilt = false;
+
+    // Fetch the settings of a connection into the index. Only fetches with partOfBuild count towards build().
+    void fetchSettings(const QDBusObjectPath& path, bool partOfBuild = false);
+    void insert(const QString& path, const ConnectionSettings& settings);
+    void remove(const QString& path);
+
+private slots:
+    void onNewConnection(const QDBusObjectPath& path);
+    void onConnectionRemoved(const QDBusObjectPath& path);
+    void onConnectionUpdated(const QDBusMessage& message);
+
+public:
+    explicit SavedConnectionIndex(QObject* parent = nullptr);
+
+    // List the saved connections and fetch their settings, all asynchronously
+    void build();
+
+    // Whether every connection saved when the index was built is indexed
+    bool isReady() const
+    {
+        return isBuilt;
+    }
+
+    // Path of the saved connection for a Wi-Fi network, empty if there is none
+    QDBusObjectPath findBySsid(const QByteArray& ssid) const
+    {
+        return QDBusObjectPath(pathBySsid.value(ssid));
+    }
+
+    // Path of the saved connection with uuid, empty if there is none
+    QDBusObjectPath findByUuid(const QString& uuid) const
+    {
+        return QDBusObjectPath(pathByUuid.value(uuid));
+    }
+
+    ConnectionSettings settings(const QDBusObjectPath& path) const
+    {
+        return settingsByPath.value(path.path());
+    }
+
+    int count() const
+    {
+        return settingsByPath.count();
+    }
+
+signals:
+    void built();
+};
+
+#endif
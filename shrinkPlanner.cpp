@@ -0,0 +1,182 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "shrinkPlanner.hpp"
+#include <QProcess>
+#include <QRegularExpression>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+
+static const qint64 MiB = 1024 * 1024;
+
+// Run a command to completion and return its output. Returns an empty string on failure.
+static QString readCommandOutput(const QString& program, const QStringList& arguments)
+{
+    QProcess process;
+    process.start(program, arguments);
+
+    if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+    {
+        qWarning() << program << arguments << "failed:" << process.readAllStandardError().trimmed();
+        return QString();
+    }
+
+    return QString::fromLocal8Bit(process.readAllStandardOutput());
+}
+
+ShrinkPlanner::ShrinkPlanner(const QString& _deviceNode, FileSystem::Type _type, qint64 _length, qint64 _usedBytes, qint64 _fileSystemMinimumBytes)
+    : deviceNode(_deviceNode), type(_type), length(_length), usedBytes(std::max<qint64>(_usedBytes, 0)), fileSystemMinimumBytes(_fileSystemMinimumBytes)
+{
+    updateMinimumLength(-1);
+}
+
+void ShrinkPlanner::probe()
+{
+    qint64 resizerMinimumBytes = -1;
+
+    if (type == FileSystem::Type::Ext2 || type == FileSystem::Type::Ext3 || type == FileSystem::Type::Ext4)
+    {
+        readExtBlockMap();
+        resizerMinimumBytes = readExtMinimumSize();
+    }
+
+    updateMinimumLength(resizerMinimumBytes);
+
+    qDebug() << "Shrink plan of" << deviceNode << "- length:" << length << "used:" << usedBytes << "minimum:" << minimumBytes
+             << "block map:" << hasBlockMap;
+}
+
+void ShrinkPlanner::updateMinimumLength(qint64 resizerMinimumBytes)
+{
+    // Leave a tenth of the used space and at least 256 MiB free, so the shrunk system still boots and updates
+    minimumBytes = std::max({ usedBytes + std::max(usedBytes / 10, 256 * MiB), resizerMinimumBytes, fileSystemMinimumBytes });
+    minimumBytes = std::min(minimumBytes, length);
+}
+
+bool ShrinkPlanner::readExtBlockMap()
+{
+    const QString output = readCommandOutput("dumpe2fs", { deviceNode });
+    if (output.isEmpty()) return false;
+
+    static const QRegularExpression blockSizeLine("^Block size:\\s+(\\d+)", QRegularExpression::MultilineOption);
+    static const QRegularExpression blockCountLine("^Block count:\\s+(\\d+)", QRegularExpression::MultilineOption);
+    static const QRegularExpression freeBlocksLine("^\\s+Free blocks: (.*)$", QRegularExpression::MultilineOption);
+
+    QRegularExpressionMatch blockSizeMatch = blockSizeLine.match(output);
+    if (!blockSizeMatch.hasMatch()) return false;
+
+    blockSize = blockSizeMatch.captured(1).toLongLong();
+
+    // Every block group lists its free blocks as "a-b, c, d-e"
+    QRegularExpressionMatchIterator groups = freeBlocksLine.globalMatch(output);
+    while (groups.hasNext())
+    {
+        const QString ranges = groups.next().captured(1).trimmed();
+        if (ranges.isEmpty()) continue;
+
+        for (const QString& range : ranges.split(",", Qt::SkipEmptyParts))
+        {
+            QStringList bounds = range.trimmed().split("-");
+            qint64 first = bounds.first().toLongLong();
+            qint64 last = bounds.last().toLongLong();
+            freeRanges.append({ first * blockSize, (last + 1) * blockSize - 1 });
+        }
+    }
+
+    // The partition may be longer than its filesystem, and nothing has to be moved from the space beyond it
+    QRegularExpressionMatch blockCountMatch = blockCountLine.match(output);
+    qint64 fileSystemBytes = blockCountMatch.hasMatch() ? blockCountMatch.captured(1).toLongLong() * blockSize : length;
+    if (fileSystemBytes < length)
+    {
+        freeRanges.append({ fileSystemBytes, length - 1 });
+    }
+
+    hasBlockMap = true;
+    return true;
+}
+
+qint64 ShrinkPlanner::readExtMinimumSize()
+{
+    // resize2fs reports its minimum in filesystem blocks, whose size is known from the block map
+    if (blockSize <= 0) return -1;
+
+    const QString output = readCommandOutput("resize2fs", { "-P", deviceNode });
+    static const QRegularExpression minimumSizeLine("minimum size of the filesystem:\\s+(\\d+)");
+    QRegularExpressionMatch minimumSizeMatch = minimumSizeLine.match(output);
+
+    if (!minimumSizeMatch.hasMatch()) return -1;
+
+    return minimumSizeMatch.captured(1).toLongLong() * blockSize;
+}
+
+qint64 ShrinkPlanner::bytesToMove(qint64 newLength) const
+{
+    if (newLength >= length) return 0;
+
+    if (!hasBlockMap)
+    {
+        // Without a block map, assume the used data is spread evenly over the filesystem
+        return static_cast<qint64>(static_cast<double>(usedBytes) * (length - newLength) / length);
+    }
+
+    // Everything beyond the new end that is not free has to be moved
+    qint64 freeBeyondEnd = 0;
+    for (const QPair<qint64, qint64>& range : freeRanges)
+    {
+        if (range.second < newLength) continue;
+        freeBeyondEnd += range.second - std::max(range.first, newLength) + 1;
+    }
+
+    return std::max<qint64>(0, (length - newLength) - freeBeyondEnd);
+}
+
+qint64 ShrinkPlanner::leastMoveLength(qint64 minimumLength, qint64 maximumLength) const
+{
+    if (!hasBlockMap) return maximumLength;
+
+    // Walk the free ranges back from the end of the filesystem. Block groups list their free blocks
+    // separately, so a free tail is usually made of several adjacent ranges.
+    QList<QPair<qint64, qint64>> sortedRanges = freeRanges;
+    std::sort(sortedRanges.begin(), sortedRanges.end());
+
+    qint64 usedEnd = length;
+    for (auto range = sortedRanges.crbegin(); range != sortedRanges.crend(); ++range)
+    {
+        if (range->second + 1 < usedEnd) break;
+        usedEnd = std::min(usedEnd, range->first);
+    }
+
+    return std::clamp(usedEnd, minimumLength, std::max(minimumLength, maximumLength));
+}
+
+qint64 ShrinkPlanner::deviceBytesWritten(const QString& deviceNode)
+{
+    // The seventh field of the stat file counts written sectors, always of 512 bytes
+    QFileInfo deviceNodeInfo(deviceNode);
+    QString blockName = deviceNodeInfo.exists() ? QFileInfo(deviceNodeInfo.canonicalFilePath()).fileName() : deviceNodeInfo.fileName();
+
+    QFile statFile("/sys/class/block/" + blockName + "/stat");
+    if (!statFile.open(QIODevice::ReadOnly | QIODevice::Text)) return -1;
+
+    QStringList fields = QString::fromLocal8Bit(statFile.readAll()).simplified().split(" ");
+    if (fields.size() < 7) return -1;
+
+    return fields.at(6).toLongLong() * 512;
+}
@@ -0,0 +1,123 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <QThread>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QtGlobal>
+#include <kpmcore/fs/filesystem.h>
+
+#ifndef SHRINKPLANNER_H
+#define SHRINKPLANNER_H
+
+// Plans shrinking a partition by moving its end, so the data before the new end stays in place and only the
+// used blocks beyond it are moved by the filesystem resizer. Used block information is read from the filesystem
+// when the type supports it, otherwise the used data is assumed to be spread evenly over the partition.
+// Reading it runs external tools, so probe() should run off the GUI thread, e.g. through ShrinkProbe.
+class ShrinkPlanner
+{
+private:
+    QString deviceNode;
+    FileSystem::Type type;
+    qint64 length;              // Current length of the filesystem in bytes
+    qint64 usedBytes;
+    qint64 fileSystemMinimumBytes;
+    qint64 minimumBytes;
+
+    // Free ranges of the filesystem, as byte offsets from its start [first, last]. Empty when unknown.
+    QList<QPair<qint64, qint64>> freeRanges;
+    bool hasBlockMap = false;
+    qint64 blockSize = 0;
+
+    bool readExtBlockMap();
+    qint64 readExtMinimumSize();
+    void updateMinimumLength(qint64 resizerMinimumBytes);
+
+public:
+    ShrinkPlanner(const QString& _deviceNode, FileSystem::Type _type, qint64 _length, qint64 _usedBytes, qint64 _fileSystemMinimumBytes);
+
+    // Read the used blocks and the resizer minimum of the filesystem. Blocks while dumpe2fs and resize2fs run.
+    void probe();
+
+    QString getDeviceNode() const
+    {
+        return deviceNode;
+    }
+
+    // Smallest length the filesystem can be shrunk to, with some room left to use the system
+    qint64 getMinimumLength() const
+    {
+        return minimumBytes;
+    }
+
+    // Whether bytesToMove() is exact, or an estimate from the used space
+    bool isExact() const
+    {
+        return hasBlockMap;
+    }
+
+    // Used bytes beyond newLength, which have to be moved before the partition can end at newLength
+    qint64 bytesToMove(qint64 newLength) const;
+
+    // Length in [minimumLength, maximumLength] that moves the least data: the end of the last used block when
+    // it is known, so nothing has to be moved at all. Without a block map every shrink moves some data, and the
+    // least is moved by shrinking as little as allowed.
+    qint64 leastMoveLength(qint64 minimumLength, qint64 maximumLength) const;
+
+    // Seconds to move the data at the given sequential throughput of the device, every byte is read and written once
+    static double estimateMoveSeconds(qint64 bytes, double bytesPerSecond)
+    {
+        return bytesPerSecond > 0. ? 2. * bytes / bytesPerSecond : -1.;
+    }
+
+    // Bytes written to deviceNode since boot, from the kernel I/O statistics
+    static qint64 deviceBytesWritten(const QString& deviceNode);
+};
+
+// Probes a ShrinkPlanner in a background thread, so the dialog does not freeze while large filesystems are read
+class ShrinkProbe : public QThread
+{
+Q_OBJECT
+private:
+    ShrinkPlanner planner;
+    QString deviceNode;     // Device of the partition, to find it again once the probe finished
+
+protected:
+    void run() override
+    {
+        planner.probe();
+    }
+
+public:
+    ShrinkProbe(const ShrinkPlanner& _planner, const QString& _deviceNode, QObject* parent = nullptr)
+        : QThread(parent), planner(_planner), deviceNode(_deviceNode) {};
+
+    // Valid once the thread finished
+    const ShrinkPlanner& getPlanner() const
+    {
+        return planner;
+    }
+
+    QString getDeviceNode() const
+    {
+        return deviceNode;
+    }
+};
+
+#endif
@@ -48,6 +48,10 @@ public:
         connect(loadingTimer, &QTimer::timeout, this, &StatusIndicator::nextFrame);
     }
 
+    Status getStatus() const {
+        return currentStatus;
+    }
+
     void setStatus(Status _status) {
         if (_status == currentStatus)
             return;  // Avoid redundant updates
@@ -0,0 +1,169 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "storageAdvisor.hpp"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+// Read a single line attribute of a block device from sysfs
+static QString readBlockAttribute(const QString& name, const QString& attribute)
+{
+    QFile file("/sys/class/block/" + name + "/" + attribute);
+    if (!file.open(QIODevice::ReadOnly)) return QString();
+    return QString::fromLatin1(file.readAll()).trimmed();
+}
+
+QString StorageAdvisor::diskName(const QString& deviceNode)
+{
+    // /dev/mapper links are resolved to their dm-N node
+    QString name = QFileInfo(QFileInfo(deviceNode).canonicalFilePath()).fileName();
+
+    // Device mapper and md devices sit on top of the disks listed in slaves. The first one is taken as representative.
+    for (int depth = 0; depth < 8 && !name.isEmpty(); depth++)
+    {
+        QStringList slaves = QDir("/sys/class/block/" + name + "/slaves").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        if (slaves.isEmpty()) break;
+        name = slaves.first();
+    }
+
+    // Partitions are directories inside the directory of their disk
+    if (QFile::exists("/sys/class/block/" + name + "/partition"))
+    {
+        name = QFileInfo(QFileInfo("/sys/class/block/" + name).canonicalFilePath()).dir().dirName();
+    }
+
+    if (name.isEmpty() || !QFile::exists("/sys/class/block/" + name))
+    {
+        qWarning() << "StorageAdvisor::diskName(): Could not find the disk of" << deviceNode;
+        return QString();
+    }
+
+    return name;
+}
+
+StorageMedia StorageAdvisor::classify(const QString& deviceNode)
+{
+    QString name = diskName(deviceNode);
+
+    if (name.isEmpty()) return StorageMedia::Unknown;
+
+    StorageMedia media;
+    if (name.startsWith("nvme"))
+    {
+        media = StorageMedia::Nvme;
+    } else if (name.startsWith("mmcblk")) {
+        media = StorageMedia::FlashCard;
+    } else if (QFileInfo("/sys/class/block/" + name).canonicalFilePath().contains("/usb")
+        || readBlockAttribute(name, "removable") == "1") {
+        // USB sticks, card readers and disks in USB enclosures all share the bandwidth and latency of the bus
+        media = StorageMedia::Usb;
+    } else if (readBlockAttribute(name, "queue/rotational") == "1") {
+        media = StorageMedia::Rotational;
+    } else if (readBlockAttribute(name, "queue/rotational") == "0") {
+        media = StorageMedia::SataSsd;
+    } else {
+        media = StorageMedia::Unknown;
+    }
+
+    qDebug() << deviceNode << "is on" << name << "classified as" << mediaName(media);
+    return media;
+}
+
+QString StorageAdvisor::mediaName(StorageMedia media)
+{
+    switch (media)
+    {
+        case StorageMedia::Nvme:       return "SSD NVMe";
+        case StorageMedia::SataSsd:    return "SSD SATA";
+        case StorageMedia::Rotational: return "Disco rígido";
+        case StorageMedia::FlashCard:  return "Cartão SD/eMMC";
+        case StorageMedia::Usb:        return "Dispositivo USB";
+        default:                       return "Desconhecido";
+    }
+}
+
+FileSystem::Type StorageAdvisor::rootFileSystem(StorageMedia media)
+{
+    // F2FS writes sequentially in the way the simple controllers of SD cards and eMMC handle best
+    return media == StorageMedia::FlashCard ? FileSystem::Type::F2fs : FileSystem::Type::Ext4;
+}
+
+QStringList StorageAdvisor::mountOptions(StorageMedia media, FileSystem::Type type)
+{
+    // Updating access times turns every read into a write
+    QStringList options = { "noatime" };
+
+    // Slow flash media commit the journal less often, batching small writes
+    if ((media == StorageMedia::FlashCard || media == StorageMedia::Usb)
+        && (type == FileSystem::Type::Ext4 || type == FileSystem::Type::Btrfs))
+    {
+        options << "commit=60";
+    }
+
+    // Copy-on-write fragments files that are rewritten in place, which only costs seeks on rotational disks
+    if (media == StorageMedia::Rotational && type == FileSystem::Type::Btrfs)
+    {
+        options << "autodefrag";
+    }
+
+    return options;
+}
+
+QStringList StorageAdvisor::mkfsFeatures(StorageMedia media, FileSystem::Type type)
+{
+    Q_UNUSED(media)
+
+    switch (type)
+    {
+        // fsync only writes the changed inodes to a small journal area instead of committing a whole transaction
+        case FileSystem::Type::Ext4: return { "fast_commit" };
+        case FileSystem::Type::F2fs: return { "extra_attr", "inode_checksum", "sb_checksum" };
+        default:                     return QStringList();
+    }
+}
+
+QString StorageAdvisor::ioScheduler(StorageMedia media)
+{
+    switch (media)
+    {
+        case StorageMedia::Nvme:       return "none";        // The device queues are deep enough to schedule on their own
+        case StorageMedia::Rotational: return "bfq";         // Keeps the desktop responsive while seeking
+        case StorageMedia::SataSsd:
+        case StorageMedia::FlashCard:
+        case StorageMedia::Usb:        return "mq-deadline";
+        default:                       return QString();
+    }
+}
+
+bool StorageAdvisor::periodicTrim(StorageMedia media)
+{
+    return media != StorageMedia::Rotational;
+}
+
+QString StorageAdvisor::udevRules()
+{
+    const QString rule = "ACTION==\"add|change\", ENV{DEVTYPE}==\"disk\", KERNEL==\"%1\", %2ATTR{queue/scheduler}=\"%3\"\n";
+
+    QString rules = "# I/O schedulers by media, written by the DelphinOS installer\n";
+    rules += rule.arg("nvme[0-9]*", "", ioScheduler(StorageMedia::Nvme));
+    rules += rule.arg("mmcblk[0-9]*", "", ioScheduler(StorageMedia::FlashCard));
+    rules += rule.arg("sd[a-z]*", "ATTR{queue/rotational}==\"0\", ", ioScheduler(StorageMedia::SataSsd));
+    rules += rule.arg("sd[a-z]*", "ATTR{queue/rotational}==\"1\", ", ioScheduler(StorageMedia::Rotational));
+    return rules;
+}
@@ -0,0 +1,67 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QString>
+#include <QStringList>
+#include <kpmcore/fs/filesystem.h>
+
+#ifndef STORAGEADVISOR_H
+#define STORAGEADVISOR_H
+
+// Kind of storage a block device is, as far as the installed system should be tuned for it
+enum class StorageMedia
+{
+    Nvme,
+    SataSsd,
+    Rotational,
+    FlashCard,      // SD cards and eMMC
+    Usb,
+    Unknown
+};
+
+// Chooses the filesystem, mount options, I/O scheduler and TRIM policy of the installed system from the
+// storage its root is on. The media is classified from sysfs, nothing is read from the device itself.
+namespace StorageAdvisor
+{
+    // Name of the whole disk holding deviceNode, following partitions and device mapper devices down to the disk.
+    // Empty if it can not be found in sysfs.
+    QString diskName(const QString& deviceNode);
+
+    StorageMedia classify(const QString& deviceNode);
+
+    // Human-readable name of the media, shown to the user
+    QString mediaName(StorageMedia media);
+
+    FileSystem::Type rootFileSystem(StorageMedia media);
+
+    // Mount options of the root filesystem on the installed system
+    QStringList mountOptions(StorageMedia media, FileSystem::Type type);
+
+    // Filesystem features enabled when the root filesystem is created
+    QStringList mkfsFeatures(StorageMedia media, FileSystem::Type type);
+
+    // Multi-queue I/O scheduler for the media, empty to keep the kernel default
+    QString ioScheduler(StorageMedia media);
+
+    // Whether the fstrim timer should discard the free space periodically
+    bool periodicTrim(StorageMedia media);
+
+    // udev rules selecting the I/O scheduler of every disk of the installed system by its media
+    QString udevRules();
+}
+
+#endif
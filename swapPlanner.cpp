@@ -0,0 +1,83 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "swapPlanner.hpp"
+#include <QDebug>
+#include <algorithm>
+#include <sys/sysinfo.h>
+#include <sys/statvfs.h>
+
+static const qint64 MiB = 1024 * 1024;
+static const qint64 GiB = MiB * 1024;
+
+qint64 SwapPlanner::totalMemoryBytes()
+{
+    struct sysinfo info;
+    if (sysinfo(&info) != 0)
+    {
+        qWarning() << "SwapPlanner::totalMemoryBytes(): Could not read the total memory";
+        return 0;
+    }
+    return static_cast<qint64>(info.totalram) * info.mem_unit;
+}
+
+qint64 SwapPlanner::fileSystemBytes(const QString& mountPoint)
+{
+    struct statvfs info;
+    if (statvfs(mountPoint.toLocal8Bit().constData(), &info) != 0)
+    {
+        qWarning() << "SwapPlanner::fileSystemBytes(): Could not read the size of" << mountPoint;
+        return 0;
+    }
+    return static_cast<qint64>(info.f_blocks) * info.f_frsize;
+}
+
+SwapPlan SwapPlanner::plan(qint64 memoryBytes, qint64 rootFileSystemBytes, bool createSwapFile)
+{
+    SwapPlan swapPlan;
+
+    if (memoryBytes <= 0) return swapPlan;
+
+    // zram only takes memory as pages are swapped out, compressed around 3:1 by zstd. Small machines get
+    // as much zram as memory, larger ones half of it, and it is never worth more than 8 GiB.
+    qint64 zramBytes = memoryBytes <= 4 * GiB ? memoryBytes : std::min(memoryBytes / 2, 8 * GiB);
+    swapPlan.zramSizeMiB = zramBytes / MiB;
+
+    // The swap file backs zram when memory runs out. It grows with memory up to 8 GiB, and takes at
+    // most a tenth of the root filesystem, so small disk layouts are not eaten by swap.
+    if (createSwapFile)
+    {
+        qint64 swapFileBytes = std::clamp(memoryBytes, 2 * GiB, 8 * GiB);
+
+        if (rootFileSystemBytes > 0)
+        {
+            swapFileBytes = std::min(swapFileBytes, rootFileSystemBytes / 10);
+        }
+
+        // Too small to be useful
+        if (swapFileBytes >= 512 * MiB)
+        {
+            swapPlan.swapFileSizeMiB = swapFileBytes / MiB;
+        }
+    }
+
+    qDebug() << "Swap plan for" << memoryBytes / MiB << "MiB of memory and a root of" << rootFileSystemBytes / MiB << "MiB - zram:"
+             << swapPlan.zramSizeMiB << "MiB swap file:" << swapPlan.swapFileSizeMiB << "MiB";
+
+    return swapPlan;
+}
@@ -0,0 +1,44 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <QtGlobal>
+#include <QString>
+
+#ifndef SWAPPLANNER_H
+#define SWAPPLANNER_H
+
+// Sizes of the compressed swap in RAM and of the optional swap file of the installed system, in MiB
+struct SwapPlan
+{
+    qint64 zramSizeMiB = 0;
+    qint64 swapFileSizeMiB = 0;    // 0 when no swap file is created
+};
+
+// Sizes zram and the swap file from the memory of the machine and the size of the root filesystem
+namespace SwapPlanner
+{
+    // Total memory of the machine in bytes, 0 if it can not be read
+    qint64 totalMemoryBytes();
+
+    // Total size of the filesystem mounted on mountPoint in bytes, 0 if it can not be read
+    qint64 fileSystemBytes(const QString& mountPoint);
+
+    SwapPlan plan(qint64 memoryBytes, qint64 rootFileSystemBytes, bool createSwapFile);
+}
+
+#endif
@@ -19,6 +19,51 @@ done
 
 echo "Installation finished successfully"
 
+# The busybox initramfs only mounts a multi-device Btrfs root once the btrfs hook scanned its devices.
+# The systemd based initramfs waits for them through udev by itself.
+if [ "${rootDeviceCount:-1}" -gt 1 ] && ! grep -q '^HOOKS=.*\bsystemd\b' /etc/mkinitcpio.conf; then
+    sed -i 's/^\(HOOKS=.*\)\bfilesystems\b/\1btrfs filesystems/' /etc/mkinitcpio.conf
+    mkinitcpio -P
+fi
+
+# Unlock an encrypted root from the initramfs. Both the busybox and the systemd based initramfs are supported.
+if [ -n "$cryptUuid" ]; then
+    if grep -q '^HOOKS=.*\bsystemd\b' /etc/mkinitcpio.conf; then
+        sed -i 's/^\(HOOKS=.*\)\bfilesystems\b/\1sd-encrypt filesystems/' /etc/mkinitcpio.conf
+        crypt_cmdline="rd.luks.name=$cryptUuid=$cryptName root=/dev/mapper/$cryptName"
+    else
+        sed -i 's/^\(HOOKS=.*\)\bfilesystems\b/\1encrypt filesystems/' /etc/mkinitcpio.conf
+        crypt_cmdline="cryptdevice=UUID=$cryptUuid:$cryptName root=/dev/mapper/$cryptName"
+    fi
+
+    # Adiantum is not autodetected when the live system did not load it
+    if cryptsetup luksDump "/dev/disk/by-uuid/$cryptUuid" | grep -q adiantum; then
+        echo "MODULES+=(adiantum xchacha12 nhpoly1305)" >> /etc/mkinitcpio.conf
+    fi
+
+    sed -i "s|^GRUB_CMDLINE_LINUX=\"|GRUB_CMDLINE_LINUX=\"$crypt_cmdline |" /etc/default/grub
+    mkinitcpio -P
+fi
+
+# grub-mkconfig finds the other operating systems detected by the installer through wrappers of os-prober
+# and linux-boot-prober that print the cached results, instead of probing every partition again
+os_prober_cache=/systemInstallation/osProberCache
+grub_mkconfig_env=()
+if [ -f "$os_prober_cache/os-prober" ]; then
+    mkdir -p "$os_prober_cache/bin"
+    cat > "$os_prober_cache/bin/os-prober" <<EOF
+#!/bin/sh
+cat $os_prober_cache/os-prober
+EOF
+    cat > "$os_prober_cache/bin/linux-boot-prober" <<EOF
+#!/bin/sh
+cat "$os_prober_cache/linux-boot-prober/\$(echo "\$1" | tr / _)" 2>/dev/null
+exit 0
+EOF
+    chmod +x "$os_prober_cache"/bin/*
+    grub_mkconfig_env=(PATH="$os_prober_cache/bin:$PATH" GRUB_DISABLE_OS_PROBER=false)
+fi
+
 # Detect if system is UEFI or BIOS and install the bootloader accordingly
 if [ -d /sys/firmware/efi ]; then
     setInstallationProgress "INSTALLING:UEFI bootloader:"
@@ -28,7 +73,7 @@ if [ -d /sys/firmware/efi ]; then
         exit 2
     fi
     setInstallationProgress "CONFIGURING:UEFI bootloader:"
-    grub-mkconfig -o /boot/grub/grub.cfg
+    env "${grub_mkconfig_env[@]}" grub-mkconfig -o /boot/grub/grub.cfg
     if [ $? -ne 0 ]; then
         echo "ERROR:Could not generate UEFI bootloader configuration:"
         exit 3
@@ -50,7 +95,7 @@ else
         exit 2
     fi
     setInstallationProgress "CONFIGURING:BIOS bootloader:"
-    grub-mkconfig -o /boot/grub/grub.cfg
+    env "${grub_mkconfig_env[@]}" grub-mkconfig -o /boot/grub/grub.cfg
         if [ $? -ne 0 ]; then
         echo "ERROR:generating BIOS bootloader configuration:"
         exit 3
@@ -65,5 +110,11 @@ setInstallationProgress "ACTIVATING:iwd:"
 systemctl enable iwd
 setInstallationProgress "ACTIVATING:sddm:"
 systemctl enable sddm
+# Filesystems are created without discarding free space, so it is trimmed in batches periodically instead.
+# Rotational disks have nothing to trim.
+setInstallationProgress "ACTIVATING:fstrim.timer:"
+if [ "${periodicTrim:-1}" != 0 ]; then
+    systemctl enable fstrim.timer
+fi
 
 exit 0
\ No newline at end of file
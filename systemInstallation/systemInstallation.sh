@@ -32,7 +32,10 @@ installationProcedureList+=(
   "ACTIVATING:NetworkManager:",
   "ACTIVATING:iwd:",
   "ACTIVATING:sddm:",
-  "GENERATING:fstab:"
+  "ACTIVATING:fstrim.timer:",
+  "GENERATING:fstab:",
+  "CONFIGURING:storage:",
+  "CONFIGURING:swap:"
 )
 
 procedureCount=${#installationProcedureList[@]}
@@ -64,6 +67,31 @@ if ! findmnt $newroot > /dev/null; then
     exit 2;
 fi
 
+# Sectors written to the device of the new root are reported at the end, to compare installations with and without compression
+root_source=$(findmnt -n -o SOURCE "$newroot" | sed 's/\[.*\]$//')
+root_stat="/sys/class/block/$(basename "$(realpath "$root_source")")/stat"
+sectors_written_before=$(awk '{print $7}' "$root_stat" 2>/dev/null || echo 0)
+
+# An encrypted root is unlocked by the initramfs, which needs the UUID of the LUKS partition
+crypt_name=""
+crypt_uuid=""
+if [ "$(lsblk -n -d -o TYPE "$root_source" 2>/dev/null)" = "crypt" ]; then
+  crypt_name=$(basename "$root_source")
+  crypt_device=$(cryptsetup status "$crypt_name" | awk '$1 == "device:" {print $2}')
+  if ! crypt_uuid=$(blkid -s UUID -o value "$crypt_device") || [ -z "$crypt_uuid" ]; then
+    echo "ERROR:Could not detect the encrypted root partition:"
+    exit 4
+  fi
+  echo "Root is encrypted: $crypt_device ($crypt_uuid) opened as $crypt_name"
+fi
+
+# A Btrfs root striped across several devices must have all of them registered by the initramfs before it is mounted
+root_device_count=1
+if [ "$(findmnt -n -o FSTYPE "$newroot")" = "btrfs" ]; then
+  root_device_count=$(btrfs filesystem show "$newroot" | grep -c 'devid' || true)
+  echo "Root filesystem spans $root_device_count device(s)"
+fi
+
 setInstallationProgress "PREPARE NEW ROOT:"
 
 # Ensure required directories exist
@@ -78,7 +106,17 @@ if [ -d /etc/pacman.d/gnupg ]; then
   cp -a /etc/pacman.d/gnupg "$newroot/etc/pacman.d/"
 fi
 
-if [ -f /etc/pacman.d/mirrorlist ]; then
+# The mirrors ranked by the installer are used by the installation and kept by the installed system. The host
+# pacman reads them through a temporary configuration, so the mirrorlist of the live system is left untouched.
+pacman_config=/etc/pacman.conf
+
+if [ -n "${DELPHINOS_MIRRORLIST:-}" ] && [ -s "$DELPHINOS_MIRRORLIST" ]; then
+  cp "$DELPHINOS_MIRRORLIST" "$newroot/etc/pacman.d/mirrorlist"
+
+  pacman_config=$(mktemp -t delphinos-pacman.XXXXXX.conf)
+  sed "s|^Include *= */etc/pacman.d/mirrorlist *$|Include = $DELPHINOS_MIRRORLIST|" /etc/pacman.conf > "$pacman_config"
+  echo "Using the ranked mirrorlist"
+elif [ -f /etc/pacman.d/mirrorlist ]; then
   cp /etc/pacman.d/mirrorlist "$newroot/etc/pacman.d/"
 fi
 
@@ -86,6 +124,11 @@ echo "Copying installation scripts to new root"
 mkdir -p $newroot/systemInstallation
 cp -v -r "$script_dir" "$newroot"
 
+# Other operating systems were detected by the installer in the background, so the bootloader configuration uses the cache
+if [ -f /tmp/delphinos-installer/os-prober/os-prober ]; then
+  cp -r /tmp/delphinos-installer/os-prober "$newroot/systemInstallation/osProberCache"
+fi
+
 echo "Running chroot setup"
 chroot_setup $newroot
 
@@ -94,11 +137,17 @@ packages_str="${packages[*]}"
 export DBPATH=/var/lib/pacman/
 
 sudo rm -f "/mnt/new_root/var/lib/pacman/db.lck"
+
+# The installer downloaded the packages into the cache of the new root
 setInstallationProgress "INSTALLING:base:"
-pacman --noconfirm --root $newroot -Sy base
+pacman --noconfirm --config "$pacman_config" --root $newroot --cachedir "$newroot/var/cache/pacman/pkg" -Sy base
 
 setInstallationProgress "INSTALLING:grub:"
-pacman --noconfirm --root $newroot -Sy grub
+pacman --noconfirm --config "$pacman_config" --root $newroot --cachedir "$newroot/var/cache/pacman/pkg" -Sy grub
+
+if [ "$pacman_config" != /etc/pacman.conf ]; then
+  rm -f "$pacman_config"
+fi
 
 echo "Chrooting on $newroot and running /systemInstallation/installPackages.sh $packages_str"
 
@@ -107,21 +156,139 @@ installationProcedureListStr=$(IFS=,; echo "${installationProcedureList[*]}")
 chroot $newroot env \
   installationProcedureList="$installationProcedureListStr" \
   installationProgress="$installationProgress" \
+  cryptName="$crypt_name" \
+  cryptUuid="$crypt_uuid" \
+  rootDeviceCount="$root_device_count" \
+  periodicTrim="${DELPHINOS_PERIODIC_TRIM:-1}" \
   /systemInstallation/installPackages.sh $packages_str
 
 chroot_teardown
 
 cp -v -r $newroot/systemInstallation/systemFiles/* $newroot
 
+# ParallelDownloads of the installed system is the download concurrency the installer tuned on this connection
+if [ -n "${DELPHINOS_PARALLEL_DOWNLOADS:-}" ]; then
+  sed -i "s/^#\?ParallelDownloads.*/ParallelDownloads = $DELPHINOS_PARALLEL_DOWNLOADS/" "$newroot/etc/pacman.conf"
+fi
+
 rm -r $newroot/systemInstallation
 
 setInstallationProgress "GENERATING:fstab:"
 
-genfstab $newroot > $newroot/etc/fstab
+# Filesystems are referred to by UUID, so the root entry can be found again below and device renames do not matter
+genfstab -U $newroot > $newroot/etc/fstab
 
 if [ $? -ne 0 ]; then
   echo "ERROR:Could not generate fstab file:"
   exit 3
 fi
 
-echo "Successfully generated fstab file for $newroot"
\ No newline at end of file
+echo "Successfully generated fstab file for $newroot"
+
+# genfstab copies the options the root happened to be mounted with during the installation. The options
+# chosen by the installer for the media of the root are merged into every fstab line of the root filesystem.
+setInstallationProgress "CONFIGURING:storage:"
+
+root_mount_options=${DELPHINOS_ROOT_MOUNT_OPTIONS:-}
+root_uuid=$(findmnt -n -o UUID "$newroot" || true)
+
+if [ -n "$root_mount_options" ] && [ -n "$root_uuid" ]; then
+  awk -v source="UUID=$root_uuid" -v extra="$root_mount_options" '
+    $1 == source {
+      count = split(extra, options, ",")
+      for (i = 1; i <= count; i++) {
+        name = options[i]
+        sub(/=.*/, "", name)
+        # noatime replaces the other access time policies
+        if (name == "noatime") gsub(/(^|,)(relatime|strictatime|atime)(,|$)/, ",", $4)
+        if ($4 !~ "(^|,)" name "(=|,|$)") $4 = $4 "," options[i]
+      }
+      gsub(/,,+/, ",", $4); sub(/^,/, "", $4); sub(/,$/, "", $4)
+    }
+    { print }' $newroot/etc/fstab > $newroot/etc/fstab.new
+  mv $newroot/etc/fstab.new $newroot/etc/fstab
+
+  # Every line of the root filesystem must now carry every option
+  missing_options=$(awk -v source="UUID=$root_uuid" -v extra="$root_mount_options" '
+    $1 == source {
+      found = 1
+      count = split(extra, options, ",")
+      for (i = 1; i <= count; i++) if ($4 !~ "(^|,)" options[i] "(,|$)") print options[i]
+    }
+    END { if (!found) print "(no entry for " source ")" }' $newroot/etc/fstab)
+
+  if [ -n "$missing_options" ]; then
+    echo "Warning: Root mount options missing from fstab: $(echo $missing_options)"
+  else
+    echo "Root mount options: $root_mount_options"
+  fi
+fi
+
+if [ -n "${DELPHINOS_IO_SCHEDULER_RULES:-}" ]; then
+  mkdir -p $newroot/etc/udev/rules.d
+  printf '%s' "$DELPHINOS_IO_SCHEDULER_RULES" > $newroot/etc/udev/rules.d/60-ioschedulers.rules
+  echo "Wrote I/O scheduler rules"
+fi
+
+# zram and swap file sizes are calculated by the installer from the memory and the size of the new root
+setInstallationProgress "CONFIGURING:swap:"
+
+zram_size_mib=${DELPHINOS_ZRAM_SIZE_MIB:-0}
+swapfile_size_mib=${DELPHINOS_SWAPFILE_SIZE_MIB:-0}
+
+if [ "$zram_size_mib" -gt 0 ]; then
+  mkdir -p $newroot/etc/systemd $newroot/etc/sysctl.d
+  cat > $newroot/etc/systemd/zram-generator.conf <<EOF
+[zram0]
+zram-size = $zram_size_mib
+compression-algorithm = zstd
+swap-priority = 100
+EOF
+
+  # Swapping to zram is cheap, so the kernel should prefer it over dropping the page cache
+  cat > $newroot/etc/sysctl.d/99-vm-zram-parameters.conf <<EOF
+vm.swappiness = 180
+vm.watermark_boost_factor = 0
+vm.watermark_scale_factor = 125
+vm.page-cluster = 0
+EOF
+  echo "Configured $zram_size_mib MiB of zram"
+fi
+
+# Btrfs can only activate swap files on single device filesystems, so a striped root swaps to zram only
+if [ "$swapfile_size_mib" -gt 0 ] && [ "$root_device_count" -gt 1 ]; then
+  echo "Root filesystem spans $root_device_count devices, skipping the swap file"
+  swapfile_size_mib=0
+fi
+
+if [ "$swapfile_size_mib" -gt 0 ]; then
+  # The swap file is allocated instantly instead of being filled with zeros. On Btrfs it lives in the @swap
+  # subvolume and must not be copy-on-write or compressed, which mkswapfile takes care of.
+  if [ "$(findmnt -n -o FSTYPE "$newroot")" = "btrfs" ]; then
+    swapfile=/swap/swapfile
+  else
+    swapfile=/swapfile
+  fi
+
+  create_swapfile() {
+    if [ "$swapfile" = "/swap/swapfile" ]; then
+      btrfs filesystem mkswapfile --size "${swapfile_size_mib}m" "$1"
+    else
+      fallocate -l "${swapfile_size_mib}MiB" "$1" && chmod 600 "$1" && mkswap "$1"
+    fi
+  }
+
+  if create_swapfile "$newroot$swapfile"; then
+    echo "$swapfile none swap defaults,pri=10 0 0" >> $newroot/etc/fstab
+    echo "Created a swap file of $swapfile_size_mib MiB"
+  else
+    echo "Warning: Could not create the swap file, continuing with zram only"
+    rm -f "$newroot$swapfile"
+  fi
+fi
+
+# Report the bytes written on the new root during the installation. The stat file always counts 512 byte sectors.
+sync
+sectors_written_after=$(awk '{print $7}' "$root_stat" 2>/dev/null || echo 0)
+root_compression=$(findmnt -n -o OPTIONS "$newroot" | grep -o 'compress=[^,]*' || echo "none")
+echo "BYTESWRITTEN:$(( (sectors_written_after - sectors_written_before) * 512 )):$root_compression:"
\ No newline at end of file
@@ -19,7 +19,6 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <QLineEdit>
 #include <QCheckBox>
 #include <QPointer>
-#include <QProcess>
 #include <QRegularExpression>
 
 UsersPage::UsersPage(QWidget* parent) : QWidget(parent)
@@ -102,12 +101,61 @@ UsersPage::UsersPage(QWidget* parent) : QWidget(parent)
 
 
     
+    // The installation goes on while the users are configured, and creates them once it finishes
+    QHBoxLayout* installationStatusLayout = new QHBoxLayout;
+    installationStatusIndicator = new StatusIndicator;
+    installationStatusLabel = new QLabel;
+    installationStatusLabel->setWordWrap(true);
+    installationStatusLayout->addWidget(installationStatusIndicator);
+    installationStatusLayout->addWidget(installationStatusLabel, 1);
+    page->addLayout(installationStatusLayout);
+
     // Confirmation button
     confirmButton = new QPushButton("Confirmar");
     connect(confirmButton, &QPushButton::clicked, this, &UsersPage::onConfirmButtonClicked);
     page->addWidget(confirmButton, 0, Qt::AlignRight);
 }
 
+void UsersPage::setInputsEnabled(bool enabled)
+{
+    rootPasswordLineEdit->setEnabled(enabled);
+    rootPasswordConfirmLineEdit->setEnabled(enabled);
+
+    usernameLineEdit->setEnabled(enabled);
+    userPasswordLineEdit->setEnabled(enabled);
+    userPasswordConfirmLineEdit->setEnabled(enabled);
+    grantUserAdministrativePrivileges->setEnabled(enabled);
+}
+
+void UsersPage::onInstallationStatusChanged(StatusIndicator::Status status, const QString& text)
+{
+    installationStatusIndicator->setStatus(status);
+    installationStatusLabel->setText(text);
+}
+
+void UsersPage::onUsersApplied(bool success)
+{
+    const QString& username = usernameLineEdit->text();
+
+    if (!success)
+    {
+        setInputsEnabled(true);
+        confirmButton->show();
+        userLabel->setText("<b>Crie o seu usuário</b>");
+        QMessageBox::critical(this, "Erro", "Não foi possível configurar os usuários.", QMessageBox::Ok);
+        return;
+    }
+
+    if (grantUserAdministrativePrivileges->isChecked())
+    {
+        userLabel->setText("Usuário <b>" + username + "</b> criado com sucesso com privilégios administrativos");
+    } else {
+        userLabel->setText("Usuário <b>" + username + "</b> criado com sucesso sem privilégios administrativos");
+    }
+
+    page->setCanAdvance(true);
+}
+
 void UsersPage::onRootPasswordConfirmLineChanged(const QString& text)
 {
     QTimer* timer = new QTimer;
@@ -223,58 +271,18 @@ void UsersPage::onConfirmButtonClicked(bool checked)
     if (confirmationDialog.exec() != QMessageBox::Ok)
     {
         return;
-    } else {
-        const QString& rootPassword = rootPasswordLineEdit->text();
-        const QString& userPassword = userPasswordLineEdit->text();
-
-        QString grantUserAdministrativePrivilegesCmd = "";
-
-        QProcess* configureUsersProcess = new QProcess;
-        QStringList arguments;
-        arguments << "/mnt/new_root" << "/bin/bash" << "-c"
-                  << "echo root:" + rootPassword + " | chpasswd; "
-                     "useradd -m " + username + "; "
-                     "echo " + username + ":" + userPassword + " | chpasswd; "
-                     + (grantUserAdministrativePrivileges->isChecked() ? "usermod -aG wheel " + username + ";" : "")
-                     + "exit;";
-
-        configureUsersProcess->start("chroot", arguments);
-
-        connect(configureUsersProcess, &QProcess::readyReadStandardOutput, this, [configureUsersProcess]() {
-            qDebug() << configureUsersProcess->readAllStandardOutput();
-        });
-        
-        connect(configureUsersProcess, &QProcess::readyReadStandardError, this, [configureUsersProcess]() {
-            qDebug() << configureUsersProcess->readAllStandardError();
-        });
-
-        connect(configureUsersProcess, &QProcess::finished, this, [this, username](int exitCode, QProcess::ExitStatus processStatus){
-            if (exitCode != 0 || processStatus == QProcess::ExitStatus::CrashExit)
-            {
-                QMessageBox::critical(this, "Erro", "Não foi possível configurar os usuários.", QMessageBox::Ok);
-                return;
-            } else {
-                
-                rootPasswordLineEdit->setEnabled(false);
-                rootPasswordConfirmLineEdit->setEnabled(false);
-
-                usernameLineEdit->setEnabled(false);
-                userPasswordLineEdit->setEnabled(false);
-                userPasswordConfirmLineEdit->setEnabled(false);
-                grantUserAdministrativePrivileges->setEnabled(false);
-
-
-                if (grantUserAdministrativePrivileges->isChecked())
-                {
-                    userLabel->setText("Usuário <b>" + username + "</b> criado com sucesso com privilégios administrativos");
-                } else {
-                    userLabel->setText("Usuário <b>" + username + "</b> criado com sucesso sem privilégios administrativos");
-                }
-
-                confirmButton->hide();
-                page->setCanAdvance(true);
-            }
-        });
-
     }
+
+    // Users are created by the installation as its last step, which may still be running
+    UserAccounts users;
+    users.rootPassword = rootPassword;
+    users.username = username;
+    users.userPassword = userPassword;
+    users.administrator = grantUserAdministrativePrivileges->isChecked();
+
+    setInputsEnabled(false);
+    confirmButton->hide();
+    userLabel->setText("Usuário <b>" + username + "</b> será criado ao final da instalação");
+
+    emit usersConfirmed(users);
 }
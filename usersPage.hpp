@@ -19,6 +19,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "statusIndicator.hpp"
 #include <QFile>
 
+#ifndef USERSPAGE_H
+#define USERSPAGE_H
+
+// Users confirmed on the users page, created by the installation as its last step
+struct UserAccounts
+{
+    QString rootPassword;
+    QString username;
+    QString userPassword;
+    bool administrator = false;
+};
+
 class UsersPage : public QWidget
 {
 Q_OBJECT
@@ -52,6 +64,12 @@ private:
     StatusIndicator* usersConfiguredIndicator;
     QLabel* usersConfiguredLabel;
 
+    // Progress of the installation, which runs while the users are configured
+    StatusIndicator* installationStatusIndicator;
+    QLabel* installationStatusLabel;
+
+    void setInputsEnabled(bool enabled);
+
     QPushButton* confirmButton;
 
     bool isGroupNameUsed(const QString &username) {
@@ -81,4 +99,13 @@ public:
     };
 
     UsersPage(QWidget* parent);
+
+public slots:
+    void onInstallationStatusChanged(StatusIndicator::Status status, const QString& text);
+    void onUsersApplied(bool success);
+
+signals:
+    void usersConfirmed(const UserAccounts& users);
 };
+
+#endif
@@ -0,0 +1,318 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "wifiAccessPointModel.hpp"
+#include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusArgument>
+#include <algorithm>
+
+WifiAccessPointModel::WifiAccessPointModel(QObject* parent) : QObject(parent)
+{
+    scanDebounceTimer.setSingleShot(true);
+    scanDebounceTimer.setInterval(scanDebounceInterval);
+    connect(&scanDebounceTimer, &QTimer::timeout, this, &WifiAccessPointModel::startScan);
+
+    scanTimeoutTimer.setSingleShot(true);
+    scanTimeoutTimer.setInterval(scanTimeout);
+    connect(&scanTimeoutTimer, &QTimer::timeout, this, [this]() {
+        qWarning() << "The scan of" << devicePath.path() << "did not finish";
+        finishScan(false);
+    });
+}
+
+void WifiAccessPointModel::setDevice(const NetworkDevice* device, const NetworkObjectTree* tree)
+{
+    if (!device)
+    {
+        clear();
+        return;
+    }
+
+    if (device != networkDevice || device->dbusPath != devicePath)
+    {
+        clear();
+        networkDevice = device;
+        devicePath = device->dbusPath;
+        subscribe();
+
+        // The access points NetworkManager has cached may be old, so a newly selected device is rescanned
+        requestScan();
+    }
+
+    // Reconcile with the snapshot. Known access points only have their strength updated.
+    QSet<QString> currentAccessPoints;
+    QVariant accessPointsProperty = tree->properties(devicePath, NM_WIRELESS_INTERFACE).value("AccessPoints");
+
+    for (const QDBusObjectPath& accessPointPath : qdbus_cast<QList<QDBusObjectPath>>(accessPointsProperty))
+    {
+        QVariantMap accessPointProperties = tree->properties(accessPointPath, NM_ACCESS_POINT_INTERFACE);
+        currentAccessPoints.insert(accessPointPath.path());
+
+        if (networkByAccessPoint.contains(accessPointPath.path()))
+        {
+            updateStrength(accessPointPath.path(), accessPointProperties.value("Strength").toUInt());
+        } else {
+            addAccessPoint(accessPointPath, accessPointProperties);
+        }
+    }
+
+    for (const QString& knownAccessPoint : networkByAccessPoint.keys())
+    {
+        if (!currentAccessPoints.contains(knownAccessPoint)) removeAccessPoint(knownAccessPoint);
+    }
+}
+
+void WifiAccessPointModel::clear()
+{
+    unsubscribe();
+    generation++;
+
+    if (isScanning())
+    {
+        scanDebounceTimer.stop();
+        finishScan(false);
+    }
+
+    while (!networks.isEmpty())
+    {
+        WifiAccessPoint* network = networks.takeLast();
+        emit rowRemoved(networks.count());
+        network->deleteLater();
+    }
+
+    networkBySsid.clear();
+    networkByAccessPoint.clear();
+    pendingAccessPoints.clear();
+    networkDevice = nullptr;
+    devicePath = QDBusObjectPath();
+}
+
+void WifiAccessPointModel::subscribe()
+{
+    QDBusConnection bus = networkBus();
+    bus.connect(NM_SERVICE, devicePath.path(), NM_WIRELESS_INTERFACE, "AccessPointAdded", this, SLOT(onAccessPointAdded(QDBusObjectPath)));
+    bus.connect(NM_SERVICE, devicePath.path(), NM_WIRELESS_INTERFACE, "AccessPointRemoved", this, SLOT(onAccessPointRemoved(QDBusObjectPath)));
+
+    // A single match for the property changes of every access point, instead of one per access point
+    bus.connect(NM_SERVICE, QString(), "org.freedesktop.DBus.Properties", "PropertiesChanged",
+        this, SLOT(onPropertiesChanged(QString, QVariantMap, QStringList, QDBusMessage)));
+}
+
+void WifiAccessPointModel::unsubscribe()
+{
+    if (devicePath.path().isEmpty()) return;
+
+    QDBusConnection bus = networkBus();
+    bus.disconnect(NM_SERVICE, devicePath.path(), NM_WIRELESS_INTERFACE, "AccessPointAdded", this, SLOT(onAccessPointAdded(QDBusObjectPath)));
+    bus.disconnect(NM_SERVICE, devicePath.path(), NM_WIRELESS_INTERFACE, "AccessPointRemoved", this, SLOT(onAccessPointRemoved(QDBusObjectPath)));
+    bus.disconnect(NM_SERVICE, QString(), "org.freedesktop.DBus.Properties", "PropertiesChanged",
+        this, SLOT(onPropertiesChanged(QString, QVariantMap, QStringList, QDBusMessage)));
+}
+
+void WifiAccessPointModel::requestScan()
+{
+    if (devicePath.path().isEmpty() || scanning) return;
+
+    if (!scanDebounceTimer.isActive()) emit scanStarted();
+
+    // Every request within the interval restarts it, so a burst of refreshes sends a single RequestScan
+    scanDebounceTimer.start();
+}
+
+void WifiAccessPointModel::startScan()
+{
+    if (devicePath.path().isEmpty()) return;
+
+    scanning = true;
+
+    QDBusMessage requestScan = QDBusMessage::createMethodCall(NM_SERVICE, devicePath.path(), NM_WIRELESS_INTERFACE, "RequestScan");
+    requestScan << QVariantMap();
+
+    QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(networkBus().asyncCall(requestScan), this);
+    const quint64 requestGeneration = generation;
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, requestGeneration](QDBusPendingCallWatcher* watcher) {
+        QDBusPendingReply<> reply = *watcher;
+        watcher->deleteLater();
+
+        if (requestGeneration != generation) return;
+
+        // NetworkManager refuses a scan right after another one, whose results are already listed
+        if (reply.isError())
+        {
+            qWarning() << "Could not scan with" << devicePath.path() << ":" << reply.error().message();
+            finishScan(false);
+            return;
+        }
+
+        // The access points found stream in through AccessPointAdded, until LastScan is updated
+        scanTimeoutTimer.start();
+    });
+}
+
+void WifiAccessPointModel::finishScan(bool success)
+{
+    scanning = false;
+    scanTimeoutTimer.stop();
+    emit scanFinished(success);
+}
+
+int WifiAccessPointModel::sortedRow(const WifiAccessPoint* network) const
+{
+    return std::lower_bound(networks.constBegin(), networks.constEnd(), network, &WifiAccessPointModel::isStronger) - networks.constBegin();
+}
+
+void WifiAccessPointModel::addAccessPoint(const QDBusObjectPath& path, const QVariantMap& properties)
+{
+    QString ssid = QString::fromUtf8(properties.value("Ssid").toByteArray());
+
+    // Hidden networks do not broadcast their SSID
+    if (ssid.isEmpty()) return;
+
+    uint strength = properties.value("Strength").toUInt();
+
+    if (WifiAccessPoint* network = networkBySsid.value(ssid))
+    {
+        network->strengths.insert(path.path(), strength);
+        networkByAccessPoint.insert(path.path(), network);
+        resort(network);
+        return;
+    }
+
+    WifiAccessPoint* network = new WifiAccessPoint(path, networkDevice, ssid, this);
+    network->strengths.insert(path.path(), strength);
+    networkBySsid.insert(ssid, network);
+    networkByAccessPoint.insert(path.path(), network);
+
+    int row = sortedRow(network);
+    networks.insert(row, network);
+    emit rowInserted(row);
+}
+
+void WifiAccessPointModel::updateStrength(const QString& path, uint strength)
+{
+    WifiAccessPoint* network = networkByAccessPoint.value(path);
+
+    if (!network || network->strengths.value(path) == strength) return;
+
+    network->strengths.insert(path, strength);
+    resort(network);
+}
+
+void WifiAccessPointModel::removeAccessPoint(const QString& path)
+{
+    WifiAccessPoint* network = networkByAccessPoint.take(path);
+
+    if (!network) return;
+
+    network->strengths.remove(path);
+
+    if (!network->strengths.isEmpty())
+    {
+        resort(network);
+        return;
+    }
+
+    int row = networks.indexOf(network);
+    networks.removeAt(row);
+    networkBySsid.remove(network->ssid);
+    emit rowRemoved(row);
+    network->deleteLater();
+}
+
+void WifiAccessPointModel::resort(WifiAccessPoint* network)
+{
+    network->selectStrongest();
+
+    int from = networks.indexOf(network);
+    networks.removeAt(from);
+
+    int to = sortedRow(network);
+    networks.insert(to, network);
+
+    if (from != to) emit rowMoved(from, to);
+    emit rowChanged(to);
+}
+
+void WifiAccessPointModel::onAccessPointAdded(const QDBusObjectPath& path)
+{
+    if (networkByAccessPoint.contains(path.path()) || pendingAccessPoints.contains(path.path())) return;
+
+    pendingAccessPoints.insert(path.path());
+
+    // The SSID and strength of the new access point arrive in a single asynchronous GetAll call
+    QDBusMessage getAll = QDBusMessage::createMethodCall(NM_SERVICE, path.path(), "org.freedesktop.DBus.Properties", "GetAll");
+    getAll << NM_ACCESS_POINT_INTERFACE;
+
+    QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(networkBus().asyncCall(getAll), this);
+    const quint64 requestGeneration = generation;
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, path, requestGeneration](QDBusPendingCallWatcher* watcher) {
+        QDBusPendingReply<QVariantMap> reply = *watcher;
+        watcher->deleteLater();
+
+        // The device changed, or the access point disappeared, while the properties were fetched
+        if (requestGeneration != generation || !pendingAccessPoints.remove(path.path())) return;
+
+        if (reply.isError())
+        {
+            qWarning() << "Failed to get the properties of access point" << path.path() << ":" << reply.error().message();
+            return;
+        }
+
+        addAccessPoint(path, reply.value());
+    });
+}
+
+void WifiAccessPointModel::onAccessPointRemoved(const QDBusObjectPath& path)
+{
+    pendingAccessPoints.remove(path.path());
+    removeAccessPoint(path.path());
+}
+
+void WifiAccessPointModel::onPropertiesChanged(const QString& interfaceName, const QVariantMap& changedProperties, const QStringList& invalidatedProperties, const QDBusMessage& message)
+{
+    Q_UNUSED(invalidatedProperties)
+
+    if (interfaceName == NM_WIRELESS_INTERFACE && message.path() == devicePath.path())
+    {
+        // The list of the device is authoritative, in case an AccessPointAdded or AccessPointRemoved signal was missed
+        if (changedProperties.contains("AccessPoints"))
+        {
+            QSet<QString> currentAccessPoints;
+            for (const QDBusObjectPath& accessPointPath : qdbus_cast<QList<QDBusObjectPath>>(changedProperties.value("AccessPoints")))
+            {
+                currentAccessPoints.insert(accessPointPath.path());
+                onAccessPointAdded(accessPointPath);
+            }
+
+            for (const QString& knownAccessPoint : networkByAccessPoint.keys())
+            {
+                if (!currentAccessPoints.contains(knownAccessPoint)) onAccessPointRemoved(QDBusObjectPath(knownAccessPoint));
+            }
+        }
+
+        if (scanning && changedProperties.contains("LastScan")) finishScan(true);
+        return;
+    }
+
+    if (interfaceName != NM_ACCESS_POINT_INTERFACE || !changedProperties.contains("Strength")) return;
+
+    updateStrength(message.path(), changedProperties.value("Strength").toUInt());
+}
@@ -0,0 +1,128 @@
+/*                      Delphinos Installer
+              Copyright © Helena Beatrice Xavier Pedro
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "networkDBus.hpp"
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QDBusMessage>
+#include <QTimer>
+
+#ifndef WIFIACCESSPOINTMODEL_H
+#define WIFIACCESSPOINTMODEL_H
+
+// Wi-Fi networks seen by a device, kept up to date from the AccessPointAdded and AccessPointRemoved signals of
+// the device and the Strength changes of every access point. Access points are merged by SSID and the networks
+// are kept sorted by signal strength, strongest first. Every change is reported as a row-level diff, so the
+// list showing the networks is never rebuilt. Rescans are requested asynchronously, and the access points they
+// find stream into the model while the scan runs.
+class WifiAccessPointModel : public QObject
+{
+Q_OBJECT
+private:
+    const NetworkDevice* networkDevice = nullptr;
+    QDBusObjectPath devicePath;
+    quint64 generation = 0;                                 // Increased when the device changes, to drop late replies
+
+    QList<WifiAccessPoint*> networks;                       // Sorted by signal strength
+    QHash<QString, WifiAccessPoint*> networkBySsid;
+    QHash<QString, WifiAccessPoint*> networkByAccessPoint;  // Network of every access point path
+    QSet<QString> pendingAccessPoints;                      // Access points whose properties are being fetched
+
+    QTimer scanDebounceTimer;                               // Coalesces rapid scan requests into one RequestScan
+    QTimer scanTimeoutTimer;                                // Stops waiting for a LastScan that never arrives
+    bool scanning = false;                                  // RequestScan sent, LastScan not updated yet
+
+    static bool isStronger(const WifiAccessPoint* network, const WifiAccessPoint* other)
+    {
+        if (network->strength() != other->strength()) return network->strength() > other->strength();
+        return network->ssid.localeAwareCompare(other->ssid) < 0;
+    }
+
+    int sortedRow(const WifiAccessPoint* network) const;
+
+    void addAccessPoint(const QDBusObjectPath& path, const QVariantMap& properties);
+    void updateStrength(const QString& path, uint strength);
+    void removeAccessPoint(const QString& path);
+
+    // Move a network whose strength changed to its sorted row
+    void resort(WifiAccessPoint* network);
+
+    void subscribe();
+    void unsubscribe();
+
+    void startScan();
+    void finishScan(bool success);
+
+private slots:
+    void onAccessPointAdded(const QDBusObjectPath& path);
+    void onAccessPointRemoved(const QDBusObjectPath& path);
+    void onPropertiesChanged(const QString& interfaceName, const QVariantMap& changedProperties, const QStringList& invalidatedProperties, const QDBusMessage& message);
+
+public:
+    static constexpr int scanDebounceInterval = 300;
+    static constexpr int scanTimeout = 30000;
+
+    explicit WifiAccessPointModel(QObject* parent = nullptr);
+
+    ~WifiAccessPointModel()
+    {
+        unsubscribe();
+    }
+
+    // Follow the access points of device. The current access points are taken from tree, so selecting a device
+    // needs no D-Bus call. Calling it again for the same device reconciles the model with a newer tree.
+    void setDevice(const NetworkDevice* device, const NetworkObjectTree* tree);
+
+    // Stop following the device and remove every network
+    void clear();
+
+    // Ask NetworkManager to rescan. Requests made while a scan is pending or running are served by that scan.
+    void requestScan();
+
+    bool isScanning() const
+    {
+        return scanning || scanDebounceTimer.isActive();
+    }
+
+    const NetworkDevice* getDevice() const
+    {
+        return networkDevice;
+    }
+
+    int count() const
+    {
+        return networks.count();
+    }
+
+    WifiAccessPoint* network(int row) const
+    {
+        return networks.value(row);
+    }
+
+signals:
+    void rowInserted(int row);
+    void rowRemoved(int row);
+    void rowMoved(int from, int to);    // The row is taken out at from, then inserted at to
+    void rowChanged(int row);
+
+    void scanStarted();
+    void scanFinished(bool success);
+};
+
+#endif